@@ -0,0 +1,29 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++11
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = cvnirc-qt-bench
+
+SOURCES += main.cpp
+
+# (Not installed; this is a development tool.)
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../include/versioncheck.pro)
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../cvnirc-core/release/ -lcvnirc-core
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../cvnirc-core/debug/ -lcvnirc-core
+else:unix {
+    LIBS += -L$$OUT_PWD/../cvnirc-core/ -lcvnirc-core
+    PRE_TARGETDEPS += ../cvnirc-core/libcvnirc-core.so*
+
+    include(../include/rpath.pro)
+}
+
+INCLUDEPATH += $$PWD/../cvnirc-core
+DEPENDPATH += $$PWD/../cvnirc-core
@@ -0,0 +1,372 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include "irccore.h"
+#include "irccorecontext.h"
+#include "ircprotoclient.h"
+#include "ircprotomessage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace cvnirc::core::IRCProto;
+
+// Count heap allocations, by interposing the C library allocator.
+// (Everything ends up there, including operator new and Qt's containers.)
+#if defined(__GLIBC__)
+#define CVN_HAVE_ALLOC_COUNT
+
+static std::atomic<quint64> allocCounter(0);
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    allocCounter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    allocCounter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    allocCounter.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}  // extern "C"
+#endif
+
+static quint64 allocCount()
+{
+#ifdef CVN_HAVE_ALLOC_COUNT
+    return allocCounter.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+
+// Lines a broken or hostile server might send. (Each one has a known
+// command, so that it makes it all the way to argument conversion.)
+static const char *malformedLines[] = {
+    "PING\r\n",                              // Missing source.
+    "PING a b c\r\n",                        // Trailing arguments.
+    ":nick!user@host JOIN\r\n",              // Missing channels.
+    ":nick!user@host PRIVMSG #chan\r\n",     // Missing text.
+    ":nick!user@host NOTICE\r\n",            // Missing targets and text.
+    ":nick!user@host PRIVMSG a b :c d\r\n",  // Trailing arguments.
+};
+static const int malformedLinesCount = sizeof(malformedLines) / sizeof(malformedLines[0]);
+
+static void report(const char *name, int lines, qint64 nsecs, quint64 failures)
+{
+    printf("%-32s %10.1f ms  %8.1f ns/line  (%llu rejected)\n",
+           name, nsecs / 1e6, double(nsecs) / lines, static_cast<unsigned long long>(failures));
+}
+
+static void benchMalformedParse(int lines)
+{
+    // A message type like the client's PING, set up standalone,
+    // so that the throwing and non-throwing paths can be compared directly.
+    auto originType = std::make_shared<MessageOriginType>("origin", [](const QByteArray &prefixBytes) {
+        return PrefixParts::parse(prefixBytes);
+    }, MessageOrigin::Type::LinkServer);
+    auto commandNameType = std::make_shared<MessageArgType<CommandNameMessageArg>>("command", [](TokensReader *reader) {
+        return std::make_shared<CommandNameMessageArg>(reader->takeToken());
+    });
+    auto sourceType = std::make_shared<MessageArgType<SourceMessageArg>>("source", [](TokensReader *reader) {
+        return std::make_shared<SourceMessageArg>(NetworkString(reader->takeToken()));
+    });
+    auto pingType = MessageType::make_shared("PingType", originType, {
+        make_const_fwd("PingCommandType", commandNameType, "PING"),
+        sourceType,
+    });
+
+    QList<MessageAsTokens> tokensList;
+    for (const char *line : { "PING\r\n", "PING a b c\r\n", "PONG a\r\n" })
+        tokensList.append(MessageOnNetwork { QByteArray(line) }.parse());
+    const int tokensCount = tokensList.length();
+
+    QElapsedTimer timer;
+    quint64 failures = 0;
+
+    timer.start();
+    for (int i = 0; i < lines; i++) {
+        ParseDiagnostic diag;
+        if (!pingType->tryFromMessageAsTokens(tokensList[i % tokensCount], &diag))
+            failures++;
+    }
+    report("parse, diagnostic code", lines, timer.nsecsElapsed(), failures);
+
+    failures = 0;
+    timer.start();
+    for (int i = 0; i < lines; i++) {
+        try {
+            pingType->fromMessageAsTokens(tokensList[i % tokensCount]);
+        }
+        catch (const std::runtime_error &) {
+            failures++;
+        }
+    }
+    report("parse, exceptions (for reference)", lines, timer.nsecsElapsed(), failures);
+}
+
+static void benchMalformedClient(int lines)
+{
+    IRCProtoClient client;
+    quint64 failures = 0;
+    QObject::connect(&client, &IRCProtoClient::notifyUser, [&failures](const QString &) {
+        failures++;
+    });
+
+    QList<MessageOnNetwork> raws;
+    for (int i = 0; i < malformedLinesCount; i++)
+        raws.append(MessageOnNetwork { QByteArray(malformedLines[i]) });
+    const int rawsCount = raws.length();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < lines; i++)
+        client.receivedRaw(raws[i % rawsCount]);
+    report("client receivedRaw()", lines, timer.nsecsElapsed(), failures);
+}
+
+
+enum class Stage {
+    Frame,
+    Tokenize,
+    Type,
+    Route,
+    Render,
+};
+static const int stageCount = 5;
+static const char *stageNames[stageCount] = { "frame", "tokenize", "type", "route", "render" };
+
+class StageStats
+{
+public:
+    qint64  nsecs = 0;
+    quint64 allocs = 0;
+};
+
+// Stands in for the frontend's log buffer: Roughly what
+// LogBuffer::appendLine() does, minus the widget.
+class RenderSink
+{
+    QString _prefix = "[00:00:00] ";
+    QString _document;
+    QElapsedTimer _timer;
+
+public:
+    StageStats stats;
+
+    void render(const QString &line)
+    {
+        const quint64 allocsBefore = allocCount();
+        _timer.start();
+
+        QString fullLine;
+        fullLine.reserve(_prefix.length() + line.length() + 1);
+        fullLine.append(_prefix).append(line).append('\n');
+        _document.append(fullLine);
+        if (_document.length() >= 1*1024*1024)
+            _document.clear();
+
+        stats.nsecs += _timer.nsecsElapsed();
+        stats.allocs += allocCount() - allocsBefore;
+    }
+};
+
+// Feeds a capture through the stages of IRCProtoClient::receivedRaw()
+// and the IRCCore context graph, timing each stage as a batch.
+static bool replayOnce(const QByteArray &capture, int chunkSize, StageStats *stats, quint64 *messages)
+{
+    RenderSink sink;  // (Before core, so it outlives the contexts.)
+    IRCCore core;
+    auto attach = [&sink](IRCCoreContext *context) {
+        QObject::connect(context, &IRCCoreContext::notifyUser, [&sink](const QString &line, IRCCoreContext *) {
+            sink.render(line);
+        });
+    };
+    IRCCoreContext *serverContext = core.createIRCProtoClient();
+    attach(serverContext);
+    QObject::connect(&core, &IRCCore::createdContext, attach);
+    IRCProtoClient *client = serverContext->ircProtoClient();
+
+    QElapsedTimer timer;
+    quint64 allocsBefore = 0;
+    auto begin = [&]() {
+        allocsBefore = allocCount();
+        timer.start();
+    };
+    auto end = [&](Stage stage) {
+        StageStats &s(stats[int(stage)]);
+        s.nsecs += timer.nsecsElapsed();
+        s.allocs += allocCount() - allocsBefore;
+    };
+
+    // Frame: Split into lines, in socket-read-sized chunks.
+    QList<MessageOnNetwork> raws;
+    begin();
+    LineFramer framer;
+    MessageOnNetwork raw;
+    for (int pos = 0; pos < capture.length(); pos += chunkSize) {
+        framer.append(capture.constData() + pos, qMin(chunkSize, capture.length() - pos));
+        while (framer.takeLine(&raw))
+            raws.append(raw);
+        if (framer.error() != LineFramer::Error::None)
+            break;
+    }
+    end(Stage::Frame);
+    if (framer.error() != LineFramer::Error::None) {
+        fprintf(stderr, "Capture has broken framing after %d lines\n", raws.length());
+        return false;
+    }
+
+    // Tokenize.
+    std::vector<Incoming> incomings;
+    begin();
+    incomings.reserve(raws.length());
+    for (const MessageOnNetwork &raw : raws)
+        incomings.emplace_back(std::make_shared<MessageOnNetwork>(raw), std::make_shared<MessageAsTokens>(raw.parse()));
+    end(Stage::Tokenize);
+
+    // Type.
+    std::vector<Incoming *> typed;
+    begin();
+    typed.reserve(incomings.size());
+    for (Incoming &in : incomings) {
+        if (client->typeIncoming(&in))
+            typed.push_back(&in);
+    }
+    end(Stage::Type);
+
+    // Route (and render, which happens from within; taken apart below).
+    begin();
+    for (Incoming *in : typed)
+        client->dispatchIncoming(in);
+    end(Stage::Route);
+
+    StageStats &route(stats[int(Stage::Route)]);
+    route.nsecs  -= sink.stats.nsecs;
+    route.allocs -= sink.stats.allocs;
+    stats[int(Stage::Render)].nsecs  += sink.stats.nsecs;
+    stats[int(Stage::Render)].allocs += sink.stats.allocs;
+
+    *messages += raws.length();
+    return true;
+}
+
+static bool benchReplay(const QByteArray &capture, int iterations, int chunkSize)
+{
+    StageStats stats[stageCount];
+    quint64 messages = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        if (!replayOnce(capture, chunkSize, stats, &messages))
+            return false;
+    }
+
+    if (messages == 0) {
+        fputs("Capture contains no messages\n", stderr);
+        return false;
+    }
+
+    qint64 totalNSecs = 0;
+    quint64 totalAllocs = 0;
+    printf("%-10s %12s %12s %14s\n", "stage", "ms", "ns/msg", "allocs/msg");
+    for (int i = 0; i < stageCount; i++) {
+        totalNSecs  += stats[i].nsecs;
+        totalAllocs += stats[i].allocs;
+        printf("%-10s %12.1f %12.1f %14.2f\n", stageNames[i],
+               stats[i].nsecs / 1e6, double(stats[i].nsecs) / messages, double(stats[i].allocs) / messages);
+    }
+    printf("%-10s %12.1f %12.1f %14.2f\n", "total",
+           totalNSecs / 1e6, double(totalNSecs) / messages, double(totalAllocs) / messages);
+    printf("\n%llu messages, %.0f messages/s\n",
+           static_cast<unsigned long long>(messages), messages / (totalNSecs / 1e9));
+#ifndef CVN_HAVE_ALLOC_COUNT
+    puts("(Allocation counting is not supported on this platform.)");
+#endif
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("canvon IRC client built-with-Qt-framework benchmarks");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Traffic capture (see /record), or plain traffic as received from an IRC server, to replay. "
+                                            "Without it, a malformed-lines benchmark is run instead.", "[capture]");
+
+    QCommandLineOption optLines({ "n", "lines" }, "Number of malformed lines to feed per benchmark.", "count", "1000000");
+    QCommandLineOption optIterations({ "i", "iterations" }, "Number of times to replay the capture.", "count", "1");
+    QCommandLineOption optChunkSize("chunk-size", "Bytes to hand to the line framer at once, like a socket read would.", "bytes", "10240");
+    if (!parser.addOption(optLines) || !parser.addOption(optIterations) || !parser.addOption(optChunkSize)) {
+        fputs("Failed to add options\n", stderr);
+        return 1;
+    }
+
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.length() > 1) {
+        fputs("Too many arguments\n", stderr);
+        return 1;
+    }
+
+    if (args.length() == 1) {
+        bool ok = false, ok2 = false;
+        const int iterations = parser.value(optIterations).toInt(&ok);
+        const int chunkSize = parser.value(optChunkSize).toInt(&ok2);
+        if (!ok || iterations <= 0 || !ok2 || chunkSize <= 0) {
+            fputs("Invalid number of iterations or chunk size\n", stderr);
+            return 1;
+        }
+
+        QFile file(args.front());
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "Can't open capture: %s\n", qPrintable(file.errorString()));
+            return 1;
+        }
+
+        QByteArray data = file.readAll();
+        if (TrafficCapture::isCapture(data)) {
+            // (Recorded via /record; replay what was received.)
+            TrafficCapture capture;
+            QString errorString;
+            if (!TrafficCapture::fromBytes(data, &capture, &errorString))
+                fprintf(stderr, "Capture is damaged, replaying what could be read: %s\n", qPrintable(errorString));
+            data = capture.receivedStream();
+        }
+
+        return benchReplay(data, iterations, chunkSize) ? 0 : 1;
+    }
+
+    bool ok = false;
+    const int lines = parser.value(optLines).toInt(&ok);
+    if (!ok || lines <= 0) {
+        fputs("Invalid number of lines\n", stderr);
+        return 1;
+    }
+
+    printf("Feeding %d malformed lines per benchmark.\n", lines);
+    benchMalformedParse(lines);
+    benchMalformedClient(lines);
+
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include "bouncer.h"
+
+#include <QDateTime>
+#include <QLocalSocket>
+#include "irccorecommandgroup.h"
+
+#include <random>
+#include <stdio.h>
+#include <stdexcept>
+#include <string>
+
+using namespace cvnirc::core::RemoteProto;
+
+Bouncer::Bouncer(const Options &options, QObject *parent) : QObject(parent),
+    _options(options),
+    _irc(this),
+    _cmdLayer(this)
+{
+    if (_options.scrollbackLines <= 0)
+        throw std::invalid_argument("Bouncer: Scrollback lines must be positive");
+    _irc.setScrollbackMaxLines(_options.scrollbackLines);
+
+    // (Tells frontends re-attaching whether what they know is about us.)
+    std::random_device random;
+    _instance = (quint64(random()) << 32 | random()) | 1;
+
+    _cmdLayer.rootCommandGroup().addSubGroup(new IRCCoreCommandGroup(&_irc, "IRC"));
+
+    _server.setSocketOptions(QLocalServer::UserAccessOption);
+    connect(&_server, &QLocalServer::newConnection, this, &Bouncer::handle_server_newConnection);
+
+    _flushTimer.setSingleShot(true);
+    connect(&_flushTimer, &QTimer::timeout, this, &Bouncer::handle_flushTimer_timeout);
+
+    connect(&_irc, &IRCCore::createdContext, this, &Bouncer::handle_irc_createdContext);
+}
+
+bool Bouncer::listen()
+{
+    if (_server.listen(_options.socketName))
+        return true;
+
+    if (_server.serverError() != QAbstractSocket::AddressInUseError)
+        return false;
+
+    // Left behind by a bouncer that didn't exit cleanly? (Don't steal it from a live one.)
+    QLocalSocket probe;
+    probe.connectToServer(_options.socketName);
+    if (probe.waitForConnected(1000))
+        return false;
+
+    QLocalServer::removeServer(_options.socketName);
+    return _server.listen(_options.socketName);
+}
+
+QString Bouncer::errorString() const
+{
+    return _server.errorString();
+}
+
+QString Bouncer::fullServerName() const
+{
+    return _server.fullServerName();
+}
+
+IRCCore &Bouncer::irc()
+{
+    return _irc;
+}
+
+void Bouncer::connectToIRCServer(const QString &host, const QString &port, const QString &user, const QString &nick)
+{
+    _irc.connectToIRCServer(host, port, user, nick);
+}
+
+void Bouncer::handle_server_newConnection()
+{
+    while (QLocalSocket *socket = _server.nextPendingConnection()) {
+        _clients.insert(socket, Client());
+        connect(socket, &QLocalSocket::readyRead, this, &Bouncer::handle_client_readyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &Bouncer::handle_client_disconnected);
+        connect(socket, &QLocalSocket::bytesWritten, this, &Bouncer::handle_client_bytesWritten);
+        printf("Frontend connected (%d now)\n", _clients.count());
+        fflush(stdout);
+    }
+}
+
+void Bouncer::handle_client_readyRead()
+{
+    auto *socket = qobject_cast<QLocalSocket *>(sender());
+    if (socket == nullptr || !_clients.contains(socket))
+        return;
+
+    Client &client(_clients[socket]);
+    client.decoder.append(socket->readAll());
+
+    try {
+        MessageType type;
+        QByteArray payload;
+        while (client.decoder.takeFrame(&type, &payload))
+            _receivedFrame(&client, type, payload);
+    }
+    catch (const std::runtime_error &ex) {
+        printf("Frontend protocol error, detaching it: %s\n", ex.what());
+        fflush(stdout);
+        socket->abort();
+    }
+}
+
+void Bouncer::handle_client_disconnected()
+{
+    auto *socket = qobject_cast<QLocalSocket *>(sender());
+    if (socket == nullptr || !_clients.contains(socket))
+        return;
+
+    _clients.remove(socket);
+    socket->deleteLater();
+    printf("Frontend detached (%d left)\n", _clients.count());
+    fflush(stdout);
+}
+
+void Bouncer::handle_client_bytesWritten()
+{
+    auto *socket = qobject_cast<QLocalSocket *>(sender());
+    if (socket == nullptr || !_clients.contains(socket))
+        return;
+
+    // (Room for more of the replay, maybe.)
+    if (!_clients[socket].replay.empty())
+        _scheduleFlush();
+}
+
+void Bouncer::handle_flushTimer_timeout()
+{
+    QList<QLocalSocket *> tooSlow;
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        QLocalSocket *socket = it.key();
+        Client &client(it.value());
+        if (!client.replay.empty()) {
+            _continueReplay(socket, &client);
+
+            // Live lines wait till the replay is through; the backlog
+            // limit is about those only. (However big the replay.)
+            if (!client.replay.empty()) {
+                if (client.heldBytes + client.writer.size() > _options.maxClientBacklogBytes)
+                    tooSlow.append(socket);
+                continue;
+            }
+        }
+
+        if (client.writer.isEmpty())
+            continue;
+
+        // Don't let a frontend that doesn't read make us hoard memory.
+        // (What's left of a replay in the socket is below a chunk's worth.)
+        if (socket->bytesToWrite() + client.writer.size() > _options.maxClientBacklogBytes) {
+            tooSlow.append(socket);
+            continue;
+        }
+
+        socket->write(client.writer.take());
+    }
+
+    // (Aborting may detach the client right away; so not while iterating.)
+    for (QLocalSocket *socket : tooSlow) {
+        printf("Frontend not keeping up, detaching it\n");
+        fflush(stdout);
+        socket->abort();
+    }
+}
+
+void Bouncer::handle_irc_createdContext(IRCCoreContext *context)
+{
+    _contexts.push_back({ context, 0, context->scrollback().endSeq() });
+    const quint32 contextId = quint32(_contexts.size());
+    _contextIds.insert(context, contextId);
+
+    connect(context, &IRCCoreContext::notifyUser, this, &Bouncer::handle_context_notifyUser);
+    connect(context, &IRCCoreContext::connectionStateChanged, this, &Bouncer::handle_context_connectionStateChanged);
+    connect(context, &IRCCoreContext::disambiguatorChanged, this, &Bouncer::handle_context_disambiguatorChanged);
+
+    _contextChanged(contextId);
+}
+
+void Bouncer::handle_context_notifyUser(const QString &line, IRCCoreContext *context)
+{
+    const quint32 contextId = _contextIds.value(context);
+    if (contextId == 0)
+        return;
+
+    // A line the context logged is the newest in its scrollback; sent with
+    // its time from there, so it's the same live and replayed. (What isn't
+    // logged, e.g. command output, is stamped now.)
+    ContextEntry &contextEntry(_contexts[contextId - 1]);
+    const Scrollback &scrollback(context->scrollback());
+    qint64 msecs = QDateTime::currentMSecsSinceEpoch();
+    Scrollback::Entry logged;
+    if (scrollback.endSeq() != contextEntry.loggedSeq && scrollback.entry(scrollback.endSeq() - 1, &logged))
+        msecs = logged.msecs;
+    contextEntry.loggedSeq = scrollback.endSeq();
+
+    const QByteArray text = line.toUtf8();
+
+    bool any = false;
+    for (Client &client : _clients) {
+        if (!client.subscribedAll && !client.subscriptions.contains(contextId))
+            continue;
+
+        if (client.replay.empty()) {
+            client.writer.writeLine(contextId, msecs, text);
+        }
+        else {
+            // (Encoded when its turn comes, for the timestamp deltas.)
+            ReplayItem item;
+            item.kind = ReplayItem::Kind::Line;
+            item.contextId = contextId;
+            item.msecs = msecs;
+            item.text = text;
+            client.replay.push_back(item);
+            client.heldBytes += text.length();
+        }
+        any = true;
+    }
+    if (any)
+        _scheduleFlush();
+}
+
+void Bouncer::handle_context_connectionStateChanged(IRCCoreContext *context)
+{
+    const quint32 contextId = _contextIds.value(context);
+    if (contextId == 0)
+        return;
+
+    // (Re-attaching frontends get it via the snapshot; attached ones right away.)
+    _contexts[contextId - 1].revision = ++_revision;
+    const quint8 state = quint8(context->ircProtoClient()->connectionState());
+    for (Client &client : _clients) {
+        if (client.attached)
+            client.writer.writeState(contextId, state);
+    }
+    _scheduleFlush();
+}
+
+void Bouncer::handle_context_disambiguatorChanged(IRCCoreContext *context)
+{
+    const quint32 contextId = _contextIds.value(context);
+    if (contextId == 0)
+        return;
+
+    _contextChanged(contextId);
+}
+
+void Bouncer::_receivedFrame(Client *client, MessageType type, const QByteArray &payload)
+{
+    Reader reader(payload);
+
+    if (type == MessageType::Attach) {
+        const quint64 instance = reader.varint();
+        const quint64 revision = reader.varint();
+        reader.expectEnd();
+        _attach(client, instance, revision);
+        return;
+    }
+
+    if (!client->attached) {
+        client->writer.writeError("Not attached");
+        _scheduleFlush();
+        return;
+    }
+
+    try {
+        switch (type) {
+        case MessageType::Subscribe: {
+            const quint64 contextId = reader.varint();
+            const quint64 replayLines = reader.varint();
+            reader.expectEnd();
+            if (contextId > _contexts.size())
+                throw std::invalid_argument("Subscribe: No such context");
+
+            if (contextId == 0)
+                client->subscribedAll = true;
+            else
+                client->subscriptions.insert(quint32(contextId));
+            _replay(client, quint32(contextId), quint32(qMin<quint64>(replayLines, 0xffffffffu)));
+            break;
+        }
+        case MessageType::Unsubscribe: {
+            const quint64 contextId = reader.varint();
+            reader.expectEnd();
+            if (contextId == 0) {
+                client->subscribedAll = false;
+                client->subscriptions.clear();
+            }
+            else {
+                client->subscriptions.remove(quint32(contextId));
+            }
+            break;
+        }
+        case MessageType::Input: {
+            const quint64 contextId = reader.varint();
+            const QString text = reader.string();
+            reader.expectEnd();
+            if (contextId == 0 || contextId > _contexts.size())
+                throw std::invalid_argument("Input: No such context");
+
+            // (Commands fail in all kinds of ways; that's for the user to see.)
+            try {
+                _cmdLayer.processUserInput(text, _contexts[contextId - 1].context);
+            }
+            catch (const std::exception &ex) {
+                client->writer.writeError(ex.what());
+                _scheduleFlush();
+            }
+            break;
+        }
+        case MessageType::Connect: {
+            const QString host = reader.string();
+            const QString port = reader.string();
+            const QString user = reader.string();
+            const QString nick = reader.string();
+            reader.expectEnd();
+            try {
+                connectToIRCServer(host, port, user, nick);
+            }
+            catch (const std::exception &ex) {
+                client->writer.writeError(ex.what());
+                _scheduleFlush();
+            }
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unknown message type " + std::to_string(int(type)));
+        }
+    }
+    catch (const std::invalid_argument &ex) {
+        // (The frontend's or the user's mistake; the connection is fine.)
+        client->writer.writeError(ex.what());
+        _scheduleFlush();
+    }
+}
+
+void Bouncer::_attach(Client *client, quint64 instance, quint64 revision)
+{
+    // (What the frontend knows is about some other bouncer.)
+    if (instance != _instance)
+        revision = 0;
+
+    QList<ContextInfo> changed;
+    for (quint32 i = 0; i < _contexts.size(); i++) {
+        if (_contexts[i].revision > revision)
+            changed.append(_contextInfo(i + 1));
+    }
+
+    client->attached = true;
+    client->writer.writeHello(_instance);
+    client->writer.writeContexts(_revision, changed);
+    _scheduleFlush();
+}
+
+void Bouncer::_replay(Client *client, quint32 contextId, quint32 lines)
+{
+    // Only noted down here (what's there now; lines coming in later go
+    // out live, after it); _continueReplay() sends it bit by bit.
+    ReplayItem item;
+
+    const quint32 first = contextId == 0 ? 1 : contextId;
+    const quint32 last = contextId == 0 ? quint32(_contexts.size()) : contextId;
+    for (quint32 id = first; id <= last && lines > 0; id++) {
+        const Scrollback &scrollback(_contexts[id - 1].context->scrollback());
+        item.kind = ReplayItem::Kind::Lines;
+        item.contextId = id;
+        item.endSeq = scrollback.endSeq();
+        item.nextSeq = item.endSeq - qMin<quint64>(lines, item.endSeq - scrollback.firstSeq());
+        if (item.nextSeq < item.endSeq)
+            client->replay.push_back(item);
+    }
+
+    item.kind = ReplayItem::Kind::Done;
+    item.contextId = contextId;
+    client->replay.push_back(item);
+    _scheduleFlush();
+}
+
+void Bouncer::_continueReplay(QLocalSocket *socket, Client *client)
+{
+    // (Whatever else is in the writer by now goes out along with it.)
+    Writer &writer(client->writer);
+    while (!client->replay.empty() && socket->bytesToWrite() + writer.size() < replayChunkBytes) {
+        ReplayItem &item(client->replay.front());
+        switch (item.kind) {
+        case ReplayItem::Kind::Lines: {
+            // (Lines that fell out of the scrollback meanwhile get skipped.)
+            const Scrollback &scrollback(_contexts[item.contextId - 1].context->scrollback());
+            int written = 0;
+            for (const Scrollback::Entry &entry : scrollback.page(item.nextSeq, replayPageLines)) {
+                if (entry.seq >= item.endSeq)
+                    break;
+                writer.writeLine(item.contextId, entry.msecs, entry.toDisplayString().toUtf8());
+                item.nextSeq = entry.seq + 1;
+                written++;
+            }
+            if (written > 0 && item.nextSeq < item.endSeq)
+                continue;
+            break;
+        }
+        case ReplayItem::Kind::Done:
+            writer.writeReplayDone(item.contextId);
+            break;
+        case ReplayItem::Kind::Line:
+            writer.writeLine(item.contextId, item.msecs, item.text);
+            client->heldBytes -= item.text.length();
+            break;
+        }
+
+        client->replay.pop_front();
+    }
+
+    if (!writer.isEmpty())
+        socket->write(writer.take());
+}
+
+void Bouncer::_contextChanged(quint32 contextId)
+{
+    _contexts[contextId - 1].revision = ++_revision;
+
+    const QList<ContextInfo> changed { _contextInfo(contextId) };
+    for (Client &client : _clients) {
+        if (client.attached)
+            client.writer.writeContexts(_revision, changed);
+    }
+    _scheduleFlush();
+}
+
+ContextInfo Bouncer::_contextInfo(quint32 contextId) const
+{
+    IRCCoreContext *context = _contexts[contextId - 1].context;
+
+    ContextInfo info;
+    info.id = contextId;
+    info.type = quint8(context->type());
+    if (context->type() == IRCCoreContext::Type::Server)
+        info.state = quint8(context->ircProtoClient()->connectionState());
+    info.disambiguator = context->disambiguator();
+    return info;
+}
+
+void Bouncer::_scheduleFlush()
+{
+    if (!_clients.isEmpty() && !_flushTimer.isActive())
+        _flushTimer.start(0);
+}
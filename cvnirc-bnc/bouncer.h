@@ -0,0 +1,124 @@
+#ifndef BOUNCER_H
+#define BOUNCER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QLocalServer>
+#include <QSet>
+#include <QTimer>
+#include <deque>
+#include <vector>
+#include "irccore.h"
+#include "commandlayer.h"
+#include "remoteproto.h"
+
+class QLocalSocket;
+
+// Keeps the IRC connections (and what happened on them) while no
+// frontend is around. Frontends attach over a local socket, speaking
+// the binary protocol described in remoteproto.h.
+class Bouncer : public QObject
+{
+    Q_OBJECT
+
+public:
+    class Options
+    {
+    public:
+        QString socketName = "cvnirc-bnc";
+        int scrollbackLines = 1000;  // (Per context; kept by the contexts themselves.)
+        qint64 maxClientBacklogBytes = 16 * 1024 * 1024;  // (Of live output; replays are streamed.)
+    };
+
+    // Replays go out a bit at a time, whenever the socket's write
+    // buffer got down below this.
+    static const qint64 replayChunkBytes = 256 * 1024;
+    static const int replayPageLines = 256;
+
+private:
+    class ContextEntry
+    {
+    public:
+        IRCCoreContext *context;
+        quint64 revision;  // (Of the last change.)
+        quint64 loggedSeq;  // (Scrollback end as of the last line sent out.)
+    };
+
+    // What's still to be sent of a replay, in order.
+    class ReplayItem
+    {
+    public:
+        enum class Kind {
+            Lines,  // (Of one context, as of the subscribe.)
+            Done,
+            Line,   // (Live, come in meanwhile; goes after the replayed ones.)
+        };
+
+        Kind       kind;
+        quint32    contextId = 0;
+        quint64    nextSeq = 0, endSeq = 0;
+        qint64     msecs = 0;
+        QByteArray text;
+    };
+
+    class Client
+    {
+    public:
+        cvnirc::core::RemoteProto::Decoder decoder;
+        // (Line frames are delta-coded; all of them go through here, in order.)
+        cvnirc::core::RemoteProto::Writer  writer;
+        std::deque<ReplayItem> replay;
+        qint64 heldBytes = 0;  // (Of live lines queued behind the replay.)
+        bool attached = false;
+        bool subscribedAll = false;
+        QSet<quint32> subscriptions;
+    };
+
+    Options _options;
+    IRCCore _irc;
+    CommandLayer _cmdLayer;
+    QLocalServer _server;
+    quint64 _instance;
+    quint64 _revision = 0;
+
+    std::vector<ContextEntry> _contexts;  // (Context id is index + 1.)
+    QHash<IRCCoreContext *, quint32> _contextIds;
+
+    QHash<QLocalSocket *, Client> _clients;
+    QTimer _flushTimer;  // (Batches writes to the clients per event loop iteration.)
+
+public:
+    explicit Bouncer(const Options &options, QObject *parent = 0);
+
+    bool listen();
+    QString errorString() const;
+    QString fullServerName() const;
+
+    IRCCore &irc();
+    void connectToIRCServer(const QString &host, const QString &port, const QString &user, const QString &nick);
+
+private slots:
+    void handle_server_newConnection();
+    void handle_client_readyRead();
+    void handle_client_disconnected();
+    void handle_client_bytesWritten();
+    void handle_flushTimer_timeout();
+
+    void handle_irc_createdContext(IRCCoreContext *context);
+    void handle_context_notifyUser(const QString &line, IRCCoreContext *context);
+    void handle_context_connectionStateChanged(IRCCoreContext *context);
+    void handle_context_disambiguatorChanged(IRCCoreContext *context);
+
+private:
+    void _receivedFrame(Client *client, cvnirc::core::RemoteProto::MessageType type, const QByteArray &payload);
+    void _attach(Client *client, quint64 instance, quint64 revision);
+    void _replay(Client *client, quint32 contextId, quint32 lines);
+    void _continueReplay(QLocalSocket *socket, Client *client);
+
+    void _contextChanged(quint32 contextId);
+    cvnirc::core::RemoteProto::ContextInfo _contextInfo(quint32 contextId) const;
+    void _scheduleFlush();
+};
+
+#endif // BOUNCER_H
@@ -0,0 +1,72 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "bouncer.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("canvon IRC client built-with-Qt-framework bouncer daemon (keeps connections, frontends attach locally)");
+    parser.addHelpOption();
+
+    Bouncer::Options options;
+    QCommandLineOption optSocket({ "s", "socket" }, "Local socket name (or path) to listen on.", "name", options.socketName);
+    QCommandLineOption optScrollback("scrollback", "Lines of scrollback to keep per context.", "count", QString::number(options.scrollbackLines));
+    QCommandLineOption optConnect({ "c", "connect" }, "Connect to an IRC server at startup (may be given repeatedly).", "\"host port user nick\"");
+    QCommandLineOption optLogDir("log-dir", "Keep chat logs in this directory.", "dir");
+    for (const QCommandLineOption &option : { optSocket, optScrollback, optConnect, optLogDir }) {
+        if (!parser.addOption(option)) {
+            fputs("Failed to add options\n", stderr);
+            return 1;
+        }
+    }
+
+    parser.process(a);
+
+    bool ok = false;
+    options.socketName = parser.value(optSocket);
+    options.scrollbackLines = parser.value(optScrollback).toInt(&ok);
+    if (!ok || options.scrollbackLines <= 0 || options.socketName.isEmpty()) {
+        fputs("Invalid option value\n", stderr);
+        return 1;
+    }
+    if (options.scrollbackLines > Scrollback::maxMaxLines) {
+        fprintf(stderr, "Too much scrollback, at most %d lines\n", Scrollback::maxMaxLines);
+        return 1;
+    }
+
+    QList<QStringList> connects;
+    for (const QString &value : parser.values(optConnect)) {
+        const QStringList args = value.split(' ', QString::SkipEmptyParts);
+        if (args.count() != 4) {
+            fprintf(stderr, "Invalid connect argument \"%s\", need \"host port user nick\"\n", qPrintable(value));
+            return 1;
+        }
+        connects.append(args);
+    }
+
+    Bouncer bouncer(options);
+    if (!bouncer.listen()) {
+        fprintf(stderr, "Can't listen: %s\n", qPrintable(bouncer.errorString()));
+        return 1;
+    }
+
+    printf("Listening on %s\n", qPrintable(bouncer.fullServerName()));
+    fflush(stdout);
+
+    if (parser.isSet(optLogDir)) {
+        QString errorString;
+        if (!bouncer.irc().chatLog().start(parser.value(optLogDir), &errorString)) {
+            fprintf(stderr, "Can't log to \"%s\": %s\n", qPrintable(parser.value(optLogDir)), qPrintable(errorString));
+            return 1;
+        }
+    }
+
+    for (const QStringList &args : connects)
+        bouncer.connectToIRCServer(args[0], args[1], args[2], args[3]);
+
+    return a.exec();
+}
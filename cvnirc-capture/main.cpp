@@ -0,0 +1,215 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include "ircprotorecorder.h"
+
+#include <stdio.h>
+
+using namespace cvnirc::core::IRCProto;
+
+// Text form of a capture, one record per line:
+//
+//   #capture wallclock-start-ms=N monotonic-start-ns=N
+//   NSECS in|out ESCAPED-BYTES
+//
+// Backslash, CR, LF and other unprintable bytes get escaped
+// as \\, \r, \n and \xHH, respectively.
+
+static QByteArray escapeBytes(const QByteArray &bytes)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    QByteArray ret;
+    ret.reserve(bytes.length() + 4);
+    for (char c : bytes) {
+        const auto u = static_cast<unsigned char>(c);
+        if (c == '\\')
+            ret.append("\\\\");
+        else if (c == '\r')
+            ret.append("\\r");
+        else if (c == '\n')
+            ret.append("\\n");
+        else if (u < 0x20 || u >= 0x7f)
+            ret.append("\\x").append(hexDigits[u >> 4]).append(hexDigits[u & 0xf]);
+        else
+            ret.append(c);
+    }
+    return ret;
+}
+
+static bool unescapeBytes(const QByteArray &escaped, QByteArray *bytes)
+{
+    bytes->clear();
+    const int len = escaped.length();
+    for (int i = 0; i < len; i++) {
+        char c = escaped[i];
+        if (c != '\\') {
+            bytes->append(c);
+            continue;
+        }
+
+        if (++i >= len)
+            return false;
+
+        switch (escaped[i]) {
+        case '\\':
+            bytes->append('\\');
+            break;
+        case 'r':
+            bytes->append('\r');
+            break;
+        case 'n':
+            bytes->append('\n');
+            break;
+        case 'x': {
+            if (i + 2 >= len)
+                return false;
+            bool ok = false;
+            const int value = escaped.mid(i + 1, 2).toInt(&ok, 16);
+            if (!ok)
+                return false;
+            bytes->append(char(value));
+            i += 2;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+static QByteArray captureToText(const TrafficCapture &capture)
+{
+    QByteArray ret = "#capture wallclock-start-ms=" + QByteArray::number(capture.wallclockStartMSecs) +
+                     " monotonic-start-ns=" + QByteArray::number(capture.monotonicStartNSecs) + "\n";
+    for (const TrafficRecord &record : capture.records) {
+        ret.append(QByteArray::number(record.nsecs))
+           .append(record.direction == TrafficRecord::Direction::Sent ? " out " : " in ")
+           .append(escapeBytes(record.bytes))
+           .append('\n');
+    }
+    return ret;
+}
+
+static bool captureFromText(const QByteArray &text, TrafficCapture *capture, QString *errorString)
+{
+    int lineNo = 0;
+    for (const QByteArray &line : text.split('\n')) {
+        lineNo++;
+        if (line.isEmpty())
+            continue;
+
+        if (line.startsWith("#capture ")) {
+            for (const QByteArray &field : line.mid(9).split(' ')) {
+                if (field.startsWith("wallclock-start-ms="))
+                    capture->wallclockStartMSecs = field.mid(19).toLongLong();
+                else if (field.startsWith("monotonic-start-ns="))
+                    capture->monotonicStartNSecs = field.mid(19).toULongLong();
+            }
+            continue;
+        }
+        if (line.startsWith('#'))
+            continue;
+
+        const int space1 = line.indexOf(' ');
+        const int space2 = space1 < 0 ? -1 : line.indexOf(' ', space1 + 1);
+        TrafficRecord record;
+        bool ok = space2 > 0;
+        if (ok)
+            record.nsecs = line.left(space1).toULongLong(&ok);
+
+        const QByteArray direction = ok ? line.mid(space1 + 1, space2 - (space1 + 1)) : QByteArray();
+        if (direction == "in")
+            record.direction = TrafficRecord::Direction::Received;
+        else if (direction == "out")
+            record.direction = TrafficRecord::Direction::Sent;
+        else
+            ok = false;
+
+        if (!ok || !unescapeBytes(line.mid(space2 + 1), &record.bytes)) {
+            *errorString = "Syntax error in line " + QString::number(lineNo);
+            return false;
+        }
+
+        capture->records.append(record);
+    }
+    return true;
+}
+
+static bool readFile(const QString &fileName, QByteArray *data)
+{
+    QFile file;
+    bool ok = fileName == "-" ? file.open(stdin, QIODevice::ReadOnly) : (file.setFileName(fileName), file.open(QIODevice::ReadOnly));
+    if (!ok) {
+        fprintf(stderr, "Can't open %s: %s\n", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+
+    *data = file.readAll();
+    return true;
+}
+
+static bool writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file;
+    bool ok = fileName == "-" ? file.open(stdout, QIODevice::WriteOnly) : (file.setFileName(fileName), file.open(QIODevice::WriteOnly));
+    if (!ok || file.write(data) != data.length()) {
+        fprintf(stderr, "Can't write %s: %s\n", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("canvon IRC client built-with-Qt-framework traffic capture converter");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Capture to convert (\"-\" for stdin).");
+    parser.addPositionalArgument("output", "Where to write the result (\"-\" for stdout).");
+
+    QCommandLineOption optFromText({ "t", "from-text" }, "Convert text to binary capture. (Default is the other way around.)");
+    if (!parser.addOption(optFromText)) {
+        fputs("Failed to add options\n", stderr);
+        return 1;
+    }
+
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.length() != 2) {
+        fputs("Need input and output\n", stderr);
+        return 1;
+    }
+
+    QByteArray input;
+    if (!readFile(args[0], &input))
+        return 1;
+
+    TrafficCapture capture;
+    QString errorString;
+    if (parser.isSet(optFromText)) {
+        if (!captureFromText(input, &capture, &errorString)) {
+            fprintf(stderr, "%s: %s\n", qPrintable(args[0]), qPrintable(errorString));
+            return 1;
+        }
+
+        return writeFile(args[1], capture.toBytes()) ? 0 : 1;
+    }
+
+    bool ok = TrafficCapture::fromBytes(input, &capture, &errorString);
+    if (!ok) {
+        // (Convert what could be read anyway; but do report it.)
+        fprintf(stderr, "%s: %s\n", qPrintable(args[0]), qPrintable(errorString));
+        if (capture.records.isEmpty())
+            return 1;
+    }
+
+    if (!writeFile(args[1], captureToText(capture)))
+        return 1;
+
+    return ok ? 0 : 1;
+}
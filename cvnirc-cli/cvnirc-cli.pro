@@ -11,10 +11,14 @@ TEMPLATE = app
 TARGET = cvnirc-qt-cli
 
 SOURCES += main.cpp \
-    terminalui.cpp
+    terminalui.cpp \
+    remoteterminalui.cpp \
+    readlineout.cpp
 
 HEADERS += \
-    terminalui.h
+    terminalui.h \
+    remoteterminalui.h \
+    readlineout.h
 
 unix {
     target.path = /usr/local/bin
@@ -1,5 +1,6 @@
 #include <QCoreApplication>
 #include "terminalui.h"
+#include "remoteterminalui.h"
 #include <QCommandLineParser>
 
 #include <stdlib.h>
@@ -8,6 +9,7 @@
 #include <readline/history.h>
 
 TerminalUI *pUI;
+RemoteTerminalUI *pRemoteUI;
 
 static void cb_linehandler(char *lineC)
 {
@@ -24,12 +26,15 @@ static void cb_linehandler(char *lineC)
         return qApp->exit();
     }
 
-    pUI->queueUserInput(line);
+    if (pRemoteUI != nullptr)
+        pRemoteUI->queueUserInput(line);
+    else
+        pUI->queueUserInput(line);
 }
 
 int cycle_context(int count, int /* key */)
 {
-    if (!pUI->cycleCurrentContext(count))
+    if (!(pRemoteUI != nullptr ? pRemoteUI->cycleCurrentContext(count) : pUI->cycleCurrentContext(count)))
         return 1;
 
     return 0;
@@ -52,6 +57,19 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    QCommandLineOption optAttach("attach", "Attach to a running core (like cvnirc-bnc) at this local socket, instead of connecting by ourselves.", "name");
+    QCommandLineOption optReplay("replay", "When attaching, replay this many lines of backlog per context.", "count", "50");
+    if (!parser.addOption(optAttach) || !parser.addOption(optReplay)) {
+        fputs("Failed to add options for attaching\n", stderr);
+        return 1;
+    }
+
+    QCommandLineOption optLogDir("log-dir", "Keep chat logs in this directory.", "dir");
+    if (!parser.addOption(optLogDir)) {
+        fputs("Failed to add option for logging\n", stderr);
+        return 1;
+    }
+
 #if 0  // TODO: Implement additional command-line arguments.
     parser.addPositionalArgument("URLs", "IRC URL(s) to open.", "[irc://SERVER/CHANNEL [...]]");
     parser.addPositionalArgument("commands", "One or more /COMMAND to execute as if it was typed in.", "[/COMMAND [...]]");
@@ -60,6 +78,26 @@ int main(int argc, char *argv[])
     parser.process(a);
 
 
+    if (parser.isSet(optAttach)) {
+        bool ok = false;
+        const int replayLines = parser.value(optReplay).toInt(&ok);
+        if (!ok || replayLines < 0) {
+            fputs("Invalid replay line count\n", stderr);
+            return 1;
+        }
+
+        RemoteTerminalUI remoteUI(parser.value(optAttach), replayLines, stdin, stdout);
+        pRemoteUI = &remoteUI;
+
+        rl_callback_handler_install("cvnirc> ", cb_linehandler);
+        rl_bind_key('\t', rl_insert);
+        rl_bind_key(15 /* ^O */, cycle_context);
+
+        remoteUI.attach();
+        return a.exec();
+    }
+
+
     // Create the user interface.
     TerminalUI ui(stdin, stdout);
     pUI = &ui;
@@ -85,6 +123,15 @@ int main(int argc, char *argv[])
     ui.irc().ircProtoClients().front()->setVerboseLevel(ui.verboseLevel());
 
 
+    if (parser.isSet(optLogDir)) {
+        QString errorString;
+        if (!ui.irc().chatLog().start(parser.value(optLogDir), &errorString)) {
+            fprintf(stderr, "Can't log to \"%s\": %s\n", qPrintable(parser.value(optLogDir)), qPrintable(errorString));
+            return 1;
+        }
+    }
+
+
     // Set up GNU readline library.
     //
     // Use the alternate interface.
@@ -0,0 +1,26 @@
+#include "readlineout.h"
+
+#include <stdio.h>
+#include <readline/readline.h>
+
+void readlineOutLine(QTextStream &out, const QString &prefix, const QString &line)
+{
+#if RL_VERSION_MAJOR < 7
+#warning "Your GNU readline library is too old, will have to do without rl_clear_visible_line()..."
+    // Try to blank the current line on our own.
+    int rows = 0, cols = 0;
+    rl_get_screen_size(&rows, &cols);
+    out << '\r';
+    for (int i = 0; i < cols - 1; i++)
+        out << ' ';
+    out << '\r';
+    out.flush();
+#else
+    rl_clear_visible_line();
+#endif
+    if (!prefix.isEmpty())
+        out << prefix << " ";
+    out << line << endl;
+    rl_on_new_line();
+    rl_redisplay();
+}
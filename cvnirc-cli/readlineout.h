@@ -0,0 +1,11 @@
+#ifndef READLINEOUT_H
+#define READLINEOUT_H
+
+#include <QString>
+#include <QTextStream>
+
+// Writes a line of output above readline's prompt (and whatever is being
+// typed there), then has readline draw those again below it.
+void readlineOutLine(QTextStream &out, const QString &prefix, const QString &line);
+
+#endif // READLINEOUT_H
@@ -0,0 +1,174 @@
+#include "remoteterminalui.h"
+
+#include <QDateTime>
+#include <QTimer>
+#include "irccorecontext.h"
+#include "readlineout.h"
+
+#include <stdio.h>
+#include <readline/readline.h>
+
+// (When the core went away, try again after this long.)
+static const int reattachDelayMSecs = 2000;
+
+RemoteTerminalUI::RemoteTerminalUI(const QString &socketName, int replayLines, FILE *inFileC, FILE *outFileC, QObject *parent) :
+    QObject(parent),
+    _core(this),
+    _socketName(socketName),
+    _replayLines(replayLines),
+    _inFile(this), _outFile(this),
+    _out((_outFile.open(outFileC, QIODevice::WriteOnly), &_outFile)),
+    _inNotify((_inFile.open(inFileC, QIODevice::ReadOnly), _inFile.handle()), QSocketNotifier::Read, this)
+{
+    connect(&_inNotify, &QSocketNotifier::activated, this, &RemoteTerminalUI::handle_inNotify_activated);
+
+    connect(&_core, &RemoteCore::attached, this, &RemoteTerminalUI::handle_core_attached);
+    connect(&_core, &RemoteCore::detached, this, &RemoteTerminalUI::handle_core_detached);
+    connect(&_core, &RemoteCore::contextChanged, this, &RemoteTerminalUI::handle_core_contextChanged);
+    connect(&_core, &RemoteCore::stateChanged, this, &RemoteTerminalUI::handle_core_stateChanged);
+    connect(&_core, &RemoteCore::lineReceived, this, &RemoteTerminalUI::handle_core_lineReceived);
+    connect(&_core, &RemoteCore::replayDone, this, &RemoteTerminalUI::handle_core_replayDone);
+    connect(&_core, &RemoteCore::errorReceived, this, &RemoteTerminalUI::handle_core_errorReceived);
+
+    _out << "Welcome to cvnirc-qt-cli, attaching to " << socketName << "." << endl;
+}
+
+void RemoteTerminalUI::attach()
+{
+    _core.attach(_socketName);
+}
+
+void RemoteTerminalUI::updatePrompt()
+{
+    auto it = _core.contexts().find(_currentContextId);
+    if (it == _core.contexts().end()) {
+        rl_set_prompt("cvnirc> ");
+        return;
+    }
+
+    QString state;
+    if (it.value().type == quint8(IRCCoreContext::Type::Server) &&
+        it.value().state != quint8(IRCProtoClient::ConnectionState::Connected))
+        state = " (not connected)";
+
+    _rlPromptHolder = ("[" + it.value().disambiguator + state + "] ").toUtf8();
+    rl_set_prompt(_rlPromptHolder.constData());
+}
+
+void RemoteTerminalUI::queueUserInput(const QString &line)
+{
+    _userInputQueue.append(line);
+}
+
+void RemoteTerminalUI::userInput(const QString &line)
+{
+    // (The one thing that has no context to go to yet.)
+    if (line.startsWith("/connect ")) {
+        const QStringList args = line.mid(9).split(' ', QString::SkipEmptyParts);
+        if (args.count() != 4) {
+            outLine("Usage: /connect HOST PORT USER NICK");
+            return;
+        }
+
+        _core.connectToIRCServer(args[0], args[1], args[2], args[3]);
+        return;
+    }
+
+    if (!_core.contexts().contains(_currentContextId)) {
+        outLine("Error: No context to send this to. (Use /connect HOST PORT USER NICK.)");
+        return;
+    }
+
+    _core.sendInput(_currentContextId, line);
+}
+
+bool RemoteTerminalUI::cycleCurrentContext(int count)
+{
+    const QList<quint32> ids = _core.contexts().keys();
+    if (ids.isEmpty())
+        return false;
+
+    int i = ids.indexOf(_currentContextId);
+    if (i < 0)
+        i = 0;
+    i = ((i + count) % ids.count() + ids.count()) % ids.count();
+    _currentContextId = ids[i];
+
+    updatePrompt();
+    rl_redisplay();
+    return true;
+}
+
+void RemoteTerminalUI::outLine(const QString &line, quint32 contextId)
+{
+    auto it = _core.contexts().find(contextId);
+    readlineOutLine(_out, it != _core.contexts().end() ? it.value().disambiguator : QString(), line);
+}
+
+void RemoteTerminalUI::handle_inNotify_activated(int /* socket */)
+{
+    // (See TerminalUI; the readline callback only queues lines.)
+    rl_callback_read_char();
+
+    while (_userInputQueue.length() > 0) {
+        QString line = _userInputQueue.front();
+        _userInputQueue.pop_front();
+
+        userInput(line);
+    }
+}
+
+void RemoteTerminalUI::handle_core_attached()
+{
+    outLine("Attached to core; " + QString::number(_core.contexts().count()) + " contexts known.");
+    _replaying = true;
+    _core.subscribe(0, quint32(_replayLines));
+}
+
+void RemoteTerminalUI::handle_core_detached(const QString &reason)
+{
+    outLine(reason + " Trying to re-attach in " + QString::number(reattachDelayMSecs / 1000) + " seconds...");
+    QTimer::singleShot(reattachDelayMSecs, this, SLOT(attach()));
+}
+
+void RemoteTerminalUI::handle_core_contextChanged(quint32 contextId)
+{
+    if (!_core.contexts().contains(_currentContextId))
+        _currentContextId = contextId;
+
+    if (contextId == _currentContextId) {
+        updatePrompt();
+        rl_redisplay();
+    }
+}
+
+void RemoteTerminalUI::handle_core_stateChanged(quint32 contextId)
+{
+    if (contextId == _currentContextId) {
+        updatePrompt();
+        rl_redisplay();
+    }
+}
+
+void RemoteTerminalUI::handle_core_lineReceived(quint32 contextId, qint64 msecs, const QString &text)
+{
+    // (Backlog could be from a while ago; say when.)
+    if (_replaying)
+        outLine("[" + QDateTime::fromMSecsSinceEpoch(msecs).toString("yyyy-MM-dd HH:mm:ss") + "] " + text, contextId);
+    else
+        outLine(text, contextId);
+}
+
+void RemoteTerminalUI::handle_core_replayDone(quint32 contextId)
+{
+    if (contextId != 0)
+        return;
+
+    _replaying = false;
+    outLine("--- End of backlog ---");
+}
+
+void RemoteTerminalUI::handle_core_errorReceived(const QString &text)
+{
+    outLine("Error from core: " + text, _currentContextId);
+}
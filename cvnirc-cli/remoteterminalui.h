@@ -0,0 +1,51 @@
+#ifndef REMOTETERMINALUI_H
+#define REMOTETERMINALUI_H
+
+#include <QObject>
+#include "remotecore.h"
+#include <QFile>
+#include <QTextStream>
+#include <QSocketNotifier>
+#include <QByteArray>
+
+// Terminal user-interface for a core in another process (like cvnirc-bnc),
+// attached to over a local socket.
+class RemoteTerminalUI : public QObject
+{
+    Q_OBJECT
+    RemoteCore _core;
+    QString _socketName;
+    int _replayLines;
+    quint32 _currentContextId = 0;
+    bool _replaying = false;
+    QFile _inFile, _outFile;
+    QTextStream _out;
+    QSocketNotifier _inNotify;
+    QByteArray _rlPromptHolder;
+public:
+    explicit RemoteTerminalUI(const QString &socketName, int replayLines, FILE *inFileC, FILE *outFileC, QObject *parent = 0);
+
+    void updatePrompt();
+
+public slots:
+    void attach();
+    void queueUserInput(const QString &line);
+    void userInput(const QString &line);
+    bool cycleCurrentContext(int count);
+    void outLine(const QString &line, quint32 contextId = 0);
+
+private slots:
+    void handle_inNotify_activated(int socket);
+    void handle_core_attached();
+    void handle_core_detached(const QString &reason);
+    void handle_core_contextChanged(quint32 contextId);
+    void handle_core_stateChanged(quint32 contextId);
+    void handle_core_lineReceived(quint32 contextId, qint64 msecs, const QString &text);
+    void handle_core_replayDone(quint32 contextId);
+    void handle_core_errorReceived(const QString &text);
+
+private:
+    QStringList _userInputQueue;
+};
+
+#endif // REMOTETERMINALUI_H
@@ -2,6 +2,7 @@
 
 #include <QMetaEnum>
 #include "irccorecommandgroup.h"
+#include "readlineout.h"
 
 #include <stdio.h>
 #include <readline/readline.h>
@@ -26,6 +27,7 @@ TerminalUI::TerminalUI(FILE *inFileC, FILE *outFileC, QObject *parent) :
     // TODO: Also register UI-specific commands.
 
     _currentContext = _irc.createIRCProtoClient();
+    _updateRawLineObservation();
 
     // (Don't do this. The readline callback function will be registered
     // only *after* the ctor (to ensure that the global pointer is set
@@ -48,7 +50,13 @@ void TerminalUI::updateGeneralPrompt()
         rl_set_prompt("cvnirc> ");
     }
     else {
-        _rlPromptHolder = ("[" + _currentContext->disambiguator() + "] ").toUtf8();
+        QString lag;
+        IRCProtoClient *client = _currentContext->ircProtoClient();
+        const qint64 lagUSecs = client ? client->lagUSecs() : -1;
+        if (lagUSecs >= 0)
+            lag = " lag " + IRCProto::LagHistogram::formatUSecs(lagUSecs);
+
+        _rlPromptHolder = ("[" + _currentContext->disambiguator() + lag + "] ").toUtf8();
         rl_set_prompt(_rlPromptHolder.constData());
     }
 }
@@ -135,6 +143,24 @@ void TerminalUI::setVerboseLevel(int newVerboseLevel)
     _verboseLevel = newVerboseLevel;
     if (_verboseLevel >= 2)
         outLine("Verbose level of terminal user-interface now is " + QString::number(_verboseLevel));
+
+    _updateRawLineObservation();
+}
+
+void TerminalUI::_updateRawLineObservation()
+{
+    // Only have raw lines handed out when we'd actually display them.
+    bool wantRawLines = _verboseLevel >= 1;
+    if (wantRawLines == _observingRawLines)
+        return;
+
+    for (IRCProtoClient *client : _irc.ircProtoClients()) {
+        if (wantRawLines)
+            client->addRawLineObserver();
+        else
+            client->removeRawLineObserver();
+    }
+    _observingRawLines = wantRawLines;
 }
 
 void TerminalUI::queueUserInput(const QString &line)
@@ -315,24 +341,7 @@ bool TerminalUI::switchToContext(IRCCoreContext *context)
 
 void TerminalUI::outLine(const QString &line, IRCCoreContext *context)
 {
-#if RL_VERSION_MAJOR < 7
-#warning "Your GNU readline library is too old, will have to do without rl_clear_visible_line()..."
-    // Try to blank the current line on our own.
-    int rows = 0, cols = 0;
-    rl_get_screen_size(&rows, &cols);
-    out << '\r';
-    for (int i = 0; i < cols - 1; i++)
-        out << ' ';
-    out << '\r';
-    out.flush();
-#else
-    rl_clear_visible_line();
-#endif
-    if (context != nullptr)
-        _out << context->disambiguator() << " ";
-    _out << line << endl;
-    rl_on_new_line();
-    rl_redisplay();
+    readlineOutLine(_out, context != nullptr ? context->disambiguator() : QString(), line);
 }
 
 void TerminalUI::outSendingLine(const QString &rawLine, IRCCoreContext *context)
@@ -341,10 +350,15 @@ void TerminalUI::outSendingLine(const QString &rawLine, IRCCoreContext *context)
         outLine("< " + rawLine, context);
 }
 
-void TerminalUI::outReceivedLine(const QString &rawLine, IRCCoreContext *context)
+void TerminalUI::outReceivedLine(const QByteArray &rawLine, IRCCoreContext *context)
 {
-    if (_verboseLevel >= 1)
-        outLine("> " + rawLine, context);
+    if (_verboseLevel < 1)
+        return;
+
+    if (context == nullptr)
+        outLine("> " + QString::fromLatin1(rawLine.toPercentEncoding()), context);
+    else
+        outLine("> " + context->ircProtoClient()->rawLineToDisplay(rawLine), context);
 }
 
 void TerminalUI::handle_inNotify_activated(int /* socket */)
@@ -388,6 +402,26 @@ void TerminalUI::handle_context_connectionStateChanged(IRCCoreContext *context)
     );
 }
 
+void TerminalUI::handle_context_disambiguatorChanged(IRCCoreContext *context)
+{
+    // The prompt shows the current context's disambiguator.
+    if (context != _currentContext)
+        return;
+
+    updateGeneralPrompt();
+    rl_redisplay();
+}
+
+void TerminalUI::handle_context_highlighted(const QString &line, IRCCoreContext *context)
+{
+    Q_UNUSED(line)
+    Q_UNUSED(context)
+
+    // (The line itself is out already; just ring the bell.)
+    _out << '\a';
+    _out.flush();
+}
+
 void TerminalUI::handle_irc_createdContext(IRCCoreContext *context)
 {
     connect(context, &IRCCoreContext::notifyUser, this, &TerminalUI::outLine);
@@ -397,4 +431,23 @@ void TerminalUI::handle_irc_createdContext(IRCCoreContext *context)
     connect(context, &IRCCoreContext::focusWanted, this, &TerminalUI::switchToContext);
 
     connect(context, &IRCCoreContext::connectionStateChanged, this, &TerminalUI::handle_context_connectionStateChanged);
+    connect(context, &IRCCoreContext::disambiguatorChanged, this, &TerminalUI::handle_context_disambiguatorChanged);
+    connect(context, &IRCCoreContext::highlighted, this, &TerminalUI::handle_context_highlighted);
+
+    if (context->type() == IRCCoreContext::Type::Server) {
+        connect(context->ircProtoClient(), &IRCProtoClient::lagChanged, this, &TerminalUI::handle_client_lagChanged);
+
+        if (_observingRawLines)
+            context->ircProtoClient()->addRawLineObserver();
+    }
+}
+
+void TerminalUI::handle_client_lagChanged()
+{
+    // The prompt shows the current context's connection lag.
+    if (_currentContext == nullptr || _currentContext->ircProtoClient() != sender())
+        return;
+
+    updateGeneralPrompt();
+    rl_redisplay();
 }
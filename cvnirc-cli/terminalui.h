@@ -19,6 +19,7 @@ class TerminalUI : public QObject
     QTextStream _in, _out;
     QSocketNotifier _inNotify;
     int _verboseLevel = 1;
+    bool _observingRawLines = false;
     QByteArray _rlPromptHolder;
 public:
     enum class UserInputState {
@@ -51,18 +52,22 @@ public slots:
     bool switchToContext(IRCCoreContext *context);
     void outLine(const QString &line, IRCCoreContext *context = nullptr);
     void outSendingLine(const QString &rawLine, IRCCoreContext *context = nullptr);
-    void outReceivedLine(const QString &rawLine, IRCCoreContext *context = nullptr);
+    void outReceivedLine(const QByteArray &rawLine, IRCCoreContext *context = nullptr);
 
 private slots:
     void handle_inNotify_activated(int socket);
     void handle_context_connectionStateChanged(IRCCoreContext *context = nullptr);
+    void handle_context_disambiguatorChanged(IRCCoreContext *context = nullptr);
+    void handle_context_highlighted(const QString &line, IRCCoreContext *context = nullptr);
     void handle_irc_createdContext(IRCCoreContext *context);
+    void handle_client_lagChanged();
 
 private:
     QStringList _userInputQueue;
     UserInputState _userInputState = UserInputState::General;
 
     void _setUserInputState(UserInputState newState);
+    void _updateRawLineObservation();
 };
 
 #endif // TERMINALUI_H
@@ -0,0 +1,108 @@
+#include "admissionlimiter.h"
+
+#include <stdexcept>
+
+AdmissionLimiter::AdmissionLimiter(TimerWheel *timerWheel, double ratePerSec, int burst, QObject *parent) : QObject(parent),
+    _timerWheel(timerWheel),
+    _ratePerSec(0),
+    _burst(0),
+    _tokens(0)
+{
+    setRate(ratePerSec, burst);
+    _tokens = _burst;
+    _clock.start();
+}
+
+AdmissionLimiter::~AdmissionLimiter()
+{
+    if (_drainTimer != 0 && _timerWheel)
+        _timerWheel->cancel(_drainTimer);
+}
+
+AdmissionLimiter::Ticket AdmissionLimiter::request(callback_type callback)
+{
+    if (!callback)
+        throw std::invalid_argument("Admission limiter, request: Callback can't be empty");
+
+    // (Without a timer wheel, there'd be no way to come back later.)
+    _refill();
+    if (!_timerWheel || (_queue.empty() && _tokens >= 1)) {
+        _tokens -= 1;
+        callback();
+        return 0;
+    }
+
+    const Ticket ticket = _nextTicket++;
+    _queue.push_back({ ticket, std::move(callback) });
+    _queueByTicket.insert(ticket, std::prev(_queue.end()));
+
+    if (_drainTimer == 0)
+        _drain();
+
+    return ticket;
+}
+
+void AdmissionLimiter::cancel(Ticket ticket)
+{
+    auto it = _queueByTicket.find(ticket);
+    if (it == _queueByTicket.end())
+        return;
+
+    _queue.erase(it.value());
+    _queueByTicket.erase(it);
+}
+
+int AdmissionLimiter::queuedCount() const
+{
+    return int(_queue.size());
+}
+
+double AdmissionLimiter::ratePerSec() const
+{
+    return _ratePerSec;
+}
+
+int AdmissionLimiter::burst() const
+{
+    return _burst;
+}
+
+void AdmissionLimiter::setRate(double ratePerSec, int burst)
+{
+    if (!(ratePerSec > 0) || burst < 1)
+        throw std::invalid_argument("Admission limiter, set rate: Rate must be positive, burst at least 1");
+
+    _refill();
+    _ratePerSec = ratePerSec;
+    _burst = burst;
+    _tokens = qMin(_tokens, double(_burst));
+}
+
+void AdmissionLimiter::_refill()
+{
+    const qint64 nowMSecs = _clock.isValid() ? _clock.elapsed() : 0;
+    _tokens = qMin(double(_burst), _tokens + (nowMSecs - _lastRefillMSecs) * _ratePerSec / 1000);
+    _lastRefillMSecs = nowMSecs;
+}
+
+void AdmissionLimiter::_drain()
+{
+    _drainTimer = 0;
+
+    _refill();
+    while (!_queue.empty() && _tokens >= 1) {
+        // (Off the queue first; the callback may well request again.)
+        const callback_type callback = std::move(_queue.front().callback);
+        _queueByTicket.remove(_queue.front().ticket);
+        _queue.pop_front();
+        _tokens -= 1;
+        callback();
+    }
+
+    if (_queue.empty() || !_timerWheel || _drainTimer != 0)
+        return;
+
+    // Come back when the next token will be there.
+    const int delayMSecs = int((1 - _tokens) * 1000 / _ratePerSec) + 1;
+    _drainTimer = _timerWheel->schedule(delayMSecs, this, [this]() { _drain(); });
+}
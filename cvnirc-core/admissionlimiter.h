@@ -0,0 +1,64 @@
+#ifndef ADMISSIONLIMITER_H
+#define ADMISSIONLIMITER_H
+
+#include "cvnirc-core_global.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <functional>
+#include <list>
+#include "timerwheel.h"
+
+// Lets requests through at a limited rate (token bucket), in order;
+// e.g., so that hundreds of connections coming back after an uplink
+// flap don't all hit the network in the same second.
+class CVNIRCCORESHARED_EXPORT AdmissionLimiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef quint64 Ticket;  // (0: None.)
+    typedef std::function<void()> callback_type;
+
+private:
+    class Entry
+    {
+    public:
+        Ticket ticket;
+        callback_type callback;
+    };
+
+    QPointer<TimerWheel> _timerWheel;
+    double _ratePerSec;
+    int    _burst;
+    double _tokens;
+    QElapsedTimer _clock;
+    qint64 _lastRefillMSecs = 0;
+
+    std::list<Entry> _queue;
+    QHash<Ticket, std::list<Entry>::iterator> _queueByTicket;
+    Ticket _nextTicket = 1;
+    TimerWheel::TimerId _drainTimer = 0;
+
+public:
+    AdmissionLimiter(TimerWheel *timerWheel, double ratePerSec, int burst, QObject *parent = 0);
+    ~AdmissionLimiter();
+
+    // Runs callback once admitted. Returns 0 if that happened right away
+    // (so callback has already run), or else a ticket for cancel().
+    Ticket request(callback_type callback);
+    void cancel(Ticket ticket);
+
+    int queuedCount() const;
+    double ratePerSec() const;
+    int burst() const;
+    void setRate(double ratePerSec, int burst);
+
+private:
+    void _refill();
+    void _drain();
+};
+
+#endif // ADMISSIONLIMITER_H
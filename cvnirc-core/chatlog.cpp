@@ -0,0 +1,637 @@
+#include "chatlog.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+#include <deque>
+#include <string.h>
+
+const char ChatLogSegment::magic[8] = { 'C', 'V', 'N', 'I', 'R', 'C', 'L', '1' };
+
+template <typename T>
+static void appendLittleEndian(QByteArray *out, T value)
+{
+    uchar buf[sizeof(T)];
+    qToLittleEndian<T>(value, buf);
+    out->append(reinterpret_cast<const char *>(buf), int(sizeof(T)));
+}
+
+bool ChatLogSegment::open(const QString &dataFileName, QString *errorString)
+{
+    close();
+
+    _dataFile.setFileName(dataFileName);
+    if (!_dataFile.open(QIODevice::ReadOnly)) {
+        if (errorString != nullptr)
+            *errorString = _dataFile.errorString();
+        return false;
+    }
+
+    _dataSize = _dataFile.size();
+    if (_dataSize < headerSize ||
+        (_data = _dataFile.map(0, _dataSize)) == nullptr ||
+        memcmp(_data, magic, sizeof(magic)) != 0)
+    {
+        if (errorString != nullptr)
+            *errorString = "Not a chat log segment";
+        close();
+        return false;
+    }
+
+    // (A missing or torn index only makes things slower.)
+    _indexFile.setFileName(indexFileName(dataFileName));
+    if (_indexFile.open(QIODevice::ReadOnly)) {
+        const qint64 count = _indexFile.size() / indexEntrySize;
+        if (count > 0 && (_index = _indexFile.map(0, count * indexEntrySize)) != nullptr)
+            _indexCount = int(count);
+    }
+
+    // (Don't trust entries pointing past what we've mapped of the data.)
+    while (_indexCount > 0 && indexOffset(_indexCount - 1) >= _dataSize)
+        _indexCount--;
+
+    return true;
+}
+
+void ChatLogSegment::close()
+{
+    // (Unmapped along with closing.)
+    _dataFile.close();
+    _indexFile.close();
+    _data = nullptr;
+    _dataSize = 0;
+    _index = nullptr;
+    _indexCount = 0;
+}
+
+bool ChatLogSegment::isOpen() const
+{
+    return _data != nullptr;
+}
+
+qint64 ChatLogSegment::dataSize() const
+{
+    return _dataSize;
+}
+
+int ChatLogSegment::indexCount() const
+{
+    return _indexCount;
+}
+
+qint64 ChatLogSegment::indexMSecs(int i) const
+{
+    return qFromLittleEndian<qint64>(_index + i * indexEntrySize);
+}
+
+qint64 ChatLogSegment::indexOffset(int i) const
+{
+    return qint64(qFromLittleEndian<quint64>(_index + i * indexEntrySize + 8));
+}
+
+qint64 ChatLogSegment::readRecord(qint64 offset, Scrollback::Entry *entry) const
+{
+    if (offset < headerSize || offset + recordHeaderSize > _dataSize)
+        return -1;
+
+    const uchar *p = _data + offset;
+    const quint32 len = qFromLittleEndian<quint32>(p);
+    if (len < quint32(recordHeaderSize - 4) || offset + 4 + qint64(len) > _dataSize)
+        return -1;
+
+    const quint16 senderLen = qFromLittleEndian<quint16>(p + 4 + 8 + 1);
+    if (senderLen > len - (recordHeaderSize - 4))
+        return -1;
+
+    if (entry != nullptr) {
+        const char *sender = reinterpret_cast<const char *>(p + recordHeaderSize);
+        entry->seq = 0;
+        entry->msecs = qFromLittleEndian<qint64>(p + 4);
+        entry->kind = Scrollback::Kind(p[4 + 8]);
+        entry->sender = QString::fromUtf8(sender, senderLen);
+        entry->text = QString::fromUtf8(sender + senderLen, int(len) - (recordHeaderSize - 4) - senderLen);
+    }
+
+    return offset + 4 + len;
+}
+
+qint64 ChatLogSegment::recordMSecs(qint64 offset) const
+{
+    return qFromLittleEndian<qint64>(_data + offset + 4);
+}
+
+qint64 ChatLogSegment::seek(qint64 msecs) const
+{
+    // Last indexed record before msecs; then scan from there.
+    int lo = 0, hi = _indexCount;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (indexMSecs(mid) < msecs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    qint64 offset = lo > 0 ? indexOffset(lo - 1) : qint64(headerSize);
+    for (;;) {
+        const qint64 next = readRecord(offset, nullptr);
+        if (next < 0)
+            return -1;
+        if (recordMSecs(offset) >= msecs)
+            return offset;
+        offset = next;
+    }
+}
+
+QList<Scrollback::Entry> ChatLogSegment::last(int maxCount) const
+{
+    if (!isOpen() || maxCount <= 0)
+        return QList<Scrollback::Entry>();
+
+    // Start far enough back for at least maxCount records, going by the
+    // index; then keep only the last of them.
+    const int backEntries = (maxCount + indexInterval - 1) / indexInterval;
+    const int start = _indexCount - 1 - backEntries;
+    qint64 offset = start > 0 ? indexOffset(start) : qint64(headerSize);
+
+    std::deque<Scrollback::Entry> kept;
+    Scrollback::Entry entry;
+    while ((offset = readRecord(offset, &entry)) >= 0) {
+        kept.push_back(entry);
+        if (int(kept.size()) > maxCount)
+            kept.pop_front();
+    }
+
+    QList<Scrollback::Entry> ret;
+    ret.reserve(int(kept.size()));
+    for (const Scrollback::Entry &keptEntry : kept)
+        ret.append(keptEntry);
+    return ret;
+}
+
+QList<Scrollback::Entry> ChatLogSegment::from(qint64 msecs, int maxCount) const
+{
+    QList<Scrollback::Entry> ret;
+    if (!isOpen() || maxCount <= 0)
+        return ret;
+
+    qint64 offset = seek(msecs);
+    Scrollback::Entry entry;
+    while (ret.count() < maxCount && offset >= 0 && (offset = readRecord(offset, &entry)) >= 0)
+        ret.append(entry);
+    return ret;
+}
+
+QString ChatLogSegment::indexFileName(const QString &dataFileName)
+{
+    QString ret = dataFileName;
+    if (ret.endsWith(".log"))
+        ret.chop(4);
+    return ret + ".idx";
+}
+
+qint64 ChatLogSegment::startMSecs(const QString &dataFileName)
+{
+    return QFileInfo(dataFileName).completeBaseName().toLongLong();
+}
+
+
+ChatLog::ChatLog(qint64 maxSegmentBytes) :
+    _maxSegmentBytes(maxSegmentBytes),
+    _written(0), _dropped(0)
+{
+
+}
+
+ChatLog::~ChatLog()
+{
+    stop();
+}
+
+bool ChatLog::start(const QString &directory, QString *errorString)
+{
+    stop();
+
+    if (!QDir().mkpath(directory)) {
+        if (errorString != nullptr)
+            *errorString = "Can't create directory";
+        return false;
+    }
+
+    _directory = QDir(directory).absolutePath();
+    _pending.clear();
+    _pendingBytes = 0;
+    _stopping = false;
+    _written = 0;
+    _dropped = 0;
+    _writer = std::thread(&ChatLog::_writerLoop, this);
+    return true;
+}
+
+void ChatLog::stop()
+{
+    if (!_writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_one();
+    _writer.join();
+    if (_indexer.joinable())
+        _indexer.join();
+    _directory.clear();
+}
+
+bool ChatLog::isLogging() const
+{
+    return _writer.joinable();
+}
+
+const QString &ChatLog::directory() const
+{
+    return _directory;
+}
+
+void ChatLog::append(const QString &contextPath, const Scrollback::Entry &entry)
+{
+    if (!isLogging())
+        return;
+
+    // Encode right away, so that the writer thread gets plain bytes.
+    QByteArray sender = entry.sender.toUtf8();
+    if (sender.length() > 0xffff)
+        sender.truncate(0xffff);
+    const QByteArray text = entry.text.toUtf8();
+
+    Pending pending { contextPath, entry.msecs, QByteArray(), entry.text };
+    QByteArray &record(pending.record);
+    record.reserve(ChatLogSegment::recordHeaderSize + sender.length() + text.length());
+    appendLittleEndian<quint32>(&record, quint32(ChatLogSegment::recordHeaderSize - 4 + sender.length() + text.length()));
+    appendLittleEndian<qint64>(&record, entry.msecs);
+    record.append(char(entry.kind));
+    appendLittleEndian<quint16>(&record, quint16(sender.length()));
+    record.append(sender).append(text);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_pendingBytes + size_t(record.length()) > maxPendingBytes) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        _pendingBytes += size_t(record.length());
+        _pending.push_back(std::move(pending));
+    }
+    _wakeup.notify_one();
+}
+
+quint64 ChatLog::writtenCount() const
+{
+    return _written.load(std::memory_order_relaxed);
+}
+
+quint64 ChatLog::droppedCount() const
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+QStringList ChatLog::contextPaths() const
+{
+    return contextPaths(_directory);
+}
+
+QStringList ChatLog::segmentFiles(const QString &contextPath) const
+{
+    return segmentFiles(_directory, contextPath);
+}
+
+QStringList ChatLog::contextPaths(const QString &directory)
+{
+    if (directory.isEmpty())
+        return QStringList();
+
+    // (See contextPath(): Network, then target.)
+    QStringList ret;
+    QDir root(directory);
+    for (const QString &network : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+        for (const QString &target : QDir(root.filePath(network)).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name))
+            ret.append(network + "/" + target);
+    }
+    return ret;
+}
+
+QStringList ChatLog::segmentFiles(const QString &directory, const QString &contextPath)
+{
+    if (directory.isEmpty())
+        return QStringList();
+
+    // (Names are zero-padded timestamps, so by name is by age.)
+    QDir dir(directory + "/" + contextPath);
+    QStringList ret;
+    for (const QString &name : dir.entryList({ "*.log" }, QDir::Files, QDir::Name))
+        ret.append(dir.filePath(name));
+    return ret;
+}
+
+QList<Scrollback::Entry> ChatLog::readLast(const QString &contextPath, int maxCount) const
+{
+    QList<Scrollback::Entry> ret;
+    const QStringList files = segmentFiles(contextPath);
+    for (int i = files.count() - 1; i >= 0 && ret.count() < maxCount; i--) {
+        ChatLogSegment segment;
+        if (!segment.open(files[i]))
+            continue;
+
+        ret = segment.last(maxCount - ret.count()) + ret;
+    }
+
+    return ret;
+}
+
+QList<Scrollback::Entry> ChatLog::readFrom(const QString &contextPath, qint64 msecs, int maxCount) const
+{
+    QList<Scrollback::Entry> ret;
+    const QStringList files = segmentFiles(contextPath);
+
+    // Start with the last segment that started before msecs.
+    int first = 0;
+    for (int i = 1; i < files.count(); i++) {
+        if (ChatLogSegment::startMSecs(files[i]) <= msecs)
+            first = i;
+    }
+
+    for (int i = first; i < files.count() && ret.count() < maxCount; i++) {
+        ChatLogSegment segment;
+        if (!segment.open(files[i]))
+            continue;
+
+        ret += segment.from(msecs, maxCount - ret.count());
+    }
+
+    return ret;
+}
+
+QString ChatLog::contextPath(const QString &network, const QString &target)
+{
+    // One directory level each; and nothing that could climb out.
+    // (Nick and channel names can't contain '~', so it's safe for a marker.)
+    auto component = [](const QString &name, const char *fallback) {
+        const QString ret = QString::fromLatin1(name.toUtf8().toPercentEncoding());
+        if (ret.isEmpty() || ret == "." || ret == "..")
+            return QString(fallback);
+        return ret;
+    };
+
+    return component(network.toLower(), "~unknown") + "/" + component(target.toLower(), "~server");
+}
+
+QString ChatLog::contextDisplayName(const QString &contextPath)
+{
+    QStringList ret;
+    for (const QString &component : contextPath.split('/')) {
+        if (component == "~server")
+            ret.append("(Server)");
+        else
+            ret.append(QString::fromUtf8(QByteArray::fromPercentEncoding(component.toLatin1())));
+    }
+    return ret.join('/');
+}
+
+void ChatLog::_writerLoop()
+{
+    // Segments so far are all from earlier runs (each run starts new
+    // ones); any an earlier run couldn't finish the index of (crashed,
+    // say) get indexed in the background.
+    QStringList dataFileNames;
+    for (const QString &contextPath : contextPaths())
+        dataFileNames += segmentFiles(contextPath);
+    _indexer = std::thread(&ChatLog::_indexerLoop, this, dataFileNames);
+
+    _lastIndexSnapshot = std::chrono::steady_clock::now();
+    std::vector<Pending> batch;
+    for (;;) {
+        bool stopping;
+        {
+            // (Waking up now and then for the index snapshots.)
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait_for(lock, std::chrono::milliseconds(indexSnapshotMSecs),
+                             [this]() { return _stopping || !_pending.empty(); });
+            stopping = _stopping;
+            batch.swap(_pending);
+            _pendingBytes = 0;
+        }
+
+        for (const Pending &pending : batch)
+            _write(pending);
+        batch.clear();
+        _flush();
+        _snapshotIndexes();
+
+        if (stopping)
+            break;
+    }
+
+    _closeAll();
+}
+
+void ChatLog::_indexerLoop(QStringList dataFileNames)
+{
+    for (const QString &dataFileName : dataFileNames) {
+        if (_isStopping())
+            return;
+
+        // (If this fails, searching scans the segment instead.)
+        if (ChatSearchIndex::isBehind(dataFileName))
+            ChatSearchIndex::build(dataFileName);
+    }
+}
+
+bool ChatLog::_isStopping()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stopping;
+}
+
+void ChatLog::_write(const Pending &pending)
+{
+    OpenSegment *segment = _openSegment(pending.contextPath, pending.msecs);
+    if (segment == nullptr) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Data first; a line getting an index entry is flushed before the
+    // entry gets written, so entries only ever point at whole lines.
+    const bool indexed = segment->records % ChatLogSegment::indexInterval == 0;
+    const size_t len = size_t(pending.record.length());
+    if (fwrite(pending.record.constData(), 1, len, segment->data) != len ||
+            (indexed && fflush(segment->data) != 0)) {
+        // (Cut back to the last whole line; appending after half of one
+        // would garble the rest. Reopened on the next write.)
+        _closeFiles(segment);
+        QFile::resize(segment->dataFileName, segment->size);
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (indexed) {
+        QByteArray entry;
+        appendLittleEndian<qint64>(&entry, pending.msecs);
+        appendLittleEndian<quint64>(&entry, quint64(segment->size));
+        fwrite(entry.constData(), 1, size_t(entry.length()), segment->index);
+    }
+
+    ChatSearchIndex::addPostings(&segment->postings, quint32(segment->size), pending.text);
+
+    segment->size += qint64(len);
+    segment->records++;
+    segment->dirty = true;
+    _written.fetch_add(1, std::memory_order_relaxed);
+}
+
+ChatLog::OpenSegment *ChatLog::_openSegment(const QString &contextPath, qint64 msecs)
+{
+    auto it = _segments.find(contextPath);
+    if (it != _segments.end() && it->size < _maxSegmentBytes) {
+        OpenSegment *segment = &it.value();
+        if (segment->data == nullptr)
+            return _openFiles(contextPath, segment, "ab") ? segment : nullptr;
+
+        _lru.splice(_lru.end(), _lru, segment->lruPos);
+        return segment;
+    }
+
+    // Start a new segment; on each run, and whenever the last one is full.
+    if (it != _segments.end()) {
+        _finishSegment(&it.value());
+        _segments.erase(it);
+    }
+
+    const QString dirPath = _directory + "/" + contextPath;
+    if (!QDir().mkpath(dirPath))
+        return nullptr;
+
+    // (Named after the first line; nudged along if that's taken.)
+    QString baseName;
+    for (qint64 stamp = qMax<qint64>(msecs, 0); ; stamp++) {
+        baseName = dirPath + "/" + QString::number(stamp).rightJustified(16, '0');
+        if (!QFile::exists(baseName + ".log"))
+            break;
+    }
+
+    OpenSegment segment;
+    segment.dataFileName = baseName + ".log";
+    if (!_openFiles(contextPath, &segment, "wb"))
+        return nullptr;
+
+    if (fwrite(ChatLogSegment::magic, 1, sizeof(ChatLogSegment::magic), segment.data) != sizeof(ChatLogSegment::magic)) {
+        _closeFiles(&segment);
+        return nullptr;
+    }
+    segment.size = ChatLogSegment::headerSize;
+
+    // (The LRU position stays valid, being a list iterator.)
+    return &_segments.insert(contextPath, segment).value();
+}
+
+bool ChatLog::_openFiles(const QString &contextPath, OpenSegment *segment, const char *mode)
+{
+    // Make room first.
+    while (_lru.size() >= size_t(maxOpenSegmentFiles)) {
+        auto it = _segments.find(_lru.front());
+        if (it == _segments.end()) {
+            _lru.pop_front();  // (Can't happen.)
+            continue;
+        }
+        _closeFiles(&it.value());
+    }
+
+    const QString &dataFileName(segment->dataFileName);
+    segment->data = fopen(QFile::encodeName(dataFileName).constData(), mode);
+    segment->index = fopen(QFile::encodeName(ChatLogSegment::indexFileName(dataFileName)).constData(), mode);
+    if (segment->data == nullptr || segment->index == nullptr) {
+        if (segment->data != nullptr)
+            fclose(segment->data);
+        if (segment->index != nullptr)
+            fclose(segment->index);
+        segment->data = nullptr;
+        segment->index = nullptr;
+        return false;
+    }
+
+    segment->lruPos = _lru.insert(_lru.end(), contextPath);
+    return true;
+}
+
+void ChatLog::_closeFiles(OpenSegment *segment)
+{
+    if (segment->data == nullptr)
+        return;
+
+    // (Flushes, too.)
+    fclose(segment->data);
+    fclose(segment->index);
+    segment->data = nullptr;
+    segment->index = nullptr;
+    segment->dirty = false;
+    _lru.erase(segment->lruPos);
+}
+
+void ChatLog::_flush()
+{
+    // (Data before index; see _write(). Only ones with open files can be dirty.)
+    for (const QString &contextPath : _lru) {
+        OpenSegment &segment(_segments[contextPath]);
+        if (segment.dirty)
+            fflush(segment.data);
+    }
+    for (const QString &contextPath : _lru) {
+        OpenSegment &segment(_segments[contextPath]);
+        if (segment.dirty) {
+            fflush(segment.index);
+            segment.dirty = false;
+        }
+    }
+}
+
+void ChatLog::_snapshotIndexes()
+{
+    // Makes what got written searchable by index, every so often;
+    // until then, searching scans it. (After _flush(): An index never
+    // covers data readers can't see, yet.)
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastIndexSnapshot < std::chrono::milliseconds(indexSnapshotMSecs))
+        return;
+    _lastIndexSnapshot = now;
+
+    for (OpenSegment &segment : _segments) {
+        if (segment.records != segment.indexedRecords)
+            _writeIndex(&segment);
+    }
+}
+
+void ChatLog::_writeIndex(OpenSegment *segment)
+{
+    // (If this fails, searching scans the rest of the segment instead.)
+    if (ChatSearchIndex::write(ChatSearchIndex::fileName(segment->dataFileName), quint32(segment->records),
+                               segment->size, segment->postings))
+        segment->indexedRecords = segment->records;
+}
+
+void ChatLog::_finishSegment(OpenSegment *segment)
+{
+    _closeFiles(segment);
+
+    if (segment->records != segment->indexedRecords)
+        _writeIndex(segment);
+    segment->postings.clear();
+}
+
+void ChatLog::_closeAll()
+{
+    for (OpenSegment &segment : _segments)
+        _finishSegment(&segment);
+    _segments.clear();
+    _lru.clear();
+}
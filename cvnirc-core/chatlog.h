@@ -0,0 +1,177 @@
+#ifndef CHATLOG_H
+#define CHATLOG_H
+
+#include "cvnirc-core_global.h"
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include "scrollback.h"
+#include "chatsearch.h"
+
+// On-disk chat log layout: One directory per context (see contextPath()),
+// holding append-only segments. Each segment is a pair of files named
+// after the timestamp of its first line (all integers little-endian):
+//
+//   NNNN.log:  8 bytes magic "CVNIRCL1",
+//              then records: u32 length (of what follows), i64 ms since
+//              epoch, u8 kind, u16 sender length, sender, text (UTF-8).
+//   NNNN.idx:  Entries of i64 ms since epoch, u64 offset into the .log;
+//              one for every indexInterval-th record, starting with the first.
+//
+// The index is small enough to map in, and is what makes loading the
+// last lines or seeking to a date cheap, however long the log is.
+class CVNIRCCORESHARED_EXPORT ChatLogSegment
+{
+    QFile _dataFile, _indexFile;
+    const uchar *_data = nullptr;
+    qint64 _dataSize = 0;
+    const uchar *_index = nullptr;
+    int _indexCount = 0;
+
+public:
+    static const char magic[8];
+    static const int headerSize = 8;
+    static const int recordHeaderSize = 4 + 8 + 1 + 2;
+    static const int indexEntrySize = 8 + 8;
+    static const int indexInterval = 64;
+
+    // (Maps in what's there now; the writer may append more meanwhile.)
+    bool open(const QString &dataFileName, QString *errorString = nullptr);
+    void close();
+    bool isOpen() const;
+
+    qint64 dataSize() const;
+    int indexCount() const;
+    qint64 indexMSecs(int i) const;
+    qint64 indexOffset(int i) const;
+
+    // Decodes the record at offset. Returns the offset of the next one,
+    // or -1 at the end (or where the writer hasn't finished, yet).
+    qint64 readRecord(qint64 offset, Scrollback::Entry *entry) const;
+    // (Just the timestamp; cheaper.)
+    qint64 recordMSecs(qint64 offset) const;
+
+    // Offset of the first record at or after msecs, or -1 if there's none.
+    qint64 seek(qint64 msecs) const;
+
+    QList<Scrollback::Entry> last(int maxCount) const;
+    QList<Scrollback::Entry> from(qint64 msecs, int maxCount) const;
+
+    static QString indexFileName(const QString &dataFileName);
+    static qint64 startMSecs(const QString &dataFileName);  // (From the name.)
+};
+
+// Durable per-context logs. Appending only encodes the line and queues
+// it; a background thread does the writing (and the file juggling), so
+// logging doesn't hold up the event loop. If the writer can't keep up,
+// lines get dropped (and counted) rather than queued without bounds.
+// The writer also builds each segment's search index (see chatsearch.h);
+// and, in the background, those of earlier runs' segments lacking one.
+//
+// Only the most recently written-to segments keep their files open;
+// the others get closed, and reopened (for appending) on their next line.
+// So there can be any number of contexts without running out of files.
+class CVNIRCCORESHARED_EXPORT ChatLog
+{
+public:
+    static const qint64 defaultMaxSegmentBytes = 8 * 1024 * 1024;
+    static const size_t maxPendingBytes = 4 * 1024 * 1024;
+    static const int maxOpenSegmentFiles = 64;  // (Segments, that is; two files each.)
+    static const int indexSnapshotMSecs = 10 * 1000;
+
+private:
+    class Pending
+    {
+    public:
+        QString    contextPath;
+        qint64     msecs;
+        QByteArray record;
+        QString    text;  // (For the search index.)
+    };
+
+    class OpenSegment
+    {
+    public:
+        QString dataFileName;
+        FILE   *data = nullptr;   // (Null while closed for lack of use.)
+        FILE   *index = nullptr;
+        std::list<QString>::iterator lruPos;  // (While open.)
+        qint64  size = 0;
+        quint64 records = 0;
+        bool    dirty = false;
+        ChatSearchIndex::postings_type postings;
+        quint64 indexedRecords = 0;  // (As of the last index written.)
+    };
+
+    QString _directory;
+    qint64 _maxSegmentBytes;
+
+    std::thread _writer;
+    std::thread _indexer;  // (Started by the writer.)
+    std::mutex _mutex;  // (Guards the pending lines and the stop flag.)
+    std::condition_variable _wakeup;
+    std::vector<Pending> _pending;
+    size_t _pendingBytes = 0;
+    bool _stopping = false;
+
+    std::atomic<quint64> _written;
+    std::atomic<quint64> _dropped;
+
+    // (Writer thread only.)
+    QHash<QString, OpenSegment> _segments;  // (By context path.)
+    std::list<QString> _lru;  // (Of those with open files; least recently written to first.)
+    std::chrono::steady_clock::time_point _lastIndexSnapshot;
+
+public:
+    explicit ChatLog(qint64 maxSegmentBytes = defaultMaxSegmentBytes);
+    ~ChatLog();
+
+    bool start(const QString &directory, QString *errorString = nullptr);
+    void stop();
+    bool isLogging() const;
+    const QString &directory() const;
+
+    void append(const QString &contextPath, const Scrollback::Entry &entry);
+
+    quint64 writtenCount() const;
+    quint64 droppedCount() const;
+
+    // Reading works from any thread, and while logging, too.
+    QStringList contextPaths() const;
+    QStringList segmentFiles(const QString &contextPath) const;  // (Oldest first.)
+    static QStringList contextPaths(const QString &directory);
+    static QStringList segmentFiles(const QString &directory, const QString &contextPath);
+    QList<Scrollback::Entry> readLast(const QString &contextPath, int maxCount) const;
+    QList<Scrollback::Entry> readFrom(const QString &contextPath, qint64 msecs, int maxCount) const;
+
+    // Relative directory for a context; no target means the server context.
+    static QString contextPath(const QString &network, const QString &target);
+    static QString contextDisplayName(const QString &contextPath);
+
+private:
+    void _writerLoop();
+    void _indexerLoop(QStringList dataFileNames);
+    bool _isStopping();
+    void _write(const Pending &pending);
+    OpenSegment *_openSegment(const QString &contextPath, qint64 msecs);
+    bool _openFiles(const QString &contextPath, OpenSegment *segment, const char *mode);
+    void _closeFiles(OpenSegment *segment);
+    void _flush();
+    void _snapshotIndexes();
+    void _writeIndex(OpenSegment *segment);
+    void _finishSegment(OpenSegment *segment);
+    void _closeAll();
+};
+
+#endif // CHATLOG_H
@@ -0,0 +1,553 @@
+#include "chatsearch.h"
+
+#include "chatlog.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <string.h>
+
+const char ChatSearchIndex::magic[8] = { 'C', 'V', 'N', 'I', 'R', 'C', 'F', '2' };
+
+template <typename T>
+static void appendLittleEndian(QByteArray *out, T value)
+{
+    uchar buf[sizeof(T)];
+    qToLittleEndian<T>(value, buf);
+    out->append(reinterpret_cast<const char *>(buf), int(sizeof(T)));
+}
+
+static void appendVarint(QByteArray *out, quint64 value)
+{
+    while (value >= 0x80) {
+        out->append(char(value | 0x80));
+        value >>= 7;
+    }
+    out->append(char(value));
+}
+
+// (Advances p; false if it would run past end, or it's too long.)
+static bool readVarint(const uchar **p, const uchar *end, quint64 *value)
+{
+    quint64 ret = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p >= end)
+            return false;
+
+        const uchar b = *(*p)++;
+        ret |= quint64(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *value = ret;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::vector<quint32> intersectPostings(const std::vector<quint32> &a, const std::vector<quint32> &b)
+{
+    std::vector<quint32> ret;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ret));
+    return ret;
+}
+
+
+bool ChatSearchIndex::open(const QString &fileName)
+{
+    close();
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly))
+        return false;
+
+    _size = _file.size();
+    if (_size < headerSize || (_map = _file.map(0, _size)) == nullptr ||
+        memcmp(_map, magic, sizeof(magic)) != 0)
+    {
+        close();
+        return false;
+    }
+
+    _recordCount = qFromLittleEndian<quint32>(_map + 8);
+    _termCount = qFromLittleEndian<quint32>(_map + 12);
+    _dataSize = qFromLittleEndian<qint64>(_map + 16);
+    if (headerSize + qint64(_termCount) * 4 > _size || _dataSize < ChatLogSegment::headerSize) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void ChatSearchIndex::close()
+{
+    _file.close();
+    _map = nullptr;
+    _size = 0;
+    _recordCount = 0;
+    _termCount = 0;
+    _dataSize = 0;
+}
+
+bool ChatSearchIndex::isOpen() const
+{
+    return _map != nullptr;
+}
+
+quint32 ChatSearchIndex::recordCount() const
+{
+    return _recordCount;
+}
+
+quint32 ChatSearchIndex::termCount() const
+{
+    return _termCount;
+}
+
+qint64 ChatSearchIndex::dataSize() const
+{
+    return _dataSize;
+}
+
+std::vector<quint32> ChatSearchIndex::postings(const QString &term, bool prefix) const
+{
+    std::vector<quint32> ret;
+    if (!isOpen())
+        return ret;
+
+    // First term not less than the one we look for.
+    const QByteArray key = term.toUtf8();
+    quint32 lo = 0, hi = _termCount;
+    while (lo < hi) {
+        const quint32 mid = lo + (hi - lo) / 2;
+        const uchar *after;
+        if (_term(mid, &after) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    // (For a prefix, all the matching terms' lists one after the other;
+    // then sorted once, rather than merged in one by one.)
+    int lists = 0;
+    for (quint32 i = lo; i < _termCount; i++) {
+        const uchar *after = nullptr;
+        const QByteArray found = _term(i, &after);
+        if (after == nullptr)
+            break;  // (Corrupt.)
+
+        if (found == key) {
+            _appendPostings(after, &ret);
+            lists++;
+            if (!prefix)
+                break;
+        }
+        else if (prefix && found.startsWith(key)) {
+            _appendPostings(after, &ret);
+            lists++;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (lists > 1) {
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    }
+
+    return ret;
+}
+
+void ChatSearchIndex::addPostings(postings_type *postings, quint32 offset, const QString &text)
+{
+    for (const QString &term : ChatSearch::tokenize(text)) {
+        std::vector<quint32> &termPostings((*postings)[term]);
+        if (termPostings.empty() || termPostings.back() != offset)
+            termPostings.push_back(offset);
+    }
+}
+
+bool ChatSearchIndex::write(const QString &fileName, quint32 recordCount, qint64 dataSize,
+                            const postings_type &postings, QString *errorString)
+{
+    // (In byte order, as looked up.)
+    std::vector<std::pair<QByteArray, const std::vector<quint32> *>> terms;
+    terms.reserve(size_t(postings.size()));
+    for (auto it = postings.constBegin(); it != postings.constEnd(); ++it)
+        terms.emplace_back(it.key().toUtf8(), &it.value());
+    std::sort(terms.begin(), terms.end(),
+        [](const std::pair<QByteArray, const std::vector<quint32> *> &a, const std::pair<QByteArray, const std::vector<quint32> *> &b) {
+            return a.first < b.first;
+        });
+
+    QByteArray entries;
+    QByteArray out(magic, sizeof(magic));
+    appendLittleEndian<quint32>(&out, recordCount);
+    appendLittleEndian<quint32>(&out, quint32(terms.size()));
+    appendLittleEndian<qint64>(&out, dataSize);
+    const quint32 entriesStart = quint32(headerSize + terms.size() * 4);
+    for (const auto &term : terms) {
+        appendLittleEndian<quint32>(&out, entriesStart + quint32(entries.length()));
+
+        appendVarint(&entries, quint64(term.first.length()));
+        entries.append(term.first);
+        appendVarint(&entries, term.second->size());
+        quint32 prev = 0;
+        for (quint32 offset : *term.second) {
+            appendVarint(&entries, offset - prev);
+            prev = offset;
+        }
+    }
+    out.append(entries);
+
+    // (Under a temporary name first, so that readers never see half of it.)
+    QFile file(fileName + ".tmp");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        file.write(out) != out.length())
+    {
+        if (errorString != nullptr)
+            *errorString = file.errorString();
+        file.remove();
+        return false;
+    }
+    file.close();
+
+    QFile::remove(fileName);
+    if (!file.rename(fileName)) {
+        if (errorString != nullptr)
+            *errorString = file.errorString();
+        file.remove();
+        return false;
+    }
+
+    return true;
+}
+
+bool ChatSearchIndex::build(const QString &dataFileName, QString *errorString)
+{
+    ChatLogSegment segment;
+    if (!segment.open(dataFileName, errorString))
+        return false;
+
+    // (Up to where it's readable; a crash may have torn the last record.)
+    postings_type postings;
+    quint32 records = 0;
+    Scrollback::Entry entry;
+    qint64 offset = ChatLogSegment::headerSize;
+    for (qint64 next; (next = segment.readRecord(offset, &entry)) >= 0; offset = next) {
+        addPostings(&postings, quint32(offset), entry.text);
+        records++;
+    }
+
+    return write(fileName(dataFileName), records, offset, postings, errorString);
+}
+
+bool ChatSearchIndex::isBehind(const QString &dataFileName)
+{
+    ChatLogSegment segment;
+    if (!segment.open(dataFileName))
+        return false;  // (Nothing to index.)
+
+    ChatSearchIndex index;
+    if (!index.open(fileName(dataFileName)))
+        return true;
+
+    return segment.readRecord(index.dataSize(), nullptr) >= 0;
+}
+
+QString ChatSearchIndex::fileName(const QString &dataFileName)
+{
+    QString ret = dataFileName;
+    if (ret.endsWith(".log"))
+        ret.chop(4);
+    return ret + ".fts";
+}
+
+QByteArray ChatSearchIndex::_term(quint32 i, const uchar **after) const
+{
+    *after = nullptr;
+    const quint32 offset = qFromLittleEndian<quint32>(_map + headerSize + i * 4);
+    if (offset >= _size)
+        return QByteArray();
+
+    const uchar *p = _map + offset;
+    const uchar *end = _map + _size;
+    quint64 len;
+    if (!readVarint(&p, end, &len) || len > quint64(end - p))
+        return QByteArray();
+
+    *after = p + len;
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(p), int(len));
+}
+
+void ChatSearchIndex::_appendPostings(const uchar *p, std::vector<quint32> *out) const
+{
+    const uchar *end = _map + _size;
+    quint64 count;
+    if (!readVarint(&p, end, &count) || count > quint64(end - p))
+        return;
+
+    out->reserve(out->size() + size_t(count));
+    quint64 offset = 0, delta;
+    for (quint64 i = 0; i < count && readVarint(&p, end, &delta); i++) {
+        offset += delta;
+        out->push_back(quint32(offset));
+    }
+}
+
+
+QStringList ChatSearch::tokenize(const QString &text)
+{
+    QStringList ret;
+    QString word;
+    auto flush = [&ret, &word]() {
+        if (word.length() >= minTermLength && word.length() <= maxTermLength)
+            ret.append(word);
+        word.clear();
+    };
+
+    for (const QChar c : text) {
+        if (c.isLetterOrNumber())
+            word.append(c.toLower());
+        else
+            flush();
+    }
+    flush();
+
+    return ret;
+}
+
+QList<ChatSearch::Term> ChatSearch::parseQuery(const QString &query)
+{
+    QList<Term> ret;
+    for (QString word : query.split(' ', QString::SkipEmptyParts)) {
+        bool prefix = false;
+        while (word.endsWith('*')) {
+            word.chop(1);
+            prefix = true;
+        }
+
+        // (A word like "foo-bar" makes two terms; only the last is a prefix.)
+        const QStringList tokens = tokenize(word);
+        for (int i = 0; i < tokens.count(); i++) {
+            Term term;
+            term.text = tokens[i];
+            term.prefix = prefix && i == tokens.count() - 1;
+            ret.append(term);
+        }
+    }
+
+    return ret;
+}
+
+QList<ChatSearchHit> ChatSearch::search(const QString &directory, const QString &query,
+                                        const QStringList &contextPaths, int maxHits)
+{
+    const QList<Term> terms = parseQuery(query);
+    if (terms.isEmpty())
+        throw std::invalid_argument("Chat search: Query has no words to search for");
+
+    std::vector<std::pair<QString, QString>> jobs;  // (Context path, segment.)
+    for (const QString &path : contextPaths.isEmpty() ? ChatLog::contextPaths(directory) : contextPaths) {
+        for (const QString &file : ChatLog::segmentFiles(directory, path))
+            jobs.emplace_back(path, file);
+    }
+
+    // One worker per core (but not for just a few segments),
+    // each taking the next segment nobody took yet.
+    const size_t threadCount = qMin<size_t>(qMax(std::thread::hardware_concurrency(), 1u), jobs.size() / 2);
+    std::vector<SegmentMatches> matches(jobs.size());
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&]() {
+        for (size_t i; (i = nextJob.fetch_add(1)) < jobs.size(); )
+            matches[i] = matchSegment(jobs[i].first, jobs[i].second, terms);
+    };
+
+    if (threadCount <= 1) {
+        worker();
+    }
+    else {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threadCount; i++)
+            threads.emplace_back(worker);
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    // Rarity of each term over everything searched; scores of different
+    // segments (and contexts) are only comparable that way.
+    quint64 records = 0;
+    std::vector<quint64> documentFrequencies(size_t(terms.count()));
+    for (const SegmentMatches &segment : matches) {
+        records += segment.records;
+        for (size_t i = 0; i < documentFrequencies.size(); i++)
+            documentFrequencies[i] += segment.documentFrequencies[i];
+    }
+
+    std::vector<double> idfs;
+    for (quint64 frequency : documentFrequencies)
+        idfs.push_back(std::log(1 + double(records) / qMax<quint64>(frequency, 1)));
+
+    // Score: Per term, its rarity, damped by how often it's in the line.
+    class Ranked
+    {
+    public:
+        double  score;
+        qint64  msecs;
+        size_t  segment;
+        quint32 offset;
+    };
+    std::vector<Ranked> ranked;
+    for (size_t s = 0; s < matches.size(); s++) {
+        const SegmentMatches &segment(matches[s]);
+        for (size_t c = 0; c < segment.offsets.size(); c++) {
+            double score = 0;
+            for (size_t i = 0; i < idfs.size(); i++)
+                score += idfs[i] * (1 + std::log(double(segment.termFrequencies[c * idfs.size() + i])));
+            ranked.push_back({ score, segment.msecs[c], s, segment.offsets[c] });
+        }
+    }
+
+    const size_t n = qMin(ranked.size(), size_t(qMax(maxHits, 0)));
+    std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(), [](const Ranked &a, const Ranked &b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+        return a.msecs > b.msecs;
+    });
+    ranked.resize(n);
+
+    // Only now read the lines that made it; segment by segment.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&ranked](size_t a, size_t b) { return ranked[a].segment < ranked[b].segment; });
+
+    std::vector<ChatSearchHit> hits(n);
+    ChatLogSegment segment;
+    size_t openSegment = size_t(-1);
+    for (size_t i : order) {
+        const Ranked &rank(ranked[i]);
+        if (rank.segment != openSegment) {
+            segment.open(jobs[rank.segment].second);
+            openSegment = rank.segment;
+        }
+
+        hits[i].contextPath = jobs[rank.segment].first;
+        hits[i].score = rank.score;
+        if (segment.readRecord(rank.offset, &hits[i].entry) < 0)
+            hits[i].entry.msecs = rank.msecs;  // (Gone meanwhile? Keep the place.)
+    }
+
+    QList<ChatSearchHit> ret;
+    ret.reserve(int(n));
+    for (const ChatSearchHit &hit : hits)
+        ret.append(hit);
+    return ret;
+}
+
+QFuture<QList<ChatSearchHit>> ChatSearch::searchInBackground(const ChatLog &chatLog, const QString &query,
+                                                             const QStringList &contextPaths, int maxHits)
+{
+    // (Here, where it can still be caught.)
+    if (parseQuery(query).isEmpty())
+        throw std::invalid_argument("Chat search: Query has no words to search for");
+
+    // (A copy; the chat log may get stopped meanwhile.)
+    const QString directory = chatLog.directory();
+    return QtConcurrent::run([directory, query, contextPaths, maxHits]() {
+        return search(directory, query, contextPaths, maxHits);
+    });
+}
+
+static bool termMatches(const QString &token, const ChatSearch::Term &term)
+{
+    return term.prefix ? token.startsWith(term.text) : token == term.text;
+}
+
+// (False if one of the terms isn't in there.)
+static bool countTerms(const QStringList &tokens, const QList<ChatSearch::Term> &terms, std::vector<quint16> *out)
+{
+    bool all = true;
+    for (const ChatSearch::Term &term : terms) {
+        const auto frequency = std::count_if(tokens.begin(), tokens.end(), [&term](const QString &token) { return termMatches(token, term); });
+        out->push_back(quint16(qMin<qint64>(frequency, 0xffff)));
+        if (frequency == 0)
+            all = false;
+    }
+    return all;
+}
+
+ChatSearch::SegmentMatches ChatSearch::matchSegment(const QString &contextPath, const QString &dataFileName,
+                                                   const QList<Term> &terms)
+{
+    SegmentMatches ret;
+    ret.contextPath = contextPath;
+    ret.dataFileName = dataFileName;
+    ret.documentFrequencies.resize(size_t(terms.count()));
+
+    // (Index first: The writer may update both meanwhile, and the index
+    // shouldn't cover more than we get to see of the data.)
+    ChatSearchIndex index;
+    const bool indexed = index.open(ChatSearchIndex::fileName(dataFileName));
+    ChatLogSegment segment;
+    if (terms.isEmpty() || !segment.open(dataFileName))
+        return ret;
+
+    auto addCandidate = [&ret](quint32 offset, qint64 msecs, const std::vector<quint16> &frequencies) {
+        ret.offsets.push_back(offset);
+        ret.msecs.push_back(msecs);
+        ret.termFrequencies.insert(ret.termFrequencies.end(), frequencies.begin(), frequencies.end());
+    };
+
+    Scrollback::Entry entry;
+    std::vector<quint16> frequencies;
+    qint64 scanFrom = ChatLogSegment::headerSize;
+    if (indexed) {
+        // Candidates: Records containing all the terms. (Frequencies of
+        // all terms, though; they count for the other segments' scores.)
+        ret.records = index.recordCount();
+        scanFrom = index.dataSize();
+        std::vector<quint32> candidates;
+        for (int i = 0; i < terms.count(); i++) {
+            const std::vector<quint32> postings = index.postings(terms[i].text, terms[i].prefix);
+            ret.documentFrequencies[size_t(i)] = postings.size();
+            candidates = i == 0 ? postings : intersectPostings(candidates, postings);
+        }
+
+        for (quint32 offset : candidates) {
+            frequencies.clear();
+            // (Not all there: Index doesn't match the data.)
+            if (segment.readRecord(offset, &entry) >= 0 && countTerms(tokenize(entry.text), terms, &frequencies))
+                addCandidate(offset, entry.msecs, frequencies);
+        }
+    }
+
+    // What the index doesn't cover (all of it, without one): Scan.
+    for (qint64 offset = scanFrom, next; (next = segment.readRecord(offset, &entry)) >= 0; offset = next) {
+        ret.records++;
+        frequencies.clear();
+        const bool all = countTerms(tokenize(entry.text), terms, &frequencies);
+        for (size_t i = 0; i < frequencies.size(); i++) {
+            if (frequencies[i] != 0)
+                ret.documentFrequencies[i]++;
+        }
+        if (all)
+            addCandidate(quint32(offset), entry.msecs, frequencies);
+    }
+
+    return ret;
+}
+
+bool ChatSearch::rankedBefore(const ChatSearchHit &a, const ChatSearchHit &b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+
+    return a.entry.msecs > b.entry.msecs;
+}
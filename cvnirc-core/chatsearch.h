@@ -0,0 +1,129 @@
+#ifndef CHATSEARCH_H
+#define CHATSEARCH_H
+
+#include "cvnirc-core_global.h"
+
+#include <QFile>
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "scrollback.h"
+
+class ChatLog;
+
+// Full-text index of a chat log segment (all integers little-endian):
+//
+//   NNNN.fts:  8 bytes magic "CVNIRCF2", u32 record count, u32 term count,
+//              u64 size of the .log covered (the records before that),
+//              u32 offset of each term's entry (in term order),
+//              then the entries: varint term length, term (UTF-8),
+//              varint posting count, postings.
+//
+// Postings are the offsets of the records (into the .log) containing
+// the term, ascending, each stored as a varint delta to the previous.
+// The chat log's writer thread collects them while appending, and writes
+// the index every few seconds while the segment grows (so it may lag
+// behind; searching scans the rest) and once it is complete.
+class CVNIRCCORESHARED_EXPORT ChatSearchIndex
+{
+    QFile _file;
+    const uchar *_map = nullptr;
+    qint64 _size = 0;
+    quint32 _recordCount = 0;
+    quint32 _termCount = 0;
+    qint64  _dataSize = 0;
+
+public:
+    static const char magic[8];
+    static const int headerSize = 8 + 4 + 4 + 8;
+
+    typedef QHash<QString, std::vector<quint32>> postings_type;
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+
+    quint32 recordCount() const;
+    quint32 termCount() const;
+    qint64 dataSize() const;
+
+    // Postings of term; or, for a prefix, of all terms starting with it.
+    std::vector<quint32> postings(const QString &term, bool prefix = false) const;
+
+    // (Each term of the record's text, once.)
+    static void addPostings(postings_type *postings, quint32 offset, const QString &text);
+    static bool write(const QString &fileName, quint32 recordCount, qint64 dataSize,
+                      const postings_type &postings, QString *errorString = nullptr);
+    // Indexes all of a segment that's there, from scratch.
+    static bool build(const QString &dataFileName, QString *errorString = nullptr);
+    // Whether the segment has records the index doesn't cover.
+    static bool isBehind(const QString &dataFileName);
+    static QString fileName(const QString &dataFileName);
+
+private:
+    QByteArray _term(quint32 i, const uchar **after) const;
+    void _appendPostings(const uchar *p, std::vector<quint32> *out) const;
+};
+
+class CVNIRCCORESHARED_EXPORT ChatSearchHit
+{
+public:
+    QString contextPath;
+    Scrollback::Entry entry;
+    double score = 0;
+};
+
+// Searches chat logs for lines containing all the query's words (a
+// trailing '*' makes a word match as a prefix). Hits are ranked by
+// how often, and how rare, the words are; newer first among equals.
+//
+// Segments get searched in parallel; via their index as far as that
+// goes, and by scanning the rest (like what got written since the index
+// did, or all of a segment without one).
+class CVNIRCCORESHARED_EXPORT ChatSearch
+{
+public:
+    class Term
+    {
+    public:
+        QString text;
+        bool    prefix = false;
+    };
+
+    static const int minTermLength = 2;
+    static const int maxTermLength = 64;
+
+    // Lower-cased words of text, in order, repeats included.
+    static QStringList tokenize(const QString &text);
+    static QList<Term> parseQuery(const QString &query);
+
+    // (No context paths: all of them.)
+    static QList<ChatSearchHit> search(const QString &directory, const QString &query,
+                                       const QStringList &contextPaths, int maxHits);
+    // Same, on the thread pool; with many segments, searching takes a
+    // while. (Throws right away for a query that has no words.)
+    static QFuture<QList<ChatSearchHit>> searchInBackground(const ChatLog &chatLog, const QString &query,
+                                                           const QStringList &contextPaths, int maxHits);
+
+    // What a segment has for a query, before scoring; that takes the
+    // document frequencies of all the segments searched.
+    class SegmentMatches
+    {
+    public:
+        QString contextPath, dataFileName;
+        quint64 records = 0;
+        std::vector<quint64> documentFrequencies;  // (Per term.)
+        std::vector<quint32> offsets;  // (Of the records containing all the terms.)
+        std::vector<qint64>  msecs;    // (Per offset.)
+        std::vector<quint16> termFrequencies;  // (Per offset, per term.)
+    };
+
+    static SegmentMatches matchSegment(const QString &contextPath, const QString &dataFileName,
+                                       const QList<Term> &terms);
+    static bool rankedBefore(const ChatSearchHit &a, const ChatSearchHit &b);
+};
+
+#endif // CHATSEARCH_H
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT += network
+QT += network concurrent
 QT -= gui
 
 CONFIG += c++11
@@ -34,7 +34,20 @@ SOURCES += irccore.cpp \
     command.cpp \
     commandgroup.cpp \
     commanddefinition.cpp \
-    irccorecommandgroup.cpp
+    irccorecommandgroup.cpp \
+    ircprotostring.cpp \
+    ircprotorecorder.cpp \
+    ircprotostats.cpp \
+    timerwheel.cpp \
+    admissionlimiter.cpp \
+    dnscache.cpp \
+    tlssessioncache.cpp \
+    remoteproto.cpp \
+    remotecore.cpp \
+    scrollback.cpp \
+    chatlog.cpp \
+    chatsearch.cpp \
+    highlightmatcher.cpp
 
 HEADERS += cvnirc-core_global.h \
     irccore.h \
@@ -45,7 +58,20 @@ HEADERS += cvnirc-core_global.h \
     command.h \
     commandgroup.h \
     commanddefinition.h \
-    irccorecommandgroup.h
+    irccorecommandgroup.h \
+    ircprotostring.h \
+    ircprotorecorder.h \
+    ircprotostats.h \
+    timerwheel.h \
+    admissionlimiter.h \
+    dnscache.h \
+    tlssessioncache.h \
+    remoteproto.h \
+    remotecore.h \
+    scrollback.h \
+    chatlog.h \
+    chatsearch.h \
+    highlightmatcher.h
 
 unix {
     target.path = /usr/local/lib
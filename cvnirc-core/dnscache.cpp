@@ -0,0 +1,162 @@
+#include "dnscache.h"
+
+#include <QDnsLookup>
+#include <stdexcept>
+
+DnsCache::DnsCache(QObject *parent) : QObject(parent)
+{
+    _clock.start();
+}
+
+void DnsCache::resolve(const QString &host, QObject *context, callback_type callback)
+{
+    if (context == nullptr)
+        throw std::invalid_argument("DNS cache, resolve: Context can't be null");
+    if (!callback)
+        throw std::invalid_argument("DNS cache, resolve: Callback can't be empty");
+
+    // Nothing to look up for an IP literal.
+    QHostAddress literal;
+    if (literal.setAddress(host)) {
+        callback({ literal }, QString());
+        return;
+    }
+
+    QList<QHostAddress> cached;
+    if (lookupCached(host, &cached)) {
+        callback(cached, QString());
+        return;
+    }
+
+    const QString key = host.toLower();
+    const bool alreadyPending = _pending.contains(key);
+    Pending &pending(_pending[key]);
+    pending.waiters.append({ context, callback });
+    if (alreadyPending)
+        return;
+
+    // Both address families in parallel.
+    for (QDnsLookup::Type type : { QDnsLookup::AAAA, QDnsLookup::A }) {
+        auto *lookup = new QDnsLookup(type, host, this);
+        connect(lookup, &QDnsLookup::finished, this, [this, key, lookup]() {
+            _dnsLookupFinished(key, lookup);
+        });
+        pending.lookupsLeft++;
+        lookup->lookup();
+    }
+}
+
+bool DnsCache::lookupCached(const QString &host, QList<QHostAddress> *addresses)
+{
+    if (addresses == nullptr)
+        throw std::invalid_argument("DNS cache, lookup cached: Addresses can't be null");
+
+    auto it = _entries.find(host.toLower());
+    if (it == _entries.end()) {
+        _misses++;
+        return false;
+    }
+
+    if (_clock.elapsed() >= it.value().expiresMSecs) {
+        _entries.erase(it);
+        _misses++;
+        return false;
+    }
+
+    _hits++;
+    *addresses = it.value().addresses;
+    return true;
+}
+
+void DnsCache::clear()
+{
+    _entries.clear();
+}
+
+int DnsCache::count() const
+{
+    return _entries.count();
+}
+
+quint64 DnsCache::hits() const
+{
+    return _hits;
+}
+
+quint64 DnsCache::misses() const
+{
+    return _misses;
+}
+
+void DnsCache::_dnsLookupFinished(const QString &key, QDnsLookup *lookup)
+{
+    lookup->deleteLater();
+
+    auto it = _pending.find(key);
+    if (it == _pending.end())
+        return;
+
+    Pending &pending(it.value());
+    if (lookup->error() == QDnsLookup::NoError) {
+        for (const QDnsHostAddressRecord &record : lookup->hostAddressRecords()) {
+            const QHostAddress address = record.value();
+            QList<QHostAddress> &list(address.protocol() == QAbstractSocket::IPv6Protocol ? pending.ipv6 : pending.ipv4);
+            if (!list.contains(address))
+                list.append(address);
+            pending.minTtl = qMin(pending.minTtl, record.timeToLive());
+        }
+    }
+    else if (pending.errorString.isEmpty()) {
+        pending.errorString = lookup->errorString();
+    }
+
+    if (--pending.lookupsLeft > 0)
+        return;
+
+    if (pending.ipv6.isEmpty() && pending.ipv4.isEmpty()) {
+        // Not in the DNS; but the system resolver also knows about,
+        // e.g., /etc/hosts. (It doesn't say for how long, though.)
+        const int id = QHostInfo::lookupHost(key, this, SLOT(handle_hostInfo_lookedUp(QHostInfo)));
+        _hostInfoLookups.insert(id, key);
+        return;
+    }
+
+    _finish(key, pending.ipv6 + pending.ipv4, pending.minTtl, QString());
+}
+
+void DnsCache::handle_hostInfo_lookedUp(const QHostInfo &info)
+{
+    const QString key = _hostInfoLookups.take(info.lookupId());
+    if (key.isNull())
+        return;
+
+    QList<QHostAddress> ipv6, ipv4;
+    for (const QHostAddress &address : info.addresses())
+        (address.protocol() == QAbstractSocket::IPv6Protocol ? ipv6 : ipv4).append(address);
+
+    QString errorString;
+    if (info.error() != QHostInfo::NoError)
+        errorString = info.errorString();
+    else if (ipv6.isEmpty() && ipv4.isEmpty())
+        errorString = "No addresses found";
+
+    _finish(key, ipv6 + ipv4, fallbackTtlSecs, errorString);
+}
+
+void DnsCache::_finish(const QString &key, const QList<QHostAddress> &addresses, quint32 ttlSecs, const QString &errorString)
+{
+    const QList<Waiter> waiters = _pending.take(key).waiters;
+
+    // (Failures don't get cached; whoever asked will likely back off anyway.)
+    if (!addresses.isEmpty()) {
+        Entry entry;
+        entry.addresses = addresses;
+        entry.expiresMSecs = _clock.elapsed() + qint64(qBound<quint32>(minTtlSecs, ttlSecs, maxTtlSecs)) * 1000;
+        _entries.insert(key, entry);
+    }
+
+    for (const Waiter &waiter : waiters) {
+        if (waiter.context)
+            waiter.callback(addresses, errorString);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+#include "cvnirc-core_global.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QList>
+#include <QPointer>
+#include <functional>
+
+class QDnsLookup;
+
+// Resolved address lists per host name, kept for as long as the DNS
+// records' TTL says (within bounds). Looks up IPv6 and IPv4 in parallel;
+// concurrent requests for the same name share one lookup.
+class CVNIRCCORESHARED_EXPORT DnsCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(const QList<QHostAddress> &addresses, const QString &errorString)> callback_type;
+
+    static const int minTtlSecs = 10;
+    static const int maxTtlSecs = 60 * 60;
+    static const int fallbackTtlSecs = 60;  // (System resolver doesn't tell the TTL.)
+
+private:
+    class Entry
+    {
+    public:
+        QList<QHostAddress> addresses;
+        qint64 expiresMSecs = 0;
+    };
+
+    class Waiter
+    {
+    public:
+        QPointer<QObject> context;
+        callback_type callback;
+    };
+
+    class Pending
+    {
+    public:
+        QList<Waiter> waiters;
+        int lookupsLeft = 0;
+        QList<QHostAddress> ipv6, ipv4;
+        quint32 minTtl = 0xffffffff;
+        QString errorString;
+    };
+
+    QElapsedTimer _clock;
+    QHash<QString, Entry> _entries;
+    QHash<QString, Pending> _pending;
+    QHash<int, QString> _hostInfoLookups;  // (Lookup id -> name.)
+    quint64 _hits = 0, _misses = 0;
+
+public:
+    explicit DnsCache(QObject *parent = 0);
+
+    // Calls back with the addresses (IPv6 ones first), or an error string.
+    // Might do so right away, for an IP literal or a cache hit. Skipped if
+    // context got destroyed meanwhile.
+    void resolve(const QString &host, QObject *context, callback_type callback);
+    bool lookupCached(const QString &host, QList<QHostAddress> *addresses);
+    void clear();
+
+    int count() const;
+    quint64 hits() const;
+    quint64 misses() const;
+
+private slots:
+    void handle_hostInfo_lookedUp(const QHostInfo &info);
+
+private:
+    void _dnsLookupFinished(const QString &key, QDnsLookup *lookup);
+    void _finish(const QString &key, const QList<QHostAddress> &addresses, quint32 ttlSecs, const QString &errorString);
+};
+
+#endif // DNSCACHE_H
@@ -0,0 +1,229 @@
+#include "highlightmatcher.h"
+
+#include <deque>
+#include <string.h>
+
+HighlightMatcher::HighlightMatcher(CaseMapping caseMapping) :
+    _caseMapping(caseMapping)
+{
+    _compile();
+}
+
+HighlightMatcher::CaseMapping HighlightMatcher::caseMapping() const
+{
+    return _caseMapping;
+}
+
+void HighlightMatcher::setCaseMapping(CaseMapping caseMapping)
+{
+    if (_caseMapping == caseMapping)
+        return;
+
+    _caseMapping = caseMapping;
+    _compile();
+}
+
+const QStringList &HighlightMatcher::patterns() const
+{
+    return _patterns;
+}
+
+void HighlightMatcher::setPatterns(const QStringList &patterns)
+{
+    _patterns = patterns;
+    _compile();
+}
+
+bool HighlightMatcher::isEmpty() const
+{
+    return _compiled.empty();
+}
+
+bool HighlightMatcher::matches(const QString &text) const
+{
+    bool ret = false;
+    _scan(text, [&ret](const Match &) {
+        ret = true;
+        return false;
+    });
+    return ret;
+}
+
+QList<HighlightMatcher::Match> HighlightMatcher::findAll(const QString &text) const
+{
+    QList<Match> ret;
+    _scan(text, [&ret](const Match &match) {
+        ret.append(match);
+        return true;
+    });
+    return ret;
+}
+
+QChar HighlightMatcher::fold(QChar c, CaseMapping caseMapping)
+{
+    const ushort u = c.unicode();
+    if (u >= asciiSize)
+        return c.toLower();  // (Beyond what casemapping covers; fold anyway.)
+
+    if (u >= 'A' && u <= 'Z')
+        return QChar(ushort(u + ('a' - 'A')));
+
+    if (caseMapping == CaseMapping::Ascii)
+        return c;
+
+    switch (u) {
+    case '[':  return QChar('{');
+    case ']':  return QChar('}');
+    case '\\': return QChar('|');
+    case '~':  return caseMapping == CaseMapping::Rfc1459 ? QChar('^') : c;
+    }
+
+    return c;
+}
+
+bool HighlightMatcher::isNickChar(QChar c)
+{
+    if (c.isLetterOrNumber())
+        return true;
+
+    return c.unicode() != 0 && c.unicode() < asciiSize && strchr("[]\\`_^{|}-", char(c.unicode())) != nullptr;
+}
+
+void HighlightMatcher::_compile()
+{
+    _compiled.clear();
+    _nodes.clear();
+    _asciiNext.clear();
+    _otherNext.clear();
+    _addNode();  // (Root.)
+
+    // Trie of the folded patterns. (-1: No edge, yet.)
+    for (int i = 0; i < _patterns.count(); i++) {
+        const QString &pattern(_patterns[i]);
+        _compiled.push_back({ pattern.length(), false, false });
+        if (pattern.isEmpty())
+            continue;
+
+        _compiled.back().wordStart = isNickChar(pattern[0]);
+        _compiled.back().wordEnd = isNickChar(pattern[pattern.length() - 1]);
+
+        int state = 0;
+        for (const QChar c : pattern) {
+            const ushort u = fold(c, _caseMapping).unicode();
+            int next;
+            if (u < asciiSize) {
+                next = _asciiNext[size_t(state) * asciiSize + u];
+                if (next < 0) {
+                    next = _addNode();
+                    _asciiNext[size_t(state) * asciiSize + u] = next;
+                }
+            }
+            else {
+                const quint64 key = quint64(state) << 16 | u;
+                next = _otherNext.value(key, -1);
+                if (next < 0) {
+                    next = _addNode();
+                    _otherNext.insert(key, next);
+                }
+            }
+            state = next;
+        }
+
+        // (Same pattern twice, after folding: First one wins.)
+        if (_nodes[size_t(state)].output < 0)
+            _nodes[size_t(state)].output = i;
+    }
+
+    // (Only empty patterns: nothing to look for.)
+    if (_nodes.size() == 1)
+        _compiled.clear();
+
+    // Children of each node with non-ASCII edges, for the breadth-first pass.
+    QHash<int, QList<QPair<ushort, int>>> otherChildren;
+    for (auto it = _otherNext.constBegin(); it != _otherNext.constEnd(); ++it)
+        otherChildren[int(it.key() >> 16)].append(qMakePair(ushort(it.key() & 0xffff), it.value()));
+
+    // Breadth-first: Failure links (longest proper suffix that's in the
+    // trie) and dictionary links; and complete the ASCII table by
+    // following the failure links. (Whatever those point to is shallower,
+    // so has been dealt with already.)
+    auto discover = [this](int child, int fail) {
+        Node &node(_nodes[size_t(child)]);
+        node.fail = fail;
+        node.dictLink = _nodes[size_t(fail)].output >= 0 ? fail : _nodes[size_t(fail)].dictLink;
+    };
+
+    std::deque<int> queue;
+    queue.push_back(0);
+    while (!queue.empty()) {
+        const int state = queue.front();
+        queue.pop_front();
+        const int fail = _nodes[size_t(state)].fail;
+
+        for (ushort u = 0; u < asciiSize; u++) {
+            int &next(_asciiNext[size_t(state) * asciiSize + u]);
+            if (next < 0) {
+                next = state == 0 ? 0 : _asciiNext[size_t(fail) * asciiSize + u];
+                continue;
+            }
+
+            discover(next, state == 0 ? 0 : _asciiNext[size_t(fail) * asciiSize + u]);
+            queue.push_back(next);
+        }
+
+        for (const QPair<ushort, int> &edge : otherChildren.value(state)) {
+            discover(edge.second, state == 0 ? 0 : _next(fail, edge.first));
+            queue.push_back(edge.second);
+        }
+    }
+}
+
+int HighlightMatcher::_addNode()
+{
+    _nodes.emplace_back();
+    _asciiNext.resize(_asciiNext.size() + asciiSize, -1);
+    return int(_nodes.size()) - 1;
+}
+
+int HighlightMatcher::_next(int state, ushort unit) const
+{
+    if (unit < asciiSize)
+        return _asciiNext[size_t(state) * asciiSize + unit];
+
+    for (;;) {
+        const int next = _otherNext.value(quint64(state) << 16 | unit, -1);
+        if (next >= 0)
+            return next;
+        if (state == 0)
+            return 0;
+        state = _nodes[size_t(state)].fail;
+    }
+}
+
+template <typename F>
+void HighlightMatcher::_scan(const QString &text, F onMatch) const
+{
+    if (isEmpty())
+        return;
+
+    const int n = text.length();
+    int state = 0;
+    for (int i = 0; i < n; i++) {
+        state = _next(state, fold(text[i], _caseMapping).unicode());
+
+        // All patterns ending here: This node's, and down the dictionary links.
+        const Node &node(_nodes[size_t(state)]);
+        for (int s = node.output >= 0 ? state : node.dictLink; s >= 0; s = _nodes[size_t(s)].dictLink) {
+            const int patternIndex = _nodes[size_t(s)].output;
+            const Pattern &pattern(_compiled[size_t(patternIndex)]);
+            const int start = i - pattern.length + 1;
+            if (pattern.wordStart && start > 0 && isNickChar(text[start - 1]))
+                continue;
+            if (pattern.wordEnd && i + 1 < n && isNickChar(text[i + 1]))
+                continue;
+
+            if (!onMatch(Match { start, pattern.length, patternIndex }))
+                return;
+        }
+    }
+}
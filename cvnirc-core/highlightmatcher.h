@@ -0,0 +1,87 @@
+#ifndef HIGHLIGHTMATCHER_H
+#define HIGHLIGHTMATCHER_H
+
+#include "cvnirc-core_global.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Finds any of a set of patterns (nicks, keywords) in a line, in a
+// single pass however many patterns there are: They're compiled into
+// one Aho-Corasick automaton over case-folded UTF-16 code units.
+// Transitions on ASCII are a complete table; others go via a hash
+// and the failure links.
+//
+// Patterns match as whole words: One that starts (ends) with a nick
+// character needs a non-nick character (or the line's edge) before
+// (after) it. So "bob" highlights "bob: hi" but not "bobcat".
+class CVNIRCCORESHARED_EXPORT HighlightMatcher
+{
+public:
+    // (As announced by servers in ISUPPORT CASEMAPPING.)
+    enum class CaseMapping {
+        Ascii,
+        Rfc1459,        // (Also folds []\~ to {}|^.)
+        StrictRfc1459,  // (Only []\ to {}|.)
+    };
+
+    class Match
+    {
+    public:
+        int start;
+        int length;
+        int pattern;  // (Index into patterns().)
+    };
+
+private:
+    static const int asciiSize = 128;
+
+    class Node
+    {
+    public:
+        int fail = 0;
+        int output = -1;    // (Pattern ending here, if any.)
+        int dictLink = -1;  // (Next node down the failure chain with an output.)
+    };
+
+    class Pattern
+    {
+    public:
+        int  length;
+        bool wordStart, wordEnd;
+    };
+
+    CaseMapping _caseMapping;
+    QStringList _patterns;
+    std::vector<Pattern> _compiled;
+    std::vector<Node> _nodes;
+    std::vector<int> _asciiNext;   // (Node * asciiSize + unit.)
+    QHash<quint64, int> _otherNext;  // (Node << 16 | unit; goto edges only.)
+
+public:
+    explicit HighlightMatcher(CaseMapping caseMapping = CaseMapping::Rfc1459);
+
+    CaseMapping caseMapping() const;
+    void setCaseMapping(CaseMapping caseMapping);
+    const QStringList &patterns() const;
+    void setPatterns(const QStringList &patterns);
+    bool isEmpty() const;
+
+    // (Stops at the first match.)
+    bool matches(const QString &text) const;
+    QList<Match> findAll(const QString &text) const;
+
+    static QChar fold(QChar c, CaseMapping caseMapping);
+    static bool isNickChar(QChar c);
+
+private:
+    void _compile();
+    int _addNode();
+    int _next(int state, ushort unit) const;
+    template <typename F> void _scan(const QString &text, F onMatch) const;
+};
+
+#endif // HIGHLIGHTMATCHER_H
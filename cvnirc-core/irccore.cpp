@@ -2,9 +2,104 @@
 
 #include "ircprotoclient.h"
 #include "irccorecontext.h"
+#include <stdexcept>
+#include <string>
+
+IRCCore::IRCCore(QObject *parent) : QObject(parent),
+    _timerWheel(100, this),
+    _reconnectLimiter(&_timerWheel, 5, 10, this),
+    _dnsCache(this),
+    _tlsSessionCache(TlsSessionCache::defaultMaxEntries, this),
+    _senderInterner(std::make_shared<StringInterner>())
+{
+}
+
+TimerWheel &IRCCore::timerWheel()
+{
+    return _timerWheel;
+}
+
+AdmissionLimiter &IRCCore::reconnectLimiter()
+{
+    return _reconnectLimiter;
+}
+
+DnsCache &IRCCore::dnsCache()
+{
+    return _dnsCache;
+}
 
-IRCCore::IRCCore(QObject *parent) : QObject(parent)
+TlsSessionCache &IRCCore::tlsSessionCache()
 {
+    return _tlsSessionCache;
+}
+
+const std::shared_ptr<StringInterner> &IRCCore::senderInterner()
+{
+    return _senderInterner;
+}
+
+ChatLog &IRCCore::chatLog()
+{
+    return _chatLog;
+}
+
+const QStringList &IRCCore::highlightNicks() const
+{
+    return _highlightNicks;
+}
+
+void IRCCore::setHighlightNicks(const QStringList &nicks)
+{
+    _highlightNicks = nicks;
+    _highlightMatchers.clear();
+}
+
+const QStringList &IRCCore::highlightKeywords() const
+{
+    return _highlightKeywords;
+}
+
+void IRCCore::setHighlightKeywords(const QStringList &keywords)
+{
+    _highlightKeywords = keywords;
+    _highlightMatchers.clear();
+}
+
+bool IRCCore::isHighlight(IRCProtoClient *ircProtoClient, const QString &text)
+{
+    if (ircProtoClient == nullptr)
+        throw std::invalid_argument("IRCCore, is highlight: IRC protocol client can't be null");
+
+    auto it = _highlightMatchers.find(ircProtoClient);
+    if (it == _highlightMatchers.end()) {
+        QStringList patterns(_highlightNicks);
+        patterns.append(_highlightKeywords);
+        // TODO: Use nick *taken* last, when we have support to track this.
+        if (!ircProtoClient->nickRequestedLast().isEmpty())
+            patterns.prepend(ircProtoClient->nickRequestedLast());
+
+        // TODO: Go by the server's CASEMAPPING, once we parse ISUPPORT.
+        it = _highlightMatchers.insert(ircProtoClient, HighlightMatcher(HighlightMatcher::CaseMapping::Rfc1459));
+        it.value().setPatterns(patterns);
+    }
+
+    return it.value().matches(text);
+}
+
+int IRCCore::scrollbackMaxLines() const
+{
+    return _scrollbackMaxLines;
+}
+
+void IRCCore::setScrollbackMaxLines(int maxLines)
+{
+    if (maxLines <= 0)
+        throw std::invalid_argument("IRCCore, set scrollback max lines: Must be positive");
+    if (maxLines > Scrollback::maxMaxLines)
+        throw std::invalid_argument("IRCCore, set scrollback max lines: At most " + std::to_string(Scrollback::maxMaxLines));
+
+    _scrollbackMaxLines = maxLines;
 }
 
 const QList<IRCProtoClient *> &IRCCore::ircProtoClients()
@@ -20,8 +115,23 @@ const QList<IRCCoreContext *> &IRCCore::contexts()
 IRCCoreContext *IRCCore::createIRCProtoClient()
 {
     auto *client = new IRCProtoClient(this);
+    client->setTimerWheel(&_timerWheel);
+    client->setReconnectLimiter(&_reconnectLimiter);
+    client->setDnsCache(&_dnsCache);
+    client->setTlsSessionCache(&_tlsSessionCache);
     _ircProtoClients.append(client);
 
+    // (Our nick is one of the highlight patterns.)
+    connect(client, &IRCProtoClient::nickRequestedLastChanged, this, [this, client]() {
+        _highlightMatchers.remove(client);
+    });
+
+    // The number of connections decides whether contexts
+    // need to carry the server name in their disambiguator.
+    // TODO: Do this on removal of protocol clients, too, once that is supported.
+    for (IRCCoreContext *context : _contexts)
+        context->invalidateDisambiguator();
+
     auto *context = new IRCCoreContext(client, IRCCoreContext::Type::Server, QString(), this);
     _contexts.append(context);
     createdContext(context);
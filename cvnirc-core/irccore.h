@@ -7,6 +7,14 @@
 #include <QList>
 #include <QString>
 #include "irccorecontext.h"
+#include "timerwheel.h"
+#include "admissionlimiter.h"
+#include "dnscache.h"
+#include "tlssessioncache.h"
+#include "scrollback.h"
+#include "chatlog.h"
+#include "highlightmatcher.h"
+#include <QHash>
 
 class IRCProtoClient;
 
@@ -15,9 +23,39 @@ class CVNIRCCORESHARED_EXPORT IRCCore : public QObject
     Q_OBJECT
     QList<IRCProtoClient *> _ircProtoClients;
     QList<IRCCoreContext *> _contexts;
+    TimerWheel _timerWheel;  // (Shared by the protocol clients and frontends.)
+    AdmissionLimiter _reconnectLimiter;
+    DnsCache _dnsCache;
+    TlsSessionCache _tlsSessionCache;
+    std::shared_ptr<StringInterner> _senderInterner;  // (Shared by the contexts' scrollbacks; they may outlive us.)
+    int _scrollbackMaxLines = Scrollback::defaultMaxLines;
+    ChatLog _chatLog;
+    QStringList _highlightNicks, _highlightKeywords;
+    QHash<IRCProtoClient *, HighlightMatcher> _highlightMatchers;  // (Built when first needed.)
 public:
     explicit IRCCore(QObject *parent = 0);
 
+    TimerWheel &timerWheel();
+    // Spreads out automatic reconnects of all the protocol clients.
+    AdmissionLimiter &reconnectLimiter();
+    DnsCache &dnsCache();
+    TlsSessionCache &tlsSessionCache();
+    const std::shared_ptr<StringInterner> &senderInterner();
+    // (Not logging until started.)
+    ChatLog &chatLog();
+
+    // What highlights a line: Our current nick (per connection), plus
+    // these alternate nicks and keywords (on all connections).
+    const QStringList &highlightNicks() const;
+    void setHighlightNicks(const QStringList &nicks);
+    const QStringList &highlightKeywords() const;
+    void setHighlightKeywords(const QStringList &keywords);
+    bool isHighlight(IRCProtoClient *ircProtoClient, const QString &text);
+
+    int scrollbackMaxLines() const;
+    // (Applies to contexts created from now on.)
+    void setScrollbackMaxLines(int maxLines);
+
     const QList<IRCProtoClient *> &ircProtoClients();
     const QList<IRCCoreContext *> &contexts();
 
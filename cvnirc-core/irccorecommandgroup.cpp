@@ -1,5 +1,8 @@
 #include "irccorecommandgroup.h"
 
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <stdexcept>
 #include "command.h"
 #include "irccorecontext.h"
@@ -97,6 +100,438 @@ void IRCCoreCommandGroup::cmd_reconnect(Command *cmd, IRCCoreContext *context)
     context->ircProtoClient()->reconnectToIRCServer();
 }
 
+QStringList IRCCoreCommandGroup::cmdhelp_charset()
+{
+    return {
+        "Show or set the fallback encoding for text that is not UTF-8",
+        "(for the connection in a server context, else for the current channel/query;",
+        "use an empty string to make a channel/query follow the connection again)",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_charset(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command charset: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command charset: Context can't be null");
+
+    const QStringList &msgTokens(cmd->tokens());
+    if (!(msgTokens.length() >= 1 && msgTokens.length() <= 2))
+        throw std::invalid_argument("IRCCore command charset: Usage: /charset [ENCODING]");
+
+    IRCProtoClient *client = context->ircProtoClient();
+    if (client == nullptr)
+        throw std::invalid_argument("IRCCore command charset: Context's IRC protocol client can't be null");
+
+    bool perTarget = context->type() != IRCCoreContext::Type::Server;
+    const QString &target(context->outgoingTarget());
+
+    if (msgTokens.length() == 1) {
+        auto decoder = perTarget ? client->textDecoderForTarget(target) : client->textDecoder();
+        context->notifyUser("Fallback encoding" + (perTarget ? " for " + target : QString()) +
+                            ": " + decoder->fallbackName(), context);
+        return;
+    }
+
+    const QByteArray codecName = msgTokens[1].toLatin1();
+    bool ok = perTarget ?
+        client->setTargetFallbackEncoding(target, codecName) :
+        client->setFallbackEncoding(codecName);
+    if (!ok)
+        throw std::invalid_argument("IRCCore command charset: Unknown encoding \"" + msgTokens[1].toStdString() + "\"");
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_record()
+{
+    return {
+        "Show status of, start or stop (\"off\") recording this connection's traffic to a capture file",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_record(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command record: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command record: Context can't be null");
+
+    const QStringList &msgTokens(cmd->tokens());
+    if (!(msgTokens.length() >= 1 && msgTokens.length() <= 2))
+        throw std::invalid_argument("IRCCore command record: Usage: /record [FILE|off]");
+
+    IRCProtoClient *client = context->ircProtoClient();
+    if (client == nullptr)
+        throw std::invalid_argument("IRCCore command record: Context's IRC protocol client can't be null");
+
+    IRCProto::TrafficRecorder &recorder(client->trafficRecorder());
+    auto counts = [&recorder]() {
+        return QString::number(recorder.recordedCount()) + " lines, " +
+               QString::number(recorder.droppedCount()) + " dropped";
+    };
+
+    // (The writer gave up; close the file, and say why.)
+    if (recorder.writeFailed()) {
+        const QString errorString = recorder.errorString();
+        recorder.stop();
+        context->notifyUser("Recording traffic to " + recorder.fileName() + " failed: " + errorString + " (" + counts() + ")", context);
+        if (msgTokens.length() == 1 || msgTokens[1] == "off")
+            return;
+    }
+
+    if (msgTokens.length() == 1) {
+        if (!recorder.isRecording())
+            context->notifyUser("Not recording traffic.", context);
+        else
+            context->notifyUser("Recording traffic to " + recorder.fileName() + " (" + counts() + ")", context);
+        return;
+    }
+
+    if (msgTokens[1] == "off") {
+        if (!recorder.isRecording())
+            throw std::invalid_argument("IRCCore command record: Not recording");
+
+        recorder.stop();
+        context->notifyUser("Stopped recording traffic to " + recorder.fileName() + " (" + counts() + ")", context);
+        return;
+    }
+
+    QString errorString;
+    if (!recorder.start(msgTokens[1], &errorString))
+        throw std::runtime_error("IRCCore command record: Can't record to \"" + msgTokens[1].toStdString() + "\": " + errorString.toStdString());
+
+    context->notifyUser("Recording traffic to " + recorder.fileName(), context);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_stats()
+{
+    return {
+        "Show traffic and queue statistics of this connection",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_stats(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd) {
+        if (cmd->tokens().count() != 1)
+            throw std::invalid_argument("IRCCore command stats: Usage: /stats");
+    }
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command stats: Context can't be null");
+
+    IRCProtoClient *client = context->ircProtoClient();
+    if (client == nullptr)
+        throw std::invalid_argument("IRCCore command stats: Context's IRC protocol client can't be null");
+
+    for (const QString &line : client->stats().toDisplayLines())
+        context->notifyUser(line, context);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_lag()
+{
+    return {
+        "Show current lag and round-trip time histogram of this connection,",
+        "or set the interval (in seconds) to measure it at",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_lag(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command lag: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command lag: Context can't be null");
+
+    const QStringList &msgTokens(cmd->tokens());
+    if (!(msgTokens.length() >= 1 && msgTokens.length() <= 2))
+        throw std::invalid_argument("IRCCore command lag: Usage: /lag [INTERVAL_SECS]");
+
+    IRCProtoClient *client = context->ircProtoClient();
+    if (client == nullptr)
+        throw std::invalid_argument("IRCCore command lag: Context's IRC protocol client can't be null");
+
+    if (msgTokens.length() == 2) {
+        bool ok = false;
+        const int secs = msgTokens[1].toInt(&ok);
+        if (!ok || secs < 1)
+            throw std::invalid_argument("IRCCore command lag: Invalid interval \"" + msgTokens[1].toStdString() + "\"");
+
+        client->setLagPingInterval(secs * 1000);
+        context->notifyUser("Measuring lag every " + QString::number(secs) + " seconds.", context);
+        return;
+    }
+
+    const qint64 lagUSecs = client->lagUSecs();
+    context->notifyUser("Lag: " + (lagUSecs < 0 ? QString("unknown") : IRCProto::LagHistogram::formatUSecs(lagUSecs)) +
+                        " (measured every " + QString::number(client->lagPingInterval() / 1000) + " seconds)", context);
+    for (const QString &line : client->lagHistogram().toDisplayLines())
+        context->notifyUser(line, context);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_tls()
+{
+    return {
+        "Show TLS state of this connection, or switch certificate verification",
+        "on (verify) or off (noverify) for the next connect; connect to port +PORT for TLS",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_tls(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command tls: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command tls: Context can't be null");
+
+    const QStringList &msgTokens(cmd->tokens());
+    if (!(msgTokens.length() >= 1 && msgTokens.length() <= 2))
+        throw std::invalid_argument("IRCCore command tls: Usage: /tls [verify|noverify]");
+
+    IRCProtoClient *client = context->ircProtoClient();
+    if (client == nullptr)
+        throw std::invalid_argument("IRCCore command tls: Context's IRC protocol client can't be null");
+
+    if (msgTokens.length() == 2) {
+        if (msgTokens[1] == "verify")
+            client->setTlsVerifyPeer(true);
+        else if (msgTokens[1] == "noverify")
+            client->setTlsVerifyPeer(false);
+        else
+            throw std::invalid_argument("IRCCore command tls: Invalid argument \"" + msgTokens[1].toStdString() + "\"");
+
+        context->notifyUser("TLS certificate verification " + QString(client->tlsVerifyPeer() ? "on" : "off") +
+                            " (takes effect at the next connect).", context);
+        return;
+    }
+
+    const IRCProto::TrafficStats stats = client->stats();
+    context->notifyUser("TLS " + QString(client->isTlsRequested() ? "requested" : "not requested") +
+                        " for this connection; certificate verification " +
+                        (client->tlsVerifyPeer() ? "on" : "off") + ".", context);
+    if (stats.tls && stats.tlsHandshakeMSecs >= 0)
+        context->notifyUser("Cipher " + stats.tlsCipher + ", handshake " + QString::number(stats.tlsHandshakeMSecs) + " ms, " +
+                            (stats.tlsTicketOffered ? "session ticket offered" : "no session ticket") + ".", context);
+
+    const TlsSessionCache &cache(irc()->tlsSessionCache());
+    context->notifyUser("Session cache: " + QString::number(cache.count()) + " servers, " +
+                        QString::number(cache.hits()) + " hits, " + QString::number(cache.misses()) + " misses.", context);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_log()
+{
+    return {
+        "Show status of, start or stop the chat log; or show this context's last lines, or lines from a date on (ISO format)",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_log(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command log: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command log: Context can't be null");
+
+    const QStringList &msgTokens(cmd->tokens());
+    const char *usage = "IRCCore command log: Usage: /log [start DIR|stop|last [COUNT]|from DATE [COUNT]]";
+    if (!(msgTokens.length() >= 1 && msgTokens.length() <= 4))
+        throw std::invalid_argument(usage);
+
+    ChatLog &chatLog(irc()->chatLog());
+    auto counts = [&chatLog]() {
+        return QString::number(chatLog.writtenCount()) + " lines, " +
+               QString::number(chatLog.droppedCount()) + " dropped";
+    };
+
+    if (msgTokens.length() == 1) {
+        if (!chatLog.isLogging())
+            context->notifyUser("Not logging.", context);
+        else
+            context->notifyUser("Logging to " + chatLog.directory() + " (" + counts() + ")", context);
+        return;
+    }
+
+    const QString &subcommand(msgTokens[1]);
+    if (subcommand == "start" && msgTokens.length() == 3) {
+        QString errorString;
+        if (!chatLog.start(msgTokens[2], &errorString))
+            throw std::runtime_error("IRCCore command log: Can't log to \"" + msgTokens[2].toStdString() + "\": " + errorString.toStdString());
+
+        context->notifyUser("Logging to " + chatLog.directory(), context);
+        return;
+    }
+
+    if (subcommand == "stop" && msgTokens.length() == 2) {
+        if (!chatLog.isLogging())
+            throw std::invalid_argument("IRCCore command log: Not logging");
+
+        const QString directory = chatLog.directory();
+        chatLog.stop();
+        context->notifyUser("Stopped logging to " + directory + " (" + counts() + ")", context);
+        return;
+    }
+
+    // Reading back.
+    QList<Scrollback::Entry> entries;
+    int countIndex;
+    if (subcommand == "last" && msgTokens.length() <= 3) {
+        countIndex = 2;
+    }
+    else if (subcommand == "from" && msgTokens.length() >= 3) {
+        countIndex = 3;
+    }
+    else {
+        throw std::invalid_argument(usage);
+    }
+
+    int count = 20;
+    if (msgTokens.length() > countIndex) {
+        bool ok = false;
+        count = msgTokens[countIndex].toInt(&ok);
+        if (!ok || count <= 0)
+            throw std::invalid_argument("IRCCore command log: Invalid count \"" + msgTokens[countIndex].toStdString() + "\"");
+    }
+
+    if (!chatLog.isLogging())
+        throw std::invalid_argument("IRCCore command log: Not logging");
+
+    if (context->logPath().isEmpty())
+        throw std::invalid_argument("IRCCore command log: This context isn't logged (no server, yet)");
+
+    if (subcommand == "last") {
+        entries = chatLog.readLast(context->logPath(), count);
+    }
+    else {
+        QDateTime from = QDateTime::fromString(msgTokens[2], Qt::ISODate);
+        if (!from.isValid())
+            from = QDateTime(QDate::fromString(msgTokens[2], Qt::ISODate));
+        if (!from.isValid())
+            throw std::invalid_argument("IRCCore command log: Invalid date \"" + msgTokens[2].toStdString() + "\"");
+
+        entries = chatLog.readFrom(context->logPath(), from.toMSecsSinceEpoch(), count);
+    }
+
+    if (entries.isEmpty()) {
+        context->notifyUser("Nothing logged there.", context);
+        return;
+    }
+
+    for (const Scrollback::Entry &entry : entries)
+        context->notifyUser("[" + QDateTime::fromMSecsSinceEpoch(entry.msecs).toString("yyyy-MM-dd HH:mm:ss") + "] " +
+                            entry.toDisplayString(), context);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_search()
+{
+    return {
+        "Search the chat logs of all contexts (or, with -here, of this one) for lines containing all the words; end a word with * to match it as a prefix",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_search(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command search: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command search: Context can't be null");
+
+    QStringList words(cmd->tokens().mid(1));
+    QStringList contextPaths;
+    if (!words.isEmpty() && words.front() == "-here") {
+        words.removeFirst();
+        if (context->logPath().isEmpty())
+            throw std::invalid_argument("IRCCore command search: This context isn't logged (no server, yet)");
+        contextPaths.append(context->logPath());
+    }
+    if (words.isEmpty())
+        throw std::invalid_argument("IRCCore command search: Usage: /search [-here] WORD...");
+
+    const ChatLog &chatLog(irc()->chatLog());
+    if (!chatLog.isLogging())
+        throw std::invalid_argument("IRCCore command search: Not logging");
+
+    // (Off the event loop; the connections go on meanwhile. The watcher
+    // goes away with the context, should that go first.)
+    QElapsedTimer timer;
+    timer.start();
+    const QFuture<QList<ChatSearchHit>> future = ChatSearch::searchInBackground(chatLog, words.join(' '), contextPaths, 20);
+    auto *watcher = new QFutureWatcher<QList<ChatSearchHit>>(context);
+    QObject::connect(watcher, &QFutureWatcherBase::finished, context, [watcher, context, timer]() {
+        const QList<ChatSearchHit> hits = watcher->result();
+        watcher->deleteLater();
+
+        for (const ChatSearchHit &hit : hits)
+            context->notifyUser("[" + QDateTime::fromMSecsSinceEpoch(hit.entry.msecs).toString("yyyy-MM-dd HH:mm:ss") + "] " +
+                                ChatLog::contextDisplayName(hit.contextPath) + ": " + hit.entry.toDisplayString(), context);
+        context->notifyUser(QString::number(hits.count()) + " hits (best first), in " + QString::number(timer.elapsed()) + " ms.", context);
+    });
+    watcher->setFuture(future);
+}
+
+QStringList IRCCoreCommandGroup::cmdhelp_highlight()
+{
+    return {
+        "Show, add or remove keywords (or, with -nick, alternate nicks) that highlight a line; our current nick always does",
+    };
+}
+
+void IRCCoreCommandGroup::cmd_highlight(Command *cmd, IRCCoreContext *context)
+{
+    if (cmd == nullptr)
+        throw std::invalid_argument("IRCCore command highlight: Command object can't be null");
+
+    if (context == nullptr)
+        throw std::invalid_argument("IRCCore command highlight: Context can't be null");
+
+    QStringList args(cmd->tokens().mid(1));
+    if (args.isEmpty()) {
+        context->notifyUser("Highlighting on our nick; alternate nicks: " +
+                            (irc()->highlightNicks().isEmpty() ? QString("(none)") : irc()->highlightNicks().join(' ')) +
+                            "; keywords: " +
+                            (irc()->highlightKeywords().isEmpty() ? QString("(none)") : irc()->highlightKeywords().join(' ')), context);
+        return;
+    }
+
+    const QString subcommand = args.takeFirst();
+    const bool nicks = !args.isEmpty() && args.front() == "-nick";
+    if (nicks)
+        args.removeFirst();
+    if (!(subcommand == "add" || subcommand == "del") || args.isEmpty())
+        throw std::invalid_argument("IRCCore command highlight: Usage: /highlight [add|del [-nick] WORD...]");
+
+    QStringList list(nicks ? irc()->highlightNicks() : irc()->highlightKeywords());
+    for (const QString &word : args) {
+        if (subcommand == "add") {
+            if (!list.contains(word, Qt::CaseInsensitive))
+                list.append(word);
+        }
+        else {
+            int removed = 0;
+            for (int i = list.count() - 1; i >= 0; i--) {
+                if (list[i].compare(word, Qt::CaseInsensitive) == 0) {
+                    list.removeAt(i);
+                    removed++;
+                }
+            }
+            if (removed == 0)
+                throw std::invalid_argument("IRCCore command highlight: Not highlighting on \"" + word.toStdString() + "\"");
+        }
+    }
+
+    if (nicks)
+        irc()->setHighlightNicks(list);
+    else
+        irc()->setHighlightKeywords(list);
+    context->notifyUser(QString(nicks ? "Alternate nicks: " : "Keywords: ") +
+                        (list.isEmpty() ? QString("(none)") : list.join(' ')), context);
+}
+
 
 void IRCCoreCommandGroup::registerAllCommandDefinitions()
 {
@@ -116,5 +551,45 @@ void IRCCoreCommandGroup::registerAllCommandDefinitions()
         std::bind(&IRCCoreCommandGroup::cmdhelp_reconnect, this)
     });
 
+    registerCommandDefinition({ "charset",
+        std::bind(&IRCCoreCommandGroup::cmd_charset, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_charset, this)
+    });
+
+    registerCommandDefinition({ "record",
+        std::bind(&IRCCoreCommandGroup::cmd_record, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_record, this)
+    });
+
+    registerCommandDefinition({ "stats",
+        std::bind(&IRCCoreCommandGroup::cmd_stats, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_stats, this)
+    });
+
+    registerCommandDefinition({ "lag",
+        std::bind(&IRCCoreCommandGroup::cmd_lag, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_lag, this)
+    });
+
+    registerCommandDefinition({ "tls",
+        std::bind(&IRCCoreCommandGroup::cmd_tls, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_tls, this)
+    });
+
+    registerCommandDefinition({ "log",
+        std::bind(&IRCCoreCommandGroup::cmd_log, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_log, this)
+    });
+
+    registerCommandDefinition({ "search",
+        std::bind(&IRCCoreCommandGroup::cmd_search, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_search, this)
+    });
+
+    registerCommandDefinition({ "highlight",
+        std::bind(&IRCCoreCommandGroup::cmd_highlight, this, _1, _2),
+        std::bind(&IRCCoreCommandGroup::cmdhelp_highlight, this)
+    });
+
     _registeredOnce = true;
 }
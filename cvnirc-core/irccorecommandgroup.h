@@ -28,6 +28,30 @@ public:
     QStringList cmdhelp_reconnect();
     void cmd_reconnect(Command *cmd, IRCCoreContext *context);
 
+    QStringList cmdhelp_charset();
+    void cmd_charset(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_record();
+    void cmd_record(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_stats();
+    void cmd_stats(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_lag();
+    void cmd_lag(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_tls();
+    void cmd_tls(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_log();
+    void cmd_log(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_search();
+    void cmd_search(Command *cmd, IRCCoreContext *context);
+
+    QStringList cmdhelp_highlight();
+    void cmd_highlight(Command *cmd, IRCCoreContext *context);
+
     void registerAllCommandDefinitions() override;
 };
 
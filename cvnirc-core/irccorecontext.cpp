@@ -1,11 +1,26 @@
 #include "irccorecontext.h"
 
 #include "irccore.h"
+#include <QDateTime>
 #include <stdexcept>
+#include <string.h>
+
+static Scrollback makeScrollback(QObject *parent)
+{
+    // (Share the core's sender interner, and go by its size setting.)
+    auto *irc = dynamic_cast<IRCCore *>(parent);
+    if (irc == nullptr)
+        return Scrollback();
+
+    const int maxLines = irc->scrollbackMaxLines();
+    const qint64 arenaBytes = qint64(maxLines) * Scrollback::averageLineBytes;
+    return Scrollback(irc->senderInterner(), maxLines, int(qMin<qint64>(arenaBytes, Scrollback::maxArenaBytes)));
+}
 
 
 IRCCoreContext::IRCCoreContext(IRCProtoClient *ircProtoClient, IRCCoreContext::Type type, const QString &outgoingTarget, QObject *parent) :
-    QObject(parent), _ircProtoClient(ircProtoClient), _type(type), _outgoingTarget(outgoingTarget)
+    QObject(parent), _ircProtoClient(ircProtoClient), _type(type), _outgoingTarget(outgoingTarget),
+    _outgoingTargetBytes(outgoingTarget.toUtf8()), _scrollback(makeScrollback(parent))
 {
     if (_ircProtoClient == nullptr)
         throw std::invalid_argument("IRCCoreContext ctor: IRC protocol client can't be null");
@@ -18,6 +33,9 @@ IRCCoreContext::IRCCoreContext(IRCProtoClient *ircProtoClient, IRCCoreContext::T
     }
 
     connect(ircProtoClient, &IRCProtoClient::receivedMessage, this, &IRCCoreContext::receiveIRCProtoMessage);
+
+    // The server name is part of the disambiguator.
+    connect(ircProtoClient, &IRCProtoClient::hostPortRequestedLastChanged, this, &IRCCoreContext::invalidateDisambiguator);
 }
 
 bool IRCCoreContext::operator ==(const IRCCoreContext &other)
@@ -52,7 +70,65 @@ const QString &IRCCoreContext::outgoingTarget() const
     return _outgoingTarget;
 }
 
-QString IRCCoreContext::disambiguator() const
+const QString &IRCCoreContext::disambiguator() const
+{
+    // This gets asked for on every output line, so keep it around.
+    // (See invalidateDisambiguator() for when it needs to be recomputed.)
+    if (!_disambiguatorValid) {
+        _disambiguator = _computeDisambiguator();
+        _disambiguatorValid = true;
+    }
+
+    return _disambiguator;
+}
+
+Scrollback &IRCCoreContext::scrollback()
+{
+    return _scrollback;
+}
+
+const Scrollback &IRCCoreContext::scrollback() const
+{
+    return _scrollback;
+}
+
+const QString &IRCCoreContext::logPath() const
+{
+    // While (re)connecting, hostRequestedLast() is empty for a moment;
+    // it's the host about to be connected to, then. (Neither known:
+    // Empty, not to be logged; rather than one log shared by all.)
+    const IRCProtoClient &client(*_ircProtoClient);
+    const QString &host(client.hostRequestedLast().isEmpty() ? client.hostRequestNext() : client.hostRequestedLast());
+    if (host.isEmpty()) {
+        _logPath.clear();
+        return _logPath;
+    }
+
+    if (_logPath.isEmpty() || host != _logPathHost) {
+        _logPath = ChatLog::contextPath(host, _type == Type::Server ? QString() : _outgoingTarget);
+        _logPathHost = host;
+    }
+
+    return _logPath;
+}
+
+void IRCCoreContext::invalidateDisambiguator()
+{
+    // (Also depends on the server name.)
+    _logPath.clear();
+
+    if (!_disambiguatorValid)
+        return;
+
+    const QString newDisambiguator = _computeDisambiguator();
+    if (newDisambiguator == _disambiguator)
+        return;
+
+    _disambiguator = newDisambiguator;
+    disambiguatorChanged(this);
+}
+
+QString IRCCoreContext::_computeDisambiguator() const
 {
     auto *irc = dynamic_cast<IRCCore *>(parent());
     bool needConnectionDisambiguation;
@@ -126,48 +202,47 @@ void IRCCoreContext::receiveIRCProtoMessage(IRCProto::Incoming *in)
     if (!commandArg)
         throw std::invalid_argument("IRC core context, receive IRC proto message: Incoming message first argument is not a command name argument");
 
-    if (commandArg->commandUpper == "JOIN") {
+    if (commandArg->commandUpper() == "JOIN") {
         int argCount = msg->args.length();
         if (!(argCount >= 2 && argCount <= 3))
             throw std::runtime_error("IRC core context, receive IRC proto message: Invalid argument count after processing (" + std::to_string(argCount) + ")");
 
-        auto channelsArg = std::dynamic_pointer_cast<IRCProto::ListMessageArg<IRCProto::ChannelTargetMessageArg>>(msg->args[1]);
+        auto channelsArg = std::dynamic_pointer_cast<IRCProto::CommaListMessageArg<IRCProto::ChannelTargetMessageArg>>(msg->args[1]);
         if (!channelsArg)
             throw std::runtime_error("IRC core context, receive IRC proto message: Invalid argument type at index 1");  // TODO: Give type information if possible.
 
-        for (std::shared_ptr<IRCProto::ChannelTargetMessageArg> channelArg : channelsArg->list) {
-            const QString channel = channelArg->channel;
-
+        // (Go over the channel names in-place; no need for per-channel objects.)
+        channelsArg->forEachSlice([&](const char *data, int len) {
             if (_type == Type::Server) {
                 if (core == nullptr)
                     throw std::runtime_error("IRCCoreContext: A Server context needs to know its parent!");
 
                 bool created = false;
-                auto *context = core->createOrGetContext(_ircProtoClient, Type::Channel, channel, &created);
+                auto *context = core->createOrGetContext(_ircProtoClient, Type::Channel, _decodeSlice(data, len), &created);
                 if (context == nullptr)
                     throw std::runtime_error("IRCCoreContext: Create-or-get other context failed");
 
                 if (created)
                     context->receiveIRCProtoMessage(in);
             }
-            else if (_type == Type::Channel && channel == _outgoingTarget) {
-                notifyUser("Joined channel " + channel +
-                           (!msg->origin.prefix.isEmpty() ? ": " + msg->origin.prefix : ""),
-                           this);
+            else if (_type == Type::Channel && _isOutgoingTarget(data, len)) {
+                _log(Scrollback::Kind::Join, msg->origin.nick().toString(),
+                     "Joined channel " + _outgoingTarget +
+                     (!msg->origin.prefix.isEmpty() ? ": " + msg->origin.prefix.toString() : ""));
             }
-        }
+        });
 
         // TODO: Only mark as handled if all channels have been handled somewhere...
         // (This may have been on another channel context than (if it is one) this one.)
         in->handled = true;
     }
-    else if (commandArg->commandUpper == "PRIVMSG" ||
-             commandArg->commandUpper == "NOTICE") {
+    else if (commandArg->commandUpper() == "PRIVMSG" ||
+             commandArg->commandUpper() == "NOTICE") {
         int argCount = msg->args.length();
         if (argCount != 3)
             throw std::runtime_error("IRC core context, receive IRC proto message: Invalid argument count after processing (" + std::to_string(argCount) + ")");
 
-        auto targetsArg = std::dynamic_pointer_cast<IRCProto::ListMessageArg<IRCProto::TargetMessageArg>>(msg->args[1]);
+        auto targetsArg = std::dynamic_pointer_cast<IRCProto::CommaListMessageArg<IRCProto::TargetMessageArg>>(msg->args[1]);
         if (!targetsArg)
             throw std::runtime_error("IRC core context, receive IRC proto message: Invalid argument type at index 1");  // TODO: Give type information if possible.
 
@@ -175,23 +250,19 @@ void IRCCoreContext::receiveIRCProtoMessage(IRCProto::Incoming *in)
         if (!chatterDataArg)
             throw std::runtime_error("IRC core context, receive IRC proto message: Invalid argument type at index 2");
 
-        bool isNotice = commandArg->commandUpper == "NOTICE";
+        bool isNotice = commandArg->commandUpper() == "NOTICE";
         QString senderNick = msg->origin.type == IRCProto::MessageOrigin::Type::LinkServer ?
             "LinkServer" :  // TODO: Make sure this does not collide with a valid nick name!
-            IRCProtoClient::nickUserHost2nick(msg->origin.prefix);
-
-        for (std::shared_ptr<IRCProto::TargetMessageArg> targetArg : targetsArg->list) {
-            if (!targetArg)
-                throw std::runtime_error("IRC core context, receive IRC proto message: At least one target was null");
-
-            auto channelTargetArg = std::dynamic_pointer_cast<IRCProto::ChannelTargetMessageArg>(targetArg);
-            auto nickTargetArg = std::dynamic_pointer_cast<IRCProto::NickTargetMessageArg>(targetArg);
-            bool isChannel = channelTargetArg != nullptr;
+            msg->origin.nick().toString();
 
+        // (Go over the targets in-place; no need for per-target objects.)
+        targetsArg->forEachSlice([&](const char *data, int len) {
+            bool isChannel = _ircProtoClient->isChannel(data, len);
             Type contextType = isChannel ? Type::Channel : Type::Query;
-            QString returnPath = isChannel ? channelTargetArg->channel : senderNick;
 
             if (_type == Type::Server) {
+                QString returnPath = isChannel ? _decodeSlice(data, len) : senderNick;
+
                 bool created = false;
                 auto *context = core->createOrGetContext(_ircProtoClient, contextType, returnPath, &created);
                 if (context == nullptr)
@@ -200,16 +271,20 @@ void IRCCoreContext::receiveIRCProtoMessage(IRCProto::Incoming *in)
                 if (created)
                     context->receiveIRCProtoMessage(in);
 
-                continue;
+                return;
             }
 
-            if (_type != contextType || returnPath != _outgoingTarget)
-                continue;
+            if (_type != contextType)
+                return;
+
+            if (isChannel ? !_isOutgoingTarget(data, len) : senderNick != _outgoingTarget)
+                return;
 
-            QString sourceTyped = (isNotice ? "-" : "<") + senderNick + (isNotice ? "-" : ">");
+            // (Decode only now, and respect a per-target encoding override.)
+            const QString chatterData = chatterDataArg->chatterData.toString(_ircProtoClient->textDecoderForTarget(_outgoingTarget));
 
-            notifyUser(sourceTyped + " " + chatterDataArg->chatterData, this);
-        }
+            _log(isNotice ? Scrollback::Kind::Notice : Scrollback::Kind::Message, senderNick, chatterData);
+        });
 
         // TODO: Only mark as handled if all channels have been handled somewhere
         in->handled = true;
@@ -219,16 +294,56 @@ void IRCCoreContext::receiveIRCProtoMessage(IRCProto::Incoming *in)
 void IRCCoreContext::sendChatMessage(const QString &line)
 {
     if (_outgoingTarget.isEmpty()) {
-        notifyUser("Error: This context does not have an outgoing target. Can't send a chat message here!", this);
+        _log(Scrollback::Kind::Info, QString(), "Error: This context does not have an outgoing target. Can't send a chat message here!");
         return;
     }
 
     // TODO: Use nick *taken* last, when we have support to track this.
     //
-    notifyUser("<" + _ircProtoClient->nickRequestedLast() + "> " + line, this);
+    _log(Scrollback::Kind::OwnMessage, _ircProtoClient->nickRequestedLast(), line);
     _ircProtoClient->sendRaw("PRIVMSG " + _outgoingTarget + " :" + line);
 }
 
+void IRCCoreContext::_log(Scrollback::Kind kind, const QString &sender, const QString &text)
+{
+    Scrollback::Entry entry;
+    entry.msecs = QDateTime::currentMSecsSinceEpoch();
+    entry.seq = _scrollback.append(entry.msecs, kind, sender, text);
+    entry.kind = kind;
+    entry.sender = sender;
+    entry.text = text;
+
+    auto *core = dynamic_cast<IRCCore *>(parent());
+    if (core != nullptr && core->chatLog().isLogging() && !logPath().isEmpty())
+        core->chatLog().append(logPath(), entry);
+
+    const QString line = entry.toDisplayString();
+    notifyUser(line, this);
+
+    // (Chatter of others only; one pass over the line, whatever the number of patterns.)
+    if ((kind == Scrollback::Kind::Message || kind == Scrollback::Kind::Notice) &&
+        core != nullptr && core->isHighlight(_ircProtoClient, text))
+    {
+        highlighted(line, this);
+    }
+}
+
+QString IRCCoreContext::_decodeSlice(const char *data, int len) const
+{
+    return _ircProtoClient->textDecoder()->decode(QByteArray(data, len));
+}
+
+bool IRCCoreContext::_isOutgoingTarget(const char *data, int len) const
+{
+    // Fast path: Compare bytes without decoding, for the common all-ASCII case.
+    // (A non-ASCII target won't compare equal to ASCII bytes, as it should.)
+    if (IRCProto::TextDecoder::asciiPrefixLength(data, len) == len)
+        return _outgoingTargetBytes.length() == len &&
+               memcmp(_outgoingTargetBytes.constData(), data, len) == 0;
+
+    return _decodeSlice(data, len) == _outgoingTarget;
+}
+
 void IRCCoreContext::handle_connectionStateChanged()
 {
     connectionStateChanged(this);
@@ -236,7 +351,7 @@ void IRCCoreContext::handle_connectionStateChanged()
 
 void IRCCoreContext::handle_notifyUser(const QString &line)
 {
-    notifyUser(line, this);
+    _log(Scrollback::Kind::Info, QString(), line);
 }
 
 void IRCCoreContext::handle_sendingLine(const QString &rawLine)
@@ -244,7 +359,7 @@ void IRCCoreContext::handle_sendingLine(const QString &rawLine)
     sendingLine(rawLine, this);
 }
 
-void IRCCoreContext::handle_receivedLine(const QString &rawLine)
+void IRCCoreContext::handle_receivedLine(const QByteArray &rawLine)
 {
     receivedLine(rawLine, this);
 }
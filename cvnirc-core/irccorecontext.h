@@ -5,6 +5,7 @@
 
 #include <QObject>
 #include "ircprotoclient.h"
+#include "scrollback.h"
 
 class CVNIRCCORESHARED_EXPORT IRCCoreContext : public QObject
 {
@@ -24,6 +25,15 @@ public:
 private:
     Type _type;
     QString _outgoingTarget;
+    QByteArray _outgoingTargetBytes;  // (For comparing against the network without decoding.)
+
+    mutable QString _disambiguator;
+    mutable bool _disambiguatorValid = false;
+
+    mutable QString _logPath;  // (Empty: Not computed, yet.)
+    mutable QString _logPathHost;  // (What it got computed for.)
+
+    Scrollback _scrollback;
 
 public:
     explicit IRCCoreContext(IRCProtoClient *ircProtoClient, Type type, const QString &outgoingTarget, QObject *parent = 0);
@@ -35,7 +45,13 @@ public:
     Type type() const;
     const QString &outgoingTarget() const;
 
-    QString disambiguator() const;
+    const QString &disambiguator() const;
+
+    // What got shown in this context, for replaying it to new views.
+    Scrollback &scrollback();
+    const Scrollback &scrollback() const;
+    // Where the core's chat log keeps this context (see ChatLog::contextPath()).
+    const QString &logPath() const;
 
     void requestFocus();
 
@@ -43,19 +59,29 @@ signals:
     void connectionStateChanged(IRCCoreContext *context = nullptr);
     void notifyUser(const QString &line, IRCCoreContext *context = nullptr);
     void sendingLine(const QString &rawLine, IRCCoreContext *context = nullptr);
-    void receivedLine(const QString &rawLine, IRCCoreContext *context = nullptr);
+    void receivedLine(const QByteArray &rawLine, IRCCoreContext *context = nullptr);
 
     void focusWanted(IRCCoreContext *context = nullptr);
+    void disambiguatorChanged(IRCCoreContext *context = nullptr);
+    // Someone said our nick, or one of the highlight keywords. (Comes after notifyUser() for the line.)
+    void highlighted(const QString &line, IRCCoreContext *context = nullptr);
 
 public slots:
     void receiveIRCProtoMessage(IRCProto::Incoming *in);
     void sendChatMessage(const QString &line);
+    void invalidateDisambiguator();
 
 private slots:
     void handle_connectionStateChanged();
     void handle_notifyUser(const QString &line);
     void handle_sendingLine(const QString &rawLine);
-    void handle_receivedLine(const QString &rawLine);
+    void handle_receivedLine(const QByteArray &rawLine);
+
+private:
+    void _log(Scrollback::Kind kind, const QString &sender, const QString &text);
+    QString _computeDisambiguator() const;
+    QString _decodeSlice(const char *data, int len) const;
+    bool _isOutgoingTarget(const char *data, int len) const;
 };
 
 #endif // IRCCORECONTEXT_H
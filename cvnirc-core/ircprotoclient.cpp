@@ -1,7 +1,11 @@
 #include "ircprotoclient.h"
 
 #include <QMetaEnum>
+#include <QTextCodec>
 #include <QtNetwork>
+#include <stdexcept>
+#include <climits>
+#include <cmath>
 
 using namespace cvnirc::core::IRCProto;
 
@@ -10,31 +14,112 @@ IRCProtoClient::IRCProtoClient(QObject *parent) : QObject(parent),
     socketReadBuf(10*1024, '\0'),
     _connectionState(ConnectionState::Disconnected)
 {
-    // Exclude normal printable characters from escaping in rawLine signal arguments.
+    // Exclude normal printable characters from escaping in rawLineToDisplay().
+    QByteArray whitelist;
     for (unsigned char c = 0; c < 128; c++) {
         if (QChar(c).isPrint())
-            _rawLineWhitelist.append(c);
+            whitelist.append(c);
     }
+    setRawLineWhitelist(whitelist);
+
+    _textDecoder = std::make_shared<const TextDecoder>();
+    _statsClock.start();
+    _random.seed(std::random_device()());
 
     _loadMsgArgTypes();
     _loadMsgTypeVocabIn();
 
     // Set up signals & slots.
+    _wireSocket();
+}
+
+IRCProtoClient::~IRCProtoClient()
+{
+    // (Don't leave callbacks into a dead object behind.)
+    _stopTimer(&_lagPingTimer);
+    _stopTimer(&_watchdogTimer);
+    _stopTimer(&_connectStaggerTimer);
+    _cancelReconnect();
+}
+
+typedef void (QAbstractSocket::*error_signal_type)(QAbstractSocket::SocketError);
+
+QTcpSocket *IRCProtoClient::_createSocket()
+{
+    if (!_connectTls)
+        return new QTcpSocket(this);
+
+    auto *sslSocket = new QSslSocket(this);
+    QSslConfiguration config = sslSocket->sslConfiguration();
+    // (Otherwise, Qt doesn't hand out the session for resuming it later.)
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    if (!_tlsTicketOffered.isNull())
+        config.setSessionTicket(_tlsTicketOffered);
+    sslSocket->setSslConfiguration(config);
+
+    // (When racing addresses, the socket only sees an IP address.)
+    sslSocket->setPeerVerifyName(_connectHost);
+    if (!_tlsVerifyPeer)
+        sslSocket->setPeerVerifyMode(QSslSocket::QueryPeer);
+
+    return sslSocket;
+}
+
+void IRCProtoClient::_wireSocket()
+{
     connect(socket, &QAbstractSocket::connected,
             this, &IRCProtoClient::handle_socket_connected);
-    typedef void (QAbstractSocket::*error_signal_type)(QAbstractSocket::SocketError);
     connect(socket, static_cast<error_signal_type>(&QAbstractSocket::error),
             this, &IRCProtoClient::handle_socket_error);
     connect(socket, &QIODevice::readyRead, this, &IRCProtoClient::processIncomingData);
+
+    auto *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket == nullptr)
+        return;
+
+    connect(sslSocket, &QSslSocket::encrypted, this, &IRCProtoClient::handle_socket_encrypted);
+    typedef void (QSslSocket::*sslErrors_signal_type)(const QList<QSslError> &);
+    connect(sslSocket, static_cast<sslErrors_signal_type>(&QSslSocket::sslErrors),
+            this, &IRCProtoClient::handle_socket_sslErrors);
+#ifdef CVN_HAVE_QSSLSOCKET_NEWSESSIONTICKETRECEIVED
+    // (TLS 1.3 hands out tickets only after the handshake.)
+    connect(sslSocket, &QSslSocket::newSessionTicketReceived,
+            this, &IRCProtoClient::handle_socket_newSessionTicketReceived);
+#endif
+}
+
+void IRCProtoClient::_adoptSocket(QTcpSocket *newSocket)
+{
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    // (Drop the wiring it had as a connection attempt.)
+    newSocket->disconnect(this);
+    socket = newSocket;
+    _wireSocket();
+
+    // (The server may have been quick; readyRead won't come again for that.)
+    if (socket->bytesAvailable() > 0)
+        QMetaObject::invokeMethod(this, "processIncomingData", Qt::QueuedConnection);
 }
 
 void IRCProtoClient::disconnectFromIRCServer(const QString &quitMsg)
 {
     if (connectionState() == ConnectionState::Disconnected) {
+        if (isReconnectPending()) {
+            _cancelReconnect();
+            notifyUser("Cancelled automatic reconnect.");
+            return;
+        }
+
         notifyUser("Already disconnected.");
         return;
     }
 
+    // (The user wants this connection gone; don't bring it back.)
+    _cancelReconnect();
+
     if (connectionState() >= ConnectionState::Registering) {
         if (quitMsg.isNull()) {
             notifyUser("Sending quit request to server...");
@@ -49,8 +134,10 @@ void IRCProtoClient::disconnectFromIRCServer(const QString &quitMsg)
     // Make sure nothing stays queued from the old connection,
     // or it would probably be misdirected to a new connection...
     sendQueue.clear();
+    _sendQueueBytes = 0;
 
     notifyUser("Aborting connection...");
+    _abortConnectAttempts();
     socket->abort();
     _setConnectionState(ConnectionState::Disconnected);
 }
@@ -74,6 +161,10 @@ void IRCProtoClient::connectToIRCServer(const QString &host, const QString &port
     _userRequestNext = user;
     _nickRequestNext = nick;
 
+    // (A different server might not even have the same channels.)
+    _joinedChannels.clear();
+    _reconnectAttempts = 0;
+
     reconnectToIRCServer();
 }
 
@@ -82,14 +173,24 @@ void IRCProtoClient::reconnectToIRCServer()
     if (connectionState() != ConnectionState::Disconnected)
         disconnectFromIRCServer();
 
+    _cancelReconnect();
+    _quitSent = false;
+
     QString host = _hostRequestNext, port = _portRequestNext;
+    // "+PORT" means TLS, as in other IRC clients.
+    _connectTls = port.startsWith('+');
+    if (_connectTls && !QSslSocket::supportsSsl()) {
+        notifyUser("Can't connect to " + host + ":" + port + ": TLS is not available (no SSL library found).");
+        return;
+    }
+
     // Clear these to avoid suggesting wrong destination
     // to signal connectionStateChanged handlers.
     _hostRequestedLast.clear();
     _portRequestedLast.clear();
-    notifyUser("(Re)Connecting to " + host + ":" + port);
+    notifyUser("(Re)Connecting to " + host + ":" + port + (_connectTls ? " (TLS)" : ""));
     _setConnectionState(ConnectionState::Connecting);
-    socket->connectToHost(host, port.toShort());
+    _startConnect(host, (_connectTls ? port.mid(1) : port).toUShort());
     // Now that we are actually connecting to there,
     // update these again and emit signal about it.
     _hostRequestedLast = host;
@@ -99,8 +200,86 @@ void IRCProtoClient::reconnectToIRCServer()
 
 void IRCProtoClient::handle_socket_connected()
 {
+    _stats.connectMSecs = _statsClock.elapsed() - _connectStartMSecs;
+
+    auto *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket != nullptr) {
+        if (_verboseLevel >= 1)
+            notifyUser("Connected, starting TLS handshake" +
+                       QString(_tlsTicketOffered.isNull() ? "" : " (offering to resume the last session)") + "...");
+
+        // (The watchdog guards the handshake, too.)
+        _tlsHandshakeStartMSecs = _statsClock.elapsed();
+        _armWatchdog(_watchdogTimeouts.pingTimeoutMSecs);
+        sslSocket->startClientEncryption();
+        return;
+    }
+
+    _startRegistration();
+}
+
+void IRCProtoClient::handle_socket_encrypted()
+{
+    auto *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket == nullptr || _tlsHandshakeStartMSecs < 0)
+        return;
+
+    _stats.tlsHandshakeMSecs = _statsClock.elapsed() - _tlsHandshakeStartMSecs;
+    _tlsHandshakeStartMSecs = -1;
+    _stats.tlsCipher = sslSocket->sessionCipher().name();
+
+    // (Qt doesn't tell whether the server took up the offer; comparing
+    // tickets doesn't either, as servers may or may not issue a new one
+    // either way. So all we count is what we offered.)
+    _stats.tlsTicketOffered = !_tlsTicketOffered.isNull();
+    _stats.tlsHandshakes++;
+    if (_stats.tlsTicketOffered)
+        _stats.tlsTicketsOffered++;
+
+    notifyUser("TLS established (" + _stats.tlsCipher + ", " +
+               (_stats.tlsTicketOffered ? "session ticket offered" : "no session ticket") + ", " +
+               QString::number(_stats.tlsHandshakeMSecs) + " ms).");
+
+    _storeTlsSession();
+    _startRegistration();
+}
+
+void IRCProtoClient::handle_socket_sslErrors(const QList<QSslError> &errors)
+{
+    for (const QSslError &error : errors)
+        notifyUser("TLS error: " + error.errorString());
+
+    // (Unless ignored, the handshake fails right after this.)
+    if (_tlsVerifyPeer)
+        notifyUser("If you trust this server anyway, switch off certificate verification (/tls noverify) and reconnect.");
+}
+
+void IRCProtoClient::handle_socket_newSessionTicketReceived()
+{
+    _storeTlsSession();
+}
+
+void IRCProtoClient::_storeTlsSession()
+{
+    auto *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket == nullptr || !_tlsSessionCache)
+        return;
+
+    const QByteArray ticket = sslSocket->sslConfiguration().sessionTicket();
+    if (!ticket.isEmpty())
+        _tlsSessionCache->store(_connectHost, _connectPort, ticket);
+}
+
+void IRCProtoClient::_startRegistration()
+{
+    // (Don't let leftovers of an earlier connection confuse this one.)
+    _lineFramer.clear();
     _setConnectionState(ConnectionState::Registering);
 
+    _lastReceivedMSecs = _statsClock.elapsed();
+    _partialLineSinceMSecs = -1;
+    _armWatchdog(_watchdogTimeouts.idleMSecs);
+
     QString user = _userRequestNext;
     notifyUser("Registering as user " + user + "...");
     // "USER" USERNAME HOSTNAME SERVERNAME REALNAME
@@ -118,19 +297,32 @@ void IRCProtoClient::handle_socket_connected()
 
 void IRCProtoClient::handle_socket_error(QAbstractSocket::SocketError err)
 {
-    notifyUser(QString("Socket error ") +
+    const QString msg = QString("Socket error ") +
 #ifdef CVN_HAVE_Q_ENUM
-               QMetaEnum::fromType<QAbstractSocket::SocketError>().valueToKey(err) +
+                        QMetaEnum::fromType<QAbstractSocket::SocketError>().valueToKey(err) +
 #else
-               QString::number(err) +
+                        QString::number(err) +
 #endif
-               ": " + socket->errorString());
-    _setConnectionState(ConnectionState::Disconnected);
+                        ": " + socket->errorString();
+
+    // (Late news about a connection we've already given up on.)
+    if (connectionState() == ConnectionState::Disconnected) {
+        notifyUser(msg);
+        return;
+    }
+
+    _connectionLost(msg);
 }
 
 void IRCProtoClient::sendRaw(const QString &line)
 {
-    sendQueue.push_back(line);
+    // (Having asked to leave, a server closing the connection is no reason to come back.)
+    if (line.startsWith("QUIT", Qt::CaseInsensitive) && (line.length() == 4 || line[4] == ' '))
+        _quitSent = true;
+
+    const QByteArray bytes = (line + "\r\n").toUtf8();
+    _sendQueueBytes += bytes.length();
+    sendQueue.push_back({ line, bytes });
     processOutgoingData();
 }
 
@@ -147,10 +339,20 @@ void IRCProtoClient::processOutgoingData()
            socket->state() == QAbstractSocket::ConnectedState &&
            socket->bytesToWrite() < 512)
     {
-        QString rawLine = sendQueue.front();
-        sendingLine(rawLine);
-        socket->write((rawLine + "\r\n").toUtf8());
+        // (Take it off the queue first; handlers of sendingLine() might modify the queue.)
+        const QueuedLine queued = sendQueue.front();
         sendQueue.pop_front();
+        _sendQueueBytes -= queued.bytes.length();
+
+        sendingLine(queued.line);
+        _trafficRecorder.record(TrafficRecord::Direction::Sent, queued.bytes);
+        socket->write(queued.bytes);
+
+        const qint64 nowMSecs = _statsClock.elapsed();
+        _stats.linesSent++;
+        _stats.bytesSent += queued.bytes.length();
+        _linesSentRate.add(1, nowMSecs);
+        _bytesSentRate.add(queued.bytes.length(), nowMSecs);
     }
 }
 
@@ -158,91 +360,60 @@ void IRCProtoClient::processIncomingData()
 {
     processOutgoingData();
 
-    // Grow and read into socketReadBuf.
     qint64 ret = 0;
-    while (socketReadBuf.resize(socketReadBufUsed + 10*1024),
-           (ret = socket->read(socketReadBuf.data() + socketReadBufUsed,
-                               socketReadBuf.size() - socketReadBufUsed)
-            ) > 0) {
-        socketReadBufUsed += ret;
-
-        // Look for completely received lines.
-        int iCrLf;
-        while ((iCrLf = socketReadBuf.indexOf("\r\n")) >= 0) {
-            int len = iCrLf + 2;
-            QByteArray rawLineBytesCrLf = socketReadBuf.left(len);  // Extract line.
-            socketReadBuf.remove(0, len);  // Remove line from buffer.
-            socketReadBufUsed -= len;
-            if (socketReadBufUsed < 0) {
-                socketReadBufUsed = 0;
-                notifyUser("Internal error: Socket buffer used had become negative; "
-                           "corrected, but this should not happen!");
-                return;
-            }
-
-            if (rawLineBytesCrLf.contains('\0')) {
-                notifyUser("Protocol error: Server sent a NUL byte "
-                           "(detected in extracted line): Aborting connection.");
-                socket->abort();
-                return;
-            }
-
-            // TODO: Move this over to parse(), somehow. (?)
-            // N.B.: From the change 2017-12-01 on, rawLineBytes won't be used here anymore after the check!
-            QByteArray rawLineBytes(rawLineBytesCrLf);
-            rawLineBytes.chop(2);  // Strip CR/LF.
-            if (rawLineBytes.contains('\r') || rawLineBytes.contains('\n')) {
-                notifyUser("Protocol error: Server seems to have broken line-termination! "
-                           "(Stray CR or LF found in extracted line.) Aborting connection.");
-                socket->abort();
-                return;
-            }
-
-            // Interpret message.
-            MessageOnNetwork raw { rawLineBytesCrLf };
+    while ((ret = socket->read(socketReadBuf.data(), socketReadBuf.size())) > 0) {
+        _lineFramer.append(socketReadBuf.constData(), int(ret));
+
+        // Interpret completely received lines.
+        MessageOnNetwork raw;
+        quint64 lines = 0;
+        while (_lineFramer.takeLine(&raw)) {
+            lines++;
+            _trafficRecorder.record(TrafficRecord::Direction::Received, raw.bytes);
             receivedRaw(raw);
         }
 
-        if (socketReadBufUsed == 0)
-            // Skip additional sanity checks, as no buffered data is left.
-            continue;  // Continue with next read attempt.
-
-        // Still no complete line after 1 MiB?
-        if (socketReadBufUsed >= 1*1024*1024) {
-            notifyUser("Protocol error: Server sends data which either is "
-                       "an extremely large line, or garbage: Aborting connection.");
-            socket->abort();
+        // (Count per read, not per line.)
+        const qint64 nowMSecs = _statsClock.elapsed();
+        _stats.bytesReceived += quint64(ret);
+        _stats.linesReceived += lines;
+        _bytesReceivedRate.add(quint64(ret), nowMSecs);
+        _linesReceivedRate.add(lines, nowMSecs);
+
+        if (_lineFramer.error() != LineFramer::Error::None)
+            _stats.framingErrors++;
+
+        // (For the watchdog.)
+        _lastReceivedMSecs = nowMSecs;
+        if (_lineFramer.bufferedLength() == 0)
+            _partialLineSinceMSecs = -1;
+        else if (lines > 0 || _partialLineSinceMSecs < 0)
+            _partialLineSinceMSecs = nowMSecs;
+
+        switch (_lineFramer.error()) {
+        case LineFramer::Error::None:
+            break;
+        case LineFramer::Error::NulByte:
+            _connectionLost("Protocol error: Server sent a NUL byte: Aborting connection.");
             return;
-        }
-
-        // TODO: Test for: Still buffer contents with no complete line after (some minutes)?
-
-        const QByteArray leftover(socketReadBuf.left(socketReadBufUsed));
-
-        if (leftover.contains('\0')) {
-            notifyUser("Protocol error: Server sent a NUL byte "
-                       "(detected after extracting all lines from buffer): Aborting connection.");
-            socket->abort();
+        case LineFramer::Error::BrokenLineTermination:
+            // (A stray '\r' could actually happen when the CR/LF message framing
+            // line terminator is split between two reads; but the framer only
+            // looks at complete lines. The perhaps more commonly to be expected
+            // case might be a server that sends LF only, which this will then
+            // lead to connection abort.)
+            _connectionLost("Protocol error: Server seems to have broken line-termination! "
+                            "(Stray CR or LF found in extracted line.) Aborting connection.");
             return;
-        }
-
-        // (A stray '\r' could actually happen when the CR/LF message framing
-        // line terminator is split between two reads. But who uses CR alone
-        // as line terminator nowadays, anyhow. The perhaps more commonly
-        // to be expected case might be a server that sends LF only, which this
-        // will then lead to connection abort.)
-        //
-        if (/* leftover.contains('\r') || */ leftover.contains('\n')) {
-            notifyUser("Protocol error: Server seems to have broken line-termination! "
-                       "(Stray LF found after extracting all lines from buffer.) Aborting connection.");
-            socket->abort();
+        case LineFramer::Error::LineTooLong:
+            _connectionLost("Protocol error: Server sends data which either is "
+                            "an extremely large line, or garbage: Aborting connection.");
             return;
         }
     }
 
     if (ret < 0) {
-        notifyUser("Error reading from network socket, aborting connection.");
-        socket->abort();
+        _connectionLost("Error reading from network socket, aborting connection.");
         return;
     }
 }
@@ -253,52 +424,63 @@ void IRCProtoClient::receivedRaw(const MessageOnNetwork &raw)
         std::make_shared<MessageOnNetwork>(raw),
         std::make_shared<MessageAsTokens>(raw.parse())
     );
-    receivedLine(raw.bytes.toPercentEncoding(_rawLineWhitelist));
+    if (_rawLineObservers > 0)
+        receivedLine(raw.bytes);
+
+    if (typeIncoming(&in))
+        dispatchIncoming(&in);
+}
+
+bool IRCProtoClient::typeIncoming(Incoming *in)
+{
+    if (in == nullptr || !in->inTokens)
+        throw std::invalid_argument("IRC protocol client, typeIncoming(): Incoming tokens can't be null");
 
-    const QByteArray     &prefix(in.inTokens->prefix);
-    const QByteArrayList &tokens(in.inTokens->mainTokens);
+    const QByteArray     &prefix(in->inTokens->prefix);
+    const QByteArrayList &tokens(in->inTokens->mainTokens);
 
     // Ignore empty lines silently.
     if (prefix.isNull() && tokens.isEmpty())
-        return;
+        return false;
 
     if (!(tokens.size() >= 1)) {
         notifyUser("Protocol error, disconnecting: Received line with a prefix token only!");
         disconnectFromIRCServer("Protocol error");
-        return;
+        return false;
     }
 
-    const QString command = tokens[0];
-
-    in.inMessageType = _msgTypeVocabIn.messageType(command);
-    if (!in.inMessageType) {
-        notifyUser("Received unrecognized command \"" + command + "\"");
-        return;
+    // Recognize numerics (the bulk of the connect burst) directly from the bytes.
+    const QByteArray &commandToken(tokens[0]);
+    const int numeric = NumericCommandNameMessageArg::parseNumeric(commandToken);
+    in->inMessageType = numeric >= 0 ?
+        _msgTypeVocabIn.numericMessageType(numeric) :
+        _msgTypeVocabIn.messageType(commandToken);
+    if (!in->inMessageType) {
+        _stats.unrecognizedCommands++;
+        notifyUser("Received unrecognized command \"" + QString::fromLatin1(commandToken) + "\"");
+        return false;
     }
 
-    try {
-        // TODO: Somehow pass in how to decode raw prefix from QByteArray to QString...
-        // Might be relevant if network and user use different encodings,
-        // like latin1 vs. UTF-8, or it might even strange things like KOI8-R
-        // or what's it alled, or Shift_JIS or something be involved.
-        //
-        // Note: This would most likely be implemented via letting the lambdas
-        // in _loadMsgArgTypes() capture "this" and call a reencoding method
-        // of this IRCProtoClient for the conversion from QByteArray to QString.
-        //
-        in.inMessage = in.inMessageType->fromMessageAsTokens(*in.inTokens);
-    }
-    catch (const std::exception &ex) {
-        notifyUser("Error processing command \"" + command + "\": " + ex.what());
+    // (Text arguments stay raw bytes for now, and will get decoded
+    // on first access only, via this client's text decoder.)
+    ParseDiagnostic diag;
+    in->inMessage = in->inMessageType->tryFromMessageAsTokens(*in->inTokens, &diag);
+    if (!in->inMessage) {
+        _stats.parseErrors++;
+        notifyUser("Error processing command \"" + QString::fromLatin1(commandToken) + "\": " + diag.toString());
+        return false;
     }
 
-    if (in.inMessage) {
-        receivedMessageAutonomous(&in);
-        receivedMessage(&in);
+    return true;
+}
 
-        if (!in.handled)
-            notifyUser("Unhandled IRC protocol message: " + command);
-    }
+void IRCProtoClient::dispatchIncoming(Incoming *in)
+{
+    receivedMessageAutonomous(in);
+    receivedMessage(in);
+
+    if (!in->handled)
+        notifyUser("Unhandled IRC protocol message: " + QString::fromLatin1(in->inTokens->mainTokens.front()));
 }
 
 void IRCProtoClient::receivedMessageAutonomous(Incoming *in)
@@ -319,7 +501,7 @@ void IRCProtoClient::receivedMessageAutonomous(Incoming *in)
 
     auto numericArg = std::dynamic_pointer_cast<NumericCommandNameMessageArg>(commandArg);
 
-    if (commandArg->commandUpper == "PING") {
+    if (commandArg->commandUpper() == "PING") {
         if (msg->args.length() < 2)
             throw std::invalid_argument("IRC protocol client, receivedMessageAutonomous(): Incoming message misses second argument, the ping source");
 
@@ -327,9 +509,18 @@ void IRCProtoClient::receivedMessageAutonomous(Incoming *in)
         if (!sourceArg)
             throw std::invalid_argument("IRC protocol client, receivedMessageAutonomous(): Incoming message second argument is not a source argument");
 
-        sendRaw("PONG :" + sourceArg->source);
+        sendRaw("PONG :" + sourceArg->source.toString());
         in->handled = true;
     }
+    else if (commandArg->commandUpper() == "PONG") {
+        // (Servers put the token last; but some leave out their own name.)
+        std::shared_ptr<SourceMessageArg> tokenArg;
+        for (int i = msg->args.length() - 1; i >= 1 && !tokenArg; i--)
+            tokenArg = std::dynamic_pointer_cast<SourceMessageArg>(msg->args[i]);
+
+        if (tokenArg && _receivedLagPong(tokenArg->source.bytes()))
+            in->handled = true;
+    }
     else if (numericArg && numericArg->numeric == 1) {
         if (connectionState() != ConnectionState::Registering) {
             notifyUser("Protocol error, disconnecting: Got random Welcome/001 message");
@@ -338,9 +529,17 @@ void IRCProtoClient::receivedMessageAutonomous(Incoming *in)
         }
 
         notifyUser("Got welcome message; we're connected, now");
+        _reconnectAttempts = 0;
         _setConnectionState(ConnectionState::Connected);
+        _rejoinChannels();
         in->handled = true;
     }
+    else if (commandArg->commandUpper() == "JOIN" ||
+             commandArg->commandUpper() == "PART" ||
+             commandArg->commandUpper() == "KICK") {
+        // (Leave marking it handled to the contexts.)
+        _trackOwnChannels(commandArg->commandUpper(), msg.get());
+    }
 }
 
 IRCProtoClient::ConnectionState IRCProtoClient::connectionState() const
@@ -437,6 +636,53 @@ const QByteArray &IRCProtoClient::rawLineWhitelist() const
 void IRCProtoClient::setRawLineWhitelist(const QByteArray &newRawLineWhitelist)
 {
     _rawLineWhitelist = newRawLineWhitelist;
+
+    _rawLineWhitelistTable.fill(false);
+    for (char c : _rawLineWhitelist)
+        _rawLineWhitelistTable[static_cast<unsigned char>(c)] = true;
+
+    // The escape character itself always needs escaping.
+    _rawLineWhitelistTable['%'] = false;
+}
+
+QString IRCProtoClient::rawLineToDisplay(const QByteArray &rawLine) const
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    // Percent-encode everything that is not whitelisted.
+    QByteArray encoded;
+    encoded.reserve(rawLine.length() + 16);
+    for (char c : rawLine) {
+        unsigned char uc = static_cast<unsigned char>(c);
+        if (_rawLineWhitelistTable[uc]) {
+            encoded.append(c);
+        }
+        else {
+            encoded.append('%');
+            encoded.append(hexDigits[uc >> 4]);
+            encoded.append(hexDigits[uc & 0xf]);
+        }
+    }
+
+    return QString::fromLatin1(encoded);
+}
+
+bool IRCProtoClient::isRawLineObserved() const
+{
+    return _rawLineObservers > 0;
+}
+
+void IRCProtoClient::addRawLineObserver()
+{
+    _rawLineObservers++;
+}
+
+void IRCProtoClient::removeRawLineObserver()
+{
+    if (_rawLineObservers <= 0)
+        throw std::logic_error("IRC protocol client, remove raw line observer: There are no observers");
+
+    _rawLineObservers--;
 }
 
 void IRCProtoClient::_setConnectionState(ConnectionState newState)
@@ -445,21 +691,79 @@ void IRCProtoClient::_setConnectionState(ConnectionState newState)
         return;
 
     _connectionState = newState;
+
+    if (_connectionState == ConnectionState::Connected) {
+        _sendLagPing();
+        _armLagPing();
+    }
+    else if (_connectionState == ConnectionState::Disconnected) {
+        _stopTimer(&_watchdogTimer);
+        _stopTimer(&_lagPingTimer);
+        _lagPingToken.clear();
+        _lagLastUSecs = -1;
+        lagChanged();
+    }
+
     connectionStateChanged();
 }
 
+void IRCProtoClient::_armLagPing()
+{
+    _startTimer(&_lagPingTimer, _lagPingIntervalMSecs, [this]() { _lagPingTimeout(); });
+}
+
+void IRCProtoClient::_lagPingTimeout()
+{
+    _armLagPing();
+
+    if (!_lagPingToken.isNull()) {
+        // Still no answer; so the lag is at least that much, by now.
+        lagChanged();
+        return;
+    }
+
+    _sendLagPing();
+}
+
+void IRCProtoClient::_sendLagPing()
+{
+    // (The ping gets queued behind everything else to send,
+    // so it measures any local send backlog as well.)
+    _lagPingSentNSecs = _statsClock.nsecsElapsed();
+    _lagPingToken = "cvnirc-lag-" + QByteArray::number(_lagPingSentNSecs);
+    sendRaw("PING :" + QString::fromLatin1(_lagPingToken));
+}
+
+bool IRCProtoClient::_receivedLagPong(const QByteArray &token)
+{
+    if (_lagPingToken.isNull() || token != _lagPingToken)
+        return false;
+
+    _lagLastUSecs = (_statsClock.nsecsElapsed() - _lagPingSentNSecs) / 1000;
+    _lagHistogram.record(_lagLastUSecs);
+    _lagPingToken.clear();
+    lagChanged();
+    return true;
+}
+
 void IRCProtoClient::_loadMsgArgTypes()
 {
-    _msgArgTypesHolder.originType = std::make_shared<MessageOriginType>("origin", [](const QByteArray &prefixBytes) {
-        return QString(prefixBytes);  // TODO: Reencode from network to user encoding.
+    _msgArgTypesHolder.originType = std::make_shared<MessageOriginType>("origin", [this](const QByteArray &prefixBytes) {
+        return _prefixCache.lookup(prefixBytes, _textDecoder);
     }, MessageOrigin::Type::LinkServer);
 
     _msgArgTypesHolder.commandNameType = std::make_shared<MessageArgType<CommandNameMessageArg>>("command", [](TokensReader *reader) {
-        return std::make_shared<CommandNameMessageArg>(QString(reader->takeToken()));
-    });
-    _msgArgTypesHolder.numericCommandNameType = std::make_shared<MessageArgType<NumericCommandNameMessageArg>>("numeric", [](TokensReader *reader) {
-        return std::make_shared<NumericCommandNameMessageArg>(QString(reader->takeToken()));
+        return std::make_shared<CommandNameMessageArg>(reader->takeToken());
     });
+    _msgArgTypesHolder.numericCommandNameType = std::make_shared<MessageArgType<NumericCommandNameMessageArg>>("numeric",
+        [](TokensReader *reader) -> std::shared_ptr<NumericCommandNameMessageArg> {
+            const int numeric = NumericCommandNameMessageArg::parseNumeric(reader->takeToken());
+            if (numeric < 0) {
+                reader->setError(ParseError::InvalidNumeric);
+                return nullptr;
+            }
+            return std::make_shared<NumericCommandNameMessageArg>(numeric);
+        });
 
     auto unrecognizedType = std::make_shared<MessageArgType<UnrecognizedMessageArg>>("unrecognized", [](TokensReader *reader) {
         return std::make_shared<UnrecognizedMessageArg>(reader->takeToken());
@@ -469,38 +773,38 @@ void IRCProtoClient::_loadMsgArgTypes()
         [unrecognizedType](TokensReader *reader) {
             auto ret = std::make_shared<ListMessageArg<UnrecognizedMessageArg>>();
             while (!reader->atEnd())
-                ret->list.append(
+                ret->append(
                     unrecognizedType->fromTokens_call()(reader)
                 );
             return ret;
         });
 
-    _msgArgTypesHolder.sourceType = std::make_shared<MessageArgType<SourceMessageArg>>("source", [](TokensReader *reader) {
-        return std::make_shared<SourceMessageArg>(QString(reader->takeToken()));
+    _msgArgTypesHolder.sourceType = std::make_shared<MessageArgType<SourceMessageArg>>("source", [this](TokensReader *reader) {
+        return std::make_shared<SourceMessageArg>(NetworkString(reader->takeToken(), _textDecoder));
     });
 
     _msgArgTypesHolder.targetType = std::make_shared<MessageArgType<TargetMessageArg>>("target",
         [this](TokensReader *reader) -> std::shared_ptr<TargetMessageArg> {
             QByteArray token = reader->takeToken();
             if (isChannel(token))
-                return std::make_shared<ChannelTargetMessageArg>(QString(token));
+                return std::make_shared<ChannelTargetMessageArg>(NetworkString(token, _textDecoder));
             else
-                return std::make_shared<NickTargetMessageArg>(QString(token));
+                return std::make_shared<NickTargetMessageArg>(NetworkString(token, _textDecoder));
         });
     _msgArgTypesHolder.targetListType = make_commalist("targets", _msgArgTypesHolder.targetType);
 
-    _msgArgTypesHolder.channelType = std::make_shared<MessageArgType<ChannelTargetMessageArg>>("channel", [](TokensReader *reader) {
-        return std::make_shared<ChannelTargetMessageArg>(QString(reader->takeToken()));
+    _msgArgTypesHolder.channelType = std::make_shared<MessageArgType<ChannelTargetMessageArg>>("channel", [this](TokensReader *reader) {
+        return std::make_shared<ChannelTargetMessageArg>(NetworkString(reader->takeToken(), _textDecoder));
     });
     _msgArgTypesHolder.channelListType = make_commalist("channels", _msgArgTypesHolder.channelType);
 
-    _msgArgTypesHolder.keyType = std::make_shared<MessageArgType<KeyMessageArg>>("key", [](TokensReader *reader) {
-        return std::make_shared<KeyMessageArg>(QString(reader->takeToken()));
+    _msgArgTypesHolder.keyType = std::make_shared<MessageArgType<KeyMessageArg>>("key", [this](TokensReader *reader) {
+        return std::make_shared<KeyMessageArg>(NetworkString(reader->takeToken(), _textDecoder));
     });
     _msgArgTypesHolder.keyListType = make_commalist("keys", _msgArgTypesHolder.keyType);
 
-    _msgArgTypesHolder.chatterDataType = std::make_shared<MessageArgType<ChatterDataMessageArg>>("chatterData", [](TokensReader *reader) {
-        return std::make_shared<ChatterDataMessageArg>(QString(reader->takeToken()));
+    _msgArgTypesHolder.chatterDataType = std::make_shared<MessageArgType<ChatterDataMessageArg>>("chatterData", [this](TokensReader *reader) {
+        return std::make_shared<ChatterDataMessageArg>(NetworkString(reader->takeToken(), _textDecoder));
     });
 }
 
@@ -512,6 +816,25 @@ void IRCProtoClient::_loadMsgTypeVocabIn()
         //OptionalMessageArgType("[server2]", _msgArgTypesHolder.FIXME),
     }));
 
+    _msgTypeVocabIn.registerMessageType("PONG", MessageType::make_shared("PongType", _msgArgTypesHolder.originType, {
+        make_const_fwd("PongCommandType", _msgArgTypesHolder.commandNameType, "PONG"),
+        _msgArgTypesHolder.sourceType,
+        make_optional("[token]", _msgArgTypesHolder.sourceType),
+    }));
+
+    _msgTypeVocabIn.registerMessageType("PART", MessageType::make_shared("PartChannelType", _msgArgTypesHolder.originType, {
+        make_const_fwd("PartChannelCommandType", _msgArgTypesHolder.commandNameType, "PART"),
+        _msgArgTypesHolder.channelListType,
+        make_optional("[reason]", _msgArgTypesHolder.chatterDataType),
+    }));
+
+    _msgTypeVocabIn.registerMessageType("KICK", MessageType::make_shared("KickType", _msgArgTypesHolder.originType, {
+        make_const_fwd("KickCommandType", _msgArgTypesHolder.commandNameType, "KICK"),
+        _msgArgTypesHolder.channelType,
+        _msgArgTypesHolder.targetType,
+        make_optional("[comment]", _msgArgTypesHolder.chatterDataType),
+    }));
+
     _msgTypeVocabIn.registerMessageType("001", MessageType::make_shared("WelcomeType", _msgArgTypesHolder.originType, {
         make_const_fwd("WelcomeNumericType", _msgArgTypesHolder.numericCommandNameType, "001"),
         _msgArgTypesHolder.unrecognizedArgListType,
@@ -532,11 +855,556 @@ void IRCProtoClient::_loadMsgTypeVocabIn()
     _msgTypeVocabIn.registerMessageType("NOTICE",  chatterMsgType);
 }
 
+TrafficStats IRCProtoClient::stats() const
+{
+    TrafficStats ret(_stats);
+    ret.sendQueueLines = int(sendQueue.size());
+    ret.sendQueueBytes = _sendQueueBytes;
+    ret.socketBytesToWrite = socket->bytesToWrite();
+
+    const qint64 nowMSecs = _statsClock.elapsed();
+    ret.bytesReceivedPerSec = _bytesReceivedRate.ratePerSec(nowMSecs);
+    ret.linesReceivedPerSec = _linesReceivedRate.ratePerSec(nowMSecs);
+    ret.bytesSentPerSec = _bytesSentRate.ratePerSec(nowMSecs);
+    ret.linesSentPerSec = _linesSentRate.ratePerSec(nowMSecs);
+    return ret;
+}
+
+qint64 IRCProtoClient::lagUSecs() const
+{
+    if (_lagPingToken.isNull())
+        return _lagLastUSecs;
+
+    // (While waiting for an answer, the lag may only have grown.)
+    const qint64 pendingUSecs = (_statsClock.nsecsElapsed() - _lagPingSentNSecs) / 1000;
+    return qMax(_lagLastUSecs, pendingUSecs);
+}
+
+const LagHistogram &IRCProtoClient::lagHistogram() const
+{
+    return _lagHistogram;
+}
+
+int IRCProtoClient::lagPingInterval() const
+{
+    return _lagPingIntervalMSecs;
+}
+
+void IRCProtoClient::setLagPingInterval(int msecs)
+{
+    if (msecs <= 0)
+        throw std::invalid_argument("IRC protocol client, set lag ping interval: Interval must be positive");
+
+    _lagPingIntervalMSecs = msecs;
+    if (_lagPingTimer != 0)
+        _armLagPing();
+}
+
+TimerWheel *IRCProtoClient::timerWheel() const
+{
+    return _timerWheel;
+}
+
+void IRCProtoClient::setTimerWheel(TimerWheel *timerWheel)
+{
+    _stopTimer(&_lagPingTimer);
+    _stopTimer(&_watchdogTimer);
+    _timerWheel = timerWheel;
+
+    if (connectionState() == ConnectionState::Registering || connectionState() == ConnectionState::Connected)
+        _armWatchdog(_watchdogTimeouts.idleMSecs);
+    if (connectionState() == ConnectionState::Connected)
+        _armLagPing();
+}
+
+const IRCProtoClient::WatchdogTimeouts &IRCProtoClient::watchdogTimeouts() const
+{
+    return _watchdogTimeouts;
+}
+
+void IRCProtoClient::setWatchdogTimeouts(const WatchdogTimeouts &timeouts)
+{
+    if (timeouts.idleMSecs <= 0 || timeouts.pingTimeoutMSecs <= 0 || timeouts.stalledLineMSecs <= 0)
+        throw std::invalid_argument("IRC protocol client, set watchdog timeouts: Timeouts must be positive");
+
+    // (Takes effect at the next check.)
+    _watchdogTimeouts = timeouts;
+}
+
+void IRCProtoClient::_startTimer(TimerWheel::TimerId *id, qint64 delayMSecs, TimerWheel::callback_type callback)
+{
+    _stopTimer(id);
+    if (!_timerWheel)
+        return;
+
+    *id = _timerWheel->schedule(int(qBound<qint64>(0, delayMSecs, INT_MAX)), [id, callback]() {
+        *id = 0;
+        callback();
+    });
+}
+
+void IRCProtoClient::_stopTimer(TimerWheel::TimerId *id)
+{
+    if (*id != 0 && _timerWheel)
+        _timerWheel->cancel(*id);
+    *id = 0;
+}
+
+void IRCProtoClient::_armWatchdog(qint64 delayMSecs)
+{
+    _startTimer(&_watchdogTimer, delayMSecs, [this]() { _watchdogCheck(); });
+}
+
+void IRCProtoClient::_watchdogCheck()
+{
+    if (connectionState() == ConnectionState::Connecting && _tlsHandshakeStartMSecs >= 0) {
+        _connectionLost("Watchdog: TLS handshake not done after " +
+                        QString::number((_statsClock.elapsed() - _tlsHandshakeStartMSecs) / 1000) + " seconds, disconnecting.");
+        return;
+    }
+
+    if (!(connectionState() == ConnectionState::Registering || connectionState() == ConnectionState::Connected))
+        return;
+
+    const WatchdogTimeouts &timeouts(_watchdogTimeouts);
+    const qint64 nowMSecs = _statsClock.elapsed();
+
+    if (_partialLineSinceMSecs >= 0 && nowMSecs - _partialLineSinceMSecs >= timeouts.stalledLineMSecs) {
+        _connectionLost("Watchdog: Server left a line incomplete for " +
+                        QString::number((nowMSecs - _partialLineSinceMSecs) / 1000) + " seconds, disconnecting.");
+        return;
+    }
+
+    qint64 nextMSecs = _lastReceivedMSecs + timeouts.idleMSecs;
+    if (nowMSecs >= nextMSecs) {
+        // Silence for too long; ask the server whether it's still there.
+        // (The probe doubles as a lag measurement; one may already be on its way.
+        // While registering, PING may be refused, so just wait as long.)
+        if (_lagPingToken.isNull() && connectionState() == ConnectionState::Connected)
+            _sendLagPing();
+
+        qint64 probeMSecs = nextMSecs;
+        if (!_lagPingToken.isNull())
+            probeMSecs = qMax(probeMSecs, _lagPingSentNSecs / 1000000);
+
+        if (nowMSecs - probeMSecs >= timeouts.pingTimeoutMSecs) {
+            _connectionLost("Watchdog: Ping timeout, no data from server for " +
+                            QString::number((nowMSecs - _lastReceivedMSecs) / 1000) + " seconds, disconnecting.");
+            return;
+        }
+
+        nextMSecs = probeMSecs + timeouts.pingTimeoutMSecs;
+    }
+
+    if (_partialLineSinceMSecs >= 0)
+        nextMSecs = qMin(nextMSecs, _partialLineSinceMSecs + timeouts.stalledLineMSecs);
+
+    _armWatchdog(nextMSecs - nowMSecs);
+}
+
+const IRCProtoClient::ReconnectPolicy &IRCProtoClient::reconnectPolicy() const
+{
+    return _reconnectPolicy;
+}
+
+void IRCProtoClient::setReconnectPolicy(const ReconnectPolicy &policy)
+{
+    if (policy.initialDelayMSecs <= 0 || policy.maxDelayMSecs < policy.initialDelayMSecs ||
+        policy.multiplier < 1 || policy.jitter < 0 || policy.jitter > 1)
+        throw std::invalid_argument("IRC protocol client, set reconnect policy: Invalid policy");
+
+    _reconnectPolicy = policy;
+    if (!_reconnectPolicy.enabled)
+        _cancelReconnect();
+}
+
+AdmissionLimiter *IRCProtoClient::reconnectLimiter() const
+{
+    return _reconnectLimiter;
+}
+
+void IRCProtoClient::setReconnectLimiter(AdmissionLimiter *limiter)
+{
+    const bool waiting = _reconnectTicket != 0;
+    if (waiting && _reconnectLimiter)
+        _reconnectLimiter->cancel(_reconnectTicket);
+    _reconnectTicket = 0;
+
+    _reconnectLimiter = limiter;
+
+    // (Wait in the new line, then.)
+    if (waiting)
+        _requestReconnectAdmission();
+}
+
+bool IRCProtoClient::isReconnectPending() const
+{
+    return _reconnectTimer != 0 || _reconnectTicket != 0;
+}
+
+int IRCProtoClient::reconnectAttempts() const
+{
+    return _reconnectAttempts;
+}
+
+const QStringList &IRCProtoClient::joinedChannels() const
+{
+    return _joinedChannels;
+}
+
+void IRCProtoClient::_connectionLost(const QString &reason)
+{
+    notifyUser(reason);
+
+    // (As in disconnectFromIRCServer(); nothing of this belongs to a new connection.)
+    sendQueue.clear();
+    _sendQueueBytes = 0;
+
+    _abortConnectAttempts();
+    socket->abort();
+    _setConnectionState(ConnectionState::Disconnected);
+    _scheduleReconnect();
+}
+
+void IRCProtoClient::_scheduleReconnect()
+{
+    const ReconnectPolicy &policy(_reconnectPolicy);
+    if (!policy.enabled || _quitSent || _hostRequestNext.isEmpty() || !_timerWheel || isReconnectPending())
+        return;
+
+    double delayMSecs = policy.initialDelayMSecs * std::pow(policy.multiplier, qMin(_reconnectAttempts, 30));
+    delayMSecs = qMin(delayMSecs, double(policy.maxDelayMSecs));
+    std::uniform_real_distribution<double> unit(0, 1);
+    delayMSecs = delayMSecs * (1 - policy.jitter) + delayMSecs * policy.jitter * unit(_random);
+
+    _reconnectAttempts++;
+    notifyUser("Reconnecting in " + QString::number(delayMSecs / 1000, 'f', 1) +
+               " seconds (attempt " + QString::number(_reconnectAttempts) + ")...");
+
+    _startTimer(&_reconnectTimer, qint64(delayMSecs), [this]() { _requestReconnectAdmission(); });
+}
+
+void IRCProtoClient::_requestReconnectAdmission()
+{
+    if (!_reconnectLimiter) {
+        reconnectToIRCServer();
+        return;
+    }
+
+    // (Zero if admitted right away, and then reconnecting already.)
+    _reconnectTicket = _reconnectLimiter->request([this]() {
+        _reconnectTicket = 0;
+        reconnectToIRCServer();
+    });
+}
+
+void IRCProtoClient::_cancelReconnect()
+{
+    _stopTimer(&_reconnectTimer);
+    if (_reconnectTicket != 0 && _reconnectLimiter)
+        _reconnectLimiter->cancel(_reconnectTicket);
+    _reconnectTicket = 0;
+}
+
+void IRCProtoClient::_rejoinChannels()
+{
+    if (_joinedChannels.isEmpty())
+        return;
+
+    notifyUser("Rejoining " + QString::number(_joinedChannels.count()) + " channel(s)...");
+
+    // (Several per JOIN, but keep well below the line length limit.)
+    QString channels;
+    for (const QString &channel : _joinedChannels) {
+        if (!channels.isEmpty() && channels.length() + 1 + channel.length() > 400) {
+            sendRaw("JOIN " + channels);
+            channels.clear();
+        }
+        if (!channels.isEmpty())
+            channels.append(',');
+        channels.append(channel);
+    }
+    sendRaw("JOIN " + channels);
+}
+
+void IRCProtoClient::_trackOwnChannels(const QByteArray &command, Message *msg)
+{
+    // TODO: Use nick *taken* last, when we have support to track this.
+    auto isUs = [this](const QString &nick) {
+        return !nick.isEmpty() && nick.compare(_nickRequestedLast, Qt::CaseInsensitive) == 0;
+    };
+    auto indexOfChannel = [this](const QString &channel) {
+        for (int i = 0; i < _joinedChannels.count(); i++) {
+            if (_joinedChannels[i].compare(channel, Qt::CaseInsensitive) == 0)
+                return i;
+        }
+        return -1;
+    };
+
+    if (command == "KICK") {
+        auto channelArg = std::dynamic_pointer_cast<ChannelTargetMessageArg>(msg->args.value(1));
+        auto victimArg = std::dynamic_pointer_cast<TargetMessageArg>(msg->args.value(2));
+        if (!channelArg || !victimArg || !isUs(victimArg->targetToString()))
+            return;
+
+        const int i = indexOfChannel(channelArg->channel.toString());
+        if (i >= 0)
+            _joinedChannels.removeAt(i);
+        return;
+    }
+
+    if (!isUs(msg->origin.nick().toString()))
+        return;
+
+    auto channelsArg = std::dynamic_pointer_cast<CommaListMessageArg<ChannelTargetMessageArg>>(msg->args.value(1));
+    if (!channelsArg)
+        return;
+
+    channelsArg->forEachSlice([&](const char *data, int len) {
+        const QString channel = _textDecoder->decode(QByteArray(data, len));
+        const int i = indexOfChannel(channel);
+        if (command == "JOIN" && i < 0)
+            _joinedChannels.append(channel);
+        else if (command == "PART" && i >= 0)
+            _joinedChannels.removeAt(i);
+    });
+}
+
+DnsCache *IRCProtoClient::dnsCache() const
+{
+    return _dnsCache;
+}
+
+void IRCProtoClient::setDnsCache(DnsCache *dnsCache)
+{
+    // (Takes effect at the next connect.)
+    _dnsCache = dnsCache;
+}
+
+void IRCProtoClient::_startConnect(const QString &host, quint16 port)
+{
+    _abortConnectAttempts();
+
+    _connectHost = host;
+    _connectPort = port;
+    _connectStartMSecs = _statsClock.elapsed();
+    _stats.connectMSecs = -1;
+    _stats.tls = _connectTls;
+    _stats.tlsHandshakeMSecs = -1;
+    _stats.tlsTicketOffered = false;
+    _stats.tlsCipher.clear();
+    _tlsHandshakeStartMSecs = -1;
+    _tlsTicketOffered = QByteArray();
+    if (_connectTls && _tlsSessionCache)
+        _tlsTicketOffered = _tlsSessionCache->ticket(host, port);
+
+    if (!_dnsCache) {
+        // (Fresh socket, of the right kind for this connection.)
+        _adoptSocket(_createSocket());
+        socket->connectToHost(host, port);
+        return;
+    }
+
+    const quint64 generation = ++_connectGeneration;
+    _dnsCache->resolve(host, this, [this, generation](const QList<QHostAddress> &addresses, const QString &errorString) {
+        _resolved(generation, addresses, errorString);
+    });
+}
+
+void IRCProtoClient::_resolved(quint64 generation, const QList<QHostAddress> &addresses, const QString &errorString)
+{
+    // (Answer to a connect that got aborted or superseded meanwhile.)
+    if (generation != _connectGeneration || connectionState() != ConnectionState::Connecting)
+        return;
+
+    if (addresses.isEmpty()) {
+        _connectionLost("Can't resolve host " + _hostRequestNext + ": " + errorString);
+        return;
+    }
+
+    // Alternate address families, IPv6 first; so that a broken
+    // family costs one stagger interval, not a connect timeout.
+    QList<QHostAddress> ipv6, ipv4;
+    for (const QHostAddress &address : addresses)
+        (address.protocol() == QAbstractSocket::IPv6Protocol ? ipv6 : ipv4).append(address);
+
+    _connectAddresses.clear();
+    for (int i = 0; i < ipv6.count() || i < ipv4.count(); i++) {
+        if (i < ipv6.count())
+            _connectAddresses.append(ipv6[i]);
+        if (i < ipv4.count())
+            _connectAddresses.append(ipv4[i]);
+    }
+
+    _connectLastError.clear();
+    _startNextConnectAttempt();
+}
+
+void IRCProtoClient::_startNextConnectAttempt()
+{
+    _stopTimer(&_connectStaggerTimer);
+    if (_connectAddresses.isEmpty())
+        return;
+
+    const QHostAddress address = _connectAddresses.takeFirst();
+    if (_verboseLevel >= 2)
+        notifyUser("Trying " + address.toString() + "...");
+
+    QTcpSocket *attempt = _createSocket();
+    connect(attempt, &QAbstractSocket::connected,
+            this, &IRCProtoClient::handle_connectAttempt_connected);
+    connect(attempt, static_cast<error_signal_type>(&QAbstractSocket::error),
+            this, &IRCProtoClient::handle_connectAttempt_error);
+    _connectAttempts.append(attempt);
+    attempt->connectToHost(address, _connectPort);
+
+    // (Without a timer wheel, the next one only starts when this one fails.)
+    if (!_connectAddresses.isEmpty())
+        _startTimer(&_connectStaggerTimer, connectStaggerMSecs, [this]() { _startNextConnectAttempt(); });
+}
+
+void IRCProtoClient::_abortConnectAttempts()
+{
+    _stopTimer(&_connectStaggerTimer);
+    _connectAddresses.clear();
+
+    for (QTcpSocket *attempt : _connectAttempts) {
+        attempt->disconnect(this);
+        attempt->abort();
+        attempt->deleteLater();
+    }
+    _connectAttempts.clear();
+}
+
+void IRCProtoClient::handle_connectAttempt_connected()
+{
+    auto *attempt = qobject_cast<QTcpSocket *>(sender());
+    if (attempt == nullptr || !_connectAttempts.removeOne(attempt))
+        return;
+
+    if (_verboseLevel >= 2)
+        notifyUser("Connected to " + attempt->peerName() + ".");
+
+    // (Winner takes all; the others are aborted.)
+    _abortConnectAttempts();
+    _adoptSocket(attempt);
+    handle_socket_connected();
+}
+
+void IRCProtoClient::handle_connectAttempt_error(QAbstractSocket::SocketError err)
+{
+    Q_UNUSED(err)
+
+    auto *attempt = qobject_cast<QTcpSocket *>(sender());
+    if (attempt == nullptr || !_connectAttempts.removeOne(attempt))
+        return;
+
+    _connectLastError = attempt->peerName() + ": " + attempt->errorString();
+    if (_verboseLevel >= 2)
+        notifyUser("Connection attempt failed: " + _connectLastError);
+
+    attempt->disconnect(this);
+    attempt->deleteLater();
+
+    // (Don't wait out the stagger for a dead end.)
+    if (!_connectAddresses.isEmpty()) {
+        _startNextConnectAttempt();
+        return;
+    }
+
+    if (_connectAttempts.isEmpty())
+        _connectionLost("Connecting failed, last error: " + _connectLastError);
+}
+
+bool IRCProtoClient::isTlsRequested() const
+{
+    return _portRequestNext.startsWith('+');
+}
+
+bool IRCProtoClient::tlsVerifyPeer() const
+{
+    return _tlsVerifyPeer;
+}
+
+void IRCProtoClient::setTlsVerifyPeer(bool verifyPeer)
+{
+    _tlsVerifyPeer = verifyPeer;
+}
+
+TlsSessionCache *IRCProtoClient::tlsSessionCache() const
+{
+    return _tlsSessionCache;
+}
+
+void IRCProtoClient::setTlsSessionCache(TlsSessionCache *tlsSessionCache)
+{
+    _tlsSessionCache = tlsSessionCache;
+}
+
+TrafficRecorder &IRCProtoClient::trafficRecorder()
+{
+    return _trafficRecorder;
+}
+
+IRCProtoClient::decoder_ptr IRCProtoClient::textDecoder() const
+{
+    return _textDecoder;
+}
+
+IRCProtoClient::decoder_ptr IRCProtoClient::textDecoderForTarget(const QString &target) const
+{
+    return _targetTextDecoders.value(target.toLower(), _textDecoder);
+}
+
+bool IRCProtoClient::setFallbackEncoding(const QByteArray &codecName)
+{
+    decoder_ptr decoder = _makeTextDecoder(codecName);
+    if (!decoder)
+        return false;
+
+    if (_verboseLevel >= 1)
+        notifyUser("Setting fallback encoding to \"" + decoder->fallbackName() + "\".");
+    _textDecoder = decoder;
+    return true;
+}
+
+bool IRCProtoClient::setTargetFallbackEncoding(const QString &target, const QByteArray &codecName)
+{
+    if (codecName.isEmpty()) {
+        // Go back to the connection's setting.
+        _targetTextDecoders.remove(target.toLower());
+        return true;
+    }
+
+    decoder_ptr decoder = _makeTextDecoder(codecName);
+    if (!decoder)
+        return false;
+
+    if (_verboseLevel >= 1)
+        notifyUser("Setting fallback encoding for \"" + target + "\" to \"" + decoder->fallbackName() + "\".");
+    _targetTextDecoders.insert(target.toLower(), decoder);
+    return true;
+}
+
+IRCProtoClient::decoder_ptr IRCProtoClient::_makeTextDecoder(const QByteArray &codecName)
+{
+    QTextCodec *codec = QTextCodec::codecForName(codecName);
+    if (codec == nullptr)
+        return nullptr;
+
+    return std::make_shared<const TextDecoder>(codec);
+}
+
 bool IRCProtoClient::isChannel(const QByteArray &token)
+{
+    return isChannel(token.constData(), token.length());
+}
+
+bool IRCProtoClient::isChannel(const char *data, int len)
 {
     // TODO: Use information from 001 "Welcome" message or the like
     //       to determine what's a channel and what's not.
-    return token.startsWith('#');
+    return len >= 1 && data[0] == '#';
 }
 
 QString IRCProtoClient::nickUserHost2nick(const QString &nickUserHost)
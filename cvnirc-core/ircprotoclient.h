@@ -6,14 +6,27 @@
 #include <QObject>
 #include <QAbstractSocket>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
+#include <array>
 #include <deque>
+#include <random>
 
 #include "ircprotomessage.h"
+#include "ircprotorecorder.h"
+#include "ircprotostats.h"
+#include "timerwheel.h"
+#include "admissionlimiter.h"
+#include "dnscache.h"
+#include "tlssessioncache.h"
 
 // FIXME: Replace by wrapping in namespace.
 namespace IRCProto = cvnirc::core::IRCProto;
 
 class QTcpSocket;
+class QSslError;
 
 class CVNIRCCORESHARED_EXPORT IRCProtoClient : public QObject
 {
@@ -32,11 +45,36 @@ public:
 #endif
 
 
+    class WatchdogTimeouts
+    {
+    public:
+        int idleMSecs = 45 * 1000;        // (Probe with a PING after this much silence...)
+        int pingTimeoutMSecs = 15 * 1000; // (...and give up after this much more.)
+        int stalledLineMSecs = 60 * 1000; // (Incomplete line not getting completed.)
+    };
+
+    // Exponential backoff, with part of each delay randomized,
+    // so that connections lost together don't come back in lockstep.
+    class ReconnectPolicy
+    {
+    public:
+        bool   enabled = true;
+        int    initialDelayMSecs = 2 * 1000;
+        int    maxDelayMSecs = 5 * 60 * 1000;
+        double multiplier = 2;
+        double jitter = 0.5;  // (Fraction of the delay that is random.)
+    };
+
+
     explicit IRCProtoClient(QObject *parent = 0);
+    ~IRCProtoClient();
 
     void connectToIRCServer(const QString &host, const QString &port, const QString &user, const QString &nick);
     void sendRaw(const QString &line);
     void receivedRaw(const IRCProto::MessageOnNetwork &raw);
+    // (The stages of receivedRaw(), after tokenizing; callable separately for benchmarking.)
+    bool typeIncoming(IRCProto::Incoming *in);
+    void dispatchIncoming(IRCProto::Incoming *in);
     void receivedMessageAutonomous(IRCProto::Incoming *in);
 
     ConnectionState connectionState() const;
@@ -58,19 +96,83 @@ public:
 
     const QByteArray &rawLineWhitelist() const;
     void setRawLineWhitelist(const QByteArray &newRawLineWhitelist);
+    QString rawLineToDisplay(const QByteArray &rawLine) const;
+
+    // Signal receivedLine() is opt-in; raw lines won't even be
+    // handed out as long as nobody has registered interest.
+    bool isRawLineObserved() const;
+    void addRawLineObserver();
+    void removeRawLineObserver();
+
+    // Decoding of text received, where it is neither ASCII nor UTF-8.
+    typedef IRCProto::NetworkString::decoder_ptr  decoder_ptr;
+    decoder_ptr textDecoder() const;
+    decoder_ptr textDecoderForTarget(const QString &target) const;
+    bool setFallbackEncoding(const QByteArray &codecName);
+    bool setTargetFallbackEncoding(const QString &target, const QByteArray &codecName);
+
+    IRCProto::TrafficStats stats() const;
+
+    // Lag measurement, by PINGing the server periodically while connected.
+    qint64 lagUSecs() const;  // (-1: Unknown.)
+    const IRCProto::LagHistogram &lagHistogram() const;
+    int lagPingInterval() const;  // (In milliseconds.)
+    void setLagPingInterval(int msecs);
+
+    // Lag pings and the watchdog against dead connections and stalled
+    // partial lines run on a timer wheel; without one, they're off.
+    TimerWheel *timerWheel() const;
+    void setTimerWheel(TimerWheel *timerWheel);
+    const WatchdogTimeouts &watchdogTimeouts() const;
+    void setWatchdogTimeouts(const WatchdogTimeouts &timeouts);
+
+    // Automatic reconnect after losing the connection (not after quitting),
+    // admitted through the limiter if there is one; channels get rejoined.
+    // (Needs the timer wheel, too.)
+    const ReconnectPolicy &reconnectPolicy() const;
+    void setReconnectPolicy(const ReconnectPolicy &policy);
+    AdmissionLimiter *reconnectLimiter() const;
+    void setReconnectLimiter(AdmissionLimiter *limiter);
+    bool isReconnectPending() const;
+    int reconnectAttempts() const;
+    const QStringList &joinedChannels() const;
+
+    // Host names get resolved through the cache if there is one; then,
+    // connection attempts to the addresses race each other, IPv6 and
+    // IPv4 alternating, each started a little after the one before
+    // (or right away when that one failed). First to connect wins.
+    // (Without a cache, it's one plain connectToHost().)
+    static const int connectStaggerMSecs = 250;
+    DnsCache *dnsCache() const;
+    void setDnsCache(DnsCache *dnsCache);
+
+    // TLS, for a port given as "+PORT" (like "+6697"). With a session
+    // cache, reconnects offer the session ticket of the last connection
+    // to that server, so that the server may skip the full handshake.
+    // (Peer verification changes take effect at the next connect.)
+    bool isTlsRequested() const;
+    bool tlsVerifyPeer() const;
+    void setTlsVerifyPeer(bool verifyPeer);
+    TlsSessionCache *tlsSessionCache() const;
+    void setTlsSessionCache(TlsSessionCache *tlsSessionCache);
+
+    // Recording of all lines received and sent, to a capture file.
+    IRCProto::TrafficRecorder &trafficRecorder();
 
     bool isChannel(const QByteArray &token);
+    bool isChannel(const char *data, int len);
     static QString nickUserHost2nick(const QString &nickUserHost);
 
 signals:
     void notifyUser(const QString &msg);
     void sendingLine(const QString &rawLine);
-    void receivedLine(const QString &rawLine);
+    void receivedLine(const QByteArray &rawLine);
     void receivedMessage(IRCProto::Incoming *in);
     void connectionStateChanged();
     void hostPortRequestedLastChanged();
     void userRequestedLastChanged();
     void nickRequestedLastChanged();
+    void lagChanged();
 
 public slots:
     void reconnectToIRCServer();
@@ -80,15 +182,95 @@ public slots:
 private slots:
     void handle_socket_connected();
     void handle_socket_error(QAbstractSocket::SocketError err);
+    void handle_socket_encrypted();
+    void handle_socket_sslErrors(const QList<QSslError> &errors);
+    void handle_socket_newSessionTicketReceived();
+    void handle_connectAttempt_connected();
+    void handle_connectAttempt_error(QAbstractSocket::SocketError err);
     void processOutgoingData();
     void processIncomingData();
 
 private:
     QTcpSocket *socket;
     QByteArray  socketReadBuf;
-    qint64      socketReadBufUsed = 0;
+    QTcpSocket *_createSocket();
+    void _wireSocket();
+    void _adoptSocket(QTcpSocket *newSocket);
+    IRCProto::LineFramer _lineFramer;
+    IRCProto::TrafficRecorder _trafficRecorder;
+
+    IRCProto::TrafficStats _stats;  // (Totals, and setup of the latest connection.)
+    IRCProto::RateWindow   _bytesReceivedRate, _linesReceivedRate;
+    IRCProto::RateWindow   _bytesSentRate, _linesSentRate;
+    QElapsedTimer          _statsClock;
+
+    QPointer<TimerWheel> _timerWheel;
+    void _startTimer(TimerWheel::TimerId *id, qint64 delayMSecs, TimerWheel::callback_type callback);
+    void _stopTimer(TimerWheel::TimerId *id);
+
+    TimerWheel::TimerId _lagPingTimer = 0;
+    int        _lagPingIntervalMSecs = 30 * 1000;
+    QByteArray _lagPingToken;  // (Null: No ping outstanding.)
+    qint64     _lagPingSentNSecs = 0;
+    qint64     _lagLastUSecs = -1;
+    IRCProto::LagHistogram _lagHistogram;
+    void _armLagPing();
+    void _lagPingTimeout();
+    void _sendLagPing();
+    bool _receivedLagPong(const QByteArray &token);
+
+    TimerWheel::TimerId _watchdogTimer = 0;
+    WatchdogTimeouts    _watchdogTimeouts;
+    qint64 _lastReceivedMSecs = 0;
+    qint64 _partialLineSinceMSecs = -1;  // (-1: No partial line buffered.)
+    void _armWatchdog(qint64 delayMSecs);
+    void _watchdogCheck();
 
-    std::deque<QString> sendQueue;
+    ReconnectPolicy _reconnectPolicy;
+    QPointer<AdmissionLimiter> _reconnectLimiter;
+    TimerWheel::TimerId      _reconnectTimer = 0;
+    AdmissionLimiter::Ticket _reconnectTicket = 0;
+    int  _reconnectAttempts = 0;
+    bool _quitSent = false;
+    std::mt19937 _random;
+    QStringList _joinedChannels;
+    void _connectionLost(const QString &reason);
+    void _scheduleReconnect();
+    void _requestReconnectAdmission();
+    void _cancelReconnect();
+    void _rejoinChannels();
+    void _trackOwnChannels(const QByteArray &command, IRCProto::Message *msg);
+
+    QPointer<DnsCache> _dnsCache;
+    quint64 _connectGeneration = 0;  // (Tells outdated resolver answers apart.)
+    quint16 _connectPort = 0;
+    QList<QHostAddress> _connectAddresses;  // (Not tried yet.)
+    QList<QTcpSocket *> _connectAttempts;
+    QString _connectLastError;
+    QString _connectHost;
+    qint64  _connectStartMSecs = 0;
+    TimerWheel::TimerId _connectStaggerTimer = 0;
+    void _startConnect(const QString &host, quint16 port);
+    void _resolved(quint64 generation, const QList<QHostAddress> &addresses, const QString &errorString);
+    void _startNextConnectAttempt();
+    void _abortConnectAttempts();
+
+    bool _connectTls = false;
+    bool _tlsVerifyPeer = true;
+    QPointer<TlsSessionCache> _tlsSessionCache;
+    QByteArray _tlsTicketOffered;
+    qint64 _tlsHandshakeStartMSecs = -1;  // (-1: No handshake going on.)
+    void _storeTlsSession();
+    void _startRegistration();
+
+    class QueuedLine
+    {
+    public:
+        QString    line;
+        QByteArray bytes;  // (Encoded, including CR/LF.)
+    };
+    std::deque<QueuedLine> sendQueue;
+    qint64 _sendQueueBytes = 0;
 
     QString _hostRequestedLast, _portRequestedLast;
     QString _userRequestedLast;
@@ -103,6 +285,14 @@ private:
 
     int _verboseLevel = 1;
     QByteArray _rawLineWhitelist;
+    std::array<bool, 256> _rawLineWhitelistTable;
+    int _rawLineObservers = 0;
+    decoder_ptr _textDecoder;
+    QHash<QString, decoder_ptr> _targetTextDecoders;
+    static decoder_ptr _makeTextDecoder(const QByteArray &codecName);
+
+    IRCProto::PrefixCache _prefixCache;
+
     IRCProto::MessageArgTypesHolder _msgArgTypesHolder;
     IRCProto::MessageTypeVocabulary _msgTypeVocabIn;
 
@@ -1,6 +1,7 @@
 #include "ircprotomessage.h"
 
 #include <stdexcept>
+#include <string.h>
 
 namespace cvnirc   {
 namespace core     {  // cvnirc::core
@@ -70,11 +71,119 @@ MessageAsTokens MessageOnNetwork::parse() const
     return MessageAsTokens { prefix, parsedTokens };
 }
 
+void LineFramer::append(const char *data, int len)
+{
+    // Drop what has been taken already, once per append instead of per line.
+    if (_pos > 0) {
+        _buf.remove(0, _pos);
+        _pos = 0;
+    }
+
+    _buf.append(data, len);
+}
+
+void LineFramer::append(const QByteArray &data)
+{
+    append(data.constData(), data.length());
+}
+
+bool LineFramer::takeLine(MessageOnNetwork *line)
+{
+    if (line == nullptr)
+        throw std::invalid_argument("Line framer, take line: Line can't be null");
+
+    if (_error != Error::None)
+        return false;
+
+    const char *data = _buf.constData() + _pos;
+    const int avail = _buf.length() - _pos;
+    const auto *lf = static_cast<const char *>(memchr(data, '\n', avail));
+
+    if (lf == nullptr) {
+        // Incomplete line; check what's there, so that garbage gets noticed early.
+        if (memchr(data, '\0', avail) != nullptr)
+            _error = Error::NulByte;
+        else if (avail >= maxBufferedLength)
+            _error = Error::LineTooLong;
+        return false;
+    }
+
+    const int len = int(lf - data) + 1;  // (Including CR/LF.)
+    if (len < 2 || lf[-1] != '\r') {
+        _error = Error::BrokenLineTermination;
+        return false;
+    }
+
+    if (memchr(data, '\0', len) != nullptr) {
+        _error = Error::NulByte;
+        return false;
+    }
+
+    if (memchr(data, '\r', len - 2) != nullptr) {
+        _error = Error::BrokenLineTermination;
+        return false;
+    }
+
+    line->bytes = QByteArray(data, len);
+    _pos += len;
+    return true;
+}
+
+LineFramer::Error LineFramer::error() const
+{
+    return _error;
+}
+
+int LineFramer::bufferedLength() const
+{
+    return _buf.length() - _pos;
+}
+
+void LineFramer::clear()
+{
+    _buf.clear();
+    _pos = 0;
+    _error = Error::None;
+}
+
 MessageOnNetwork MessageAsTokens::pack() const
 {
     throw std::logic_error("MessageAsTokens::pack(): Not implemented");
 }
 
+const char *parseErrorToString(ParseError error)
+{
+    switch (error) {
+    case ParseError::None:
+        return "No error";
+    case ParseError::MissingToken:
+        return "Missing argument";
+    case ParseError::MissingByte:
+        return "Missing argument byte";
+    case ParseError::ConstMismatch:
+        return "Argument doesn't match the expected value";
+    case ParseError::InvalidNumeric:
+        return "Invalid numeric: Must be 3 digits";
+    case ParseError::TrailingTokens:
+        return "Trailing arguments, that is, more arguments than we had syntax for";
+    }
+
+    return "Unknown error";
+}
+
+bool ParseDiagnostic::ok() const
+{
+    return error == ParseError::None;
+}
+
+QString ParseDiagnostic::toString() const
+{
+    QString ret = QString::fromLatin1(parseErrorToString(error));
+    if (argIndex >= 0)
+        ret += " (at argument " + QString::number(argIndex) + ")";
+    return ret;
+}
+
 TokensReader::TokensReader(const QByteArrayList &tokens) :
     _remainingTokens(tokens)
 {
@@ -109,8 +218,10 @@ bool TokensReader::isTokenAvailable() const
 
 char TokensReader::takeByte()
 {
-    if (!isByteAvailable())
-        throw std::runtime_error("Message reader, take byte: No byte available");
+    if (!isByteAvailable()) {
+        setError(ParseError::MissingByte);
+        return '\0';
+    }
 
     QByteArray &firstToken(_remainingTokens.front());
     char c = firstToken[0];
@@ -120,12 +231,30 @@ char TokensReader::takeByte()
 
 QByteArray TokensReader::takeToken()
 {
-    if (!isTokenAvailable())
-        throw std::runtime_error("Message reader, take token: No token available");
+    if (!isTokenAvailable()) {
+        setError(ParseError::MissingToken);
+        return QByteArray();
+    }
 
     return _remainingTokens.takeFirst();
 }
 
+ParseError TokensReader::error() const
+{
+    return _error;
+}
+
+bool TokensReader::hasError() const
+{
+    return _error != ParseError::None;
+}
+
+void TokensReader::setError(ParseError error)
+{
+    if (_error == ParseError::None)
+        _error = error;
+}
+
 
 Incoming::Incoming(Incoming::raw_ptr inRaw, Incoming::tokens_ptr inTokens, messageType_ptr inMessageType, Incoming::message_ptr inMessage) :
     inRaw(inRaw),
@@ -137,14 +266,121 @@ Incoming::Incoming(Incoming::raw_ptr inRaw, Incoming::tokens_ptr inTokens, messa
 }
 
 
-MessageOrigin MessageOrigin::fromPrefix(const QString &prefix, Type onNull)
+std::shared_ptr<const PrefixParts> PrefixParts::parse(const QByteArray &prefixBytes, NetworkString::decoder_ptr decoder)
+{
+    auto parts = std::make_shared<PrefixParts>();
+    parts->prefix = NetworkString(prefixBytes, decoder);
+    if (prefixBytes.isNull())
+        return parts;
+
+    // (Start searching at 1, so that a nick can't be empty.)
+    const int len = prefixBytes.length();
+    const int posBang = prefixBytes.indexOf('!', 1);
+    const int posAt   = prefixBytes.indexOf('@', posBang > 0 ? posBang + 1 : 1);
+
+    int nickEnd = len;
+    if (posBang > 0)
+        nickEnd = posBang;
+    else if (posAt > 0)
+        nickEnd = posAt;
+
+    parts->nick = nickEnd == len ? parts->prefix : NetworkString(prefixBytes.left(nickEnd), decoder);
+    if (posBang > 0) {
+        const int userEnd = posAt > 0 ? posAt : len;
+        parts->user = NetworkString(prefixBytes.mid(posBang + 1, userEnd - (posBang + 1)), decoder);
+    }
+    if (posAt > 0)
+        parts->host = NetworkString(prefixBytes.mid(posAt + 1), decoder);
+
+    return parts;
+}
+
+PrefixCache::parts_ptr PrefixCache::lookup(const QByteArray &prefixBytes, NetworkString::decoder_ptr decoder)
+{
+    if (prefixBytes.isNull()) {
+        // (Messages from the link server; nothing to cache.)
+        static const parts_ptr nullParts = PrefixParts::parse(QByteArray());
+        return nullParts;
+    }
+
+    for (int i = 0; i < size; i++) {
+        const parts_ptr &entry(_entries[i]);
+        if (!entry)
+            break;
+
+        if (entry->prefix.bytes() != prefixBytes || entry->prefix.decoder() != decoder)
+            continue;
+
+        // Hit; move to front.
+        parts_ptr found = entry;
+        for (int j = i; j > 0; j--)
+            _entries[j] = std::move(_entries[j - 1]);
+        _entries[0] = found;
+
+        _hits++;
+        return found;
+    }
+
+    // Miss; parse, and replace least recently used.
+    parts_ptr parts = PrefixParts::parse(prefixBytes, decoder);
+    for (int j = size - 1; j > 0; j--)
+        _entries[j] = std::move(_entries[j - 1]);
+    _entries[0] = parts;
+
+    _misses++;
+    return parts;
+}
+
+void PrefixCache::clear()
+{
+    for (int i = 0; i < size; i++)
+        _entries[i].reset();
+}
+
+quint64 PrefixCache::hits() const
+{
+    return _hits;
+}
+
+quint64 PrefixCache::misses() const
+{
+    return _misses;
+}
+
+
+const NetworkString &MessageOrigin::nick() const
+{
+    return parts ? parts->nick : prefix;
+}
+
+const NetworkString &MessageOrigin::user() const
+{
+    static const NetworkString nullString;
+    return parts ? parts->user : nullString;
+}
+
+const NetworkString &MessageOrigin::host() const
+{
+    static const NetworkString nullString;
+    return parts ? parts->host : nullString;
+}
+
+MessageOrigin MessageOrigin::fromPrefix(const NetworkString &prefix, Type onNull)
+{
+    return fromPrefixParts(PrefixParts::parse(prefix.bytes(), prefix.decoder()), onNull);
+}
+
+MessageOrigin MessageOrigin::fromPrefixParts(MessageOrigin::parts_ptr parts, MessageOrigin::Type onNull)
 {
-    return { prefix.isNull() ? onNull : Type::SeePrefix, prefix };
+    if (!parts)
+        throw std::invalid_argument("Message origin from prefix parts: Parts can't be null");
+
+    return { parts->prefix.isNull() ? onNull : Type::SeePrefix, parts->prefix, parts };
 }
 
 MessageOrigin MessageOrigin::fromPrefixBytes(const QByteArray &prefixBytes, const std::function<MessageOrigin::decode_fun> &decoder, MessageOrigin::Type onNull)
 {
-    return fromPrefix(decoder(prefixBytes), onNull);
+    return fromPrefixParts(decoder(prefixBytes), onNull);
 }
 
 MessageOriginType::MessageOriginType(const QString &name, MessageOriginType::decoder_type decoder, MessageOrigin::Type onNullPrefix) :
@@ -194,11 +430,26 @@ MessageArg::~MessageArg()
 
 }
 
-CommandNameMessageArg::CommandNameMessageArg(const QString &commandOrig) :
-    commandOrig(commandOrig),
-    commandUpper(this->commandOrig.toUpper())
+CommandNameMessageArg::CommandNameMessageArg()
+{
+
+}
+
+CommandNameMessageArg::CommandNameMessageArg(const QByteArray &commandOrig) :
+    _commandOrig(commandOrig),
+    _commandUpper(commandOrig.toUpper())
+{
+
+}
+
+const QByteArray &CommandNameMessageArg::commandOrig() const
 {
+    return _commandOrig;
+}
 
+const QByteArray &CommandNameMessageArg::commandUpper() const
+{
+    return _commandUpper;
 }
 
 bool CommandNameMessageArg::operator ==(const MessageArg &other) const
@@ -207,28 +458,59 @@ bool CommandNameMessageArg::operator ==(const MessageArg &other) const
     if (myTypeOther == nullptr)
         return false;
 
-    return commandUpper == myTypeOther->commandUpper;
+    return commandUpper() == myTypeOther->commandUpper();
 }
 
-NumericCommandNameMessageArg::NumericCommandNameMessageArg(const QString &commandOrig) :
-    CommandNameMessageArg(commandOrig)
+NumericCommandNameMessageArg::NumericCommandNameMessageArg(int numeric) :
+    numeric(numeric)
 {
-    if (commandUpper.length() != 3)
-        throw std::invalid_argument("Numeric command name message arg, ctor: Invalid numeric: Length is not 3");
+    if (!(numeric >= 0 && numeric <= 999))
+        throw std::invalid_argument("Numeric command name message arg, ctor: Invalid numeric: Out of range");
+}
 
-    if (!(commandUpper[0].isDigit() && commandUpper[1].isDigit() && commandUpper[2].isDigit()))
+NumericCommandNameMessageArg::NumericCommandNameMessageArg(const QByteArray &commandOrig) :
+    numeric(parseNumeric(commandOrig))
+{
+    if (numeric < 0)
         throw std::invalid_argument("Numeric command name message arg, ctor: Invalid numeric: Must be 3 digits");
+}
+
+const QByteArray &NumericCommandNameMessageArg::commandOrig() const
+{
+    if (_commandRendered.isNull()) {
+        char digits[3] = {
+            char('0' + numeric / 100),
+            char('0' + numeric / 10 % 10),
+            char('0' + numeric % 10),
+        };
+        _commandRendered = QByteArray(digits, 3);
+    }
+
+    return _commandRendered;
+}
 
-    QString copy = commandUpper;
-    if (copy.startsWith("0"))
-        copy.remove(0, 1);
-    if (copy.startsWith("0"))
-        copy.remove(0, 1);
+const QByteArray &NumericCommandNameMessageArg::commandUpper() const
+{
+    return commandOrig();
+}
+
+int NumericCommandNameMessageArg::parseNumeric(const char *data, int len)
+{
+    if (data == nullptr || len != 3)
+        return -1;
+
+    const unsigned d0 = static_cast<unsigned char>(data[0]) - '0';
+    const unsigned d1 = static_cast<unsigned char>(data[1]) - '0';
+    const unsigned d2 = static_cast<unsigned char>(data[2]) - '0';
+    if (d0 > 9 || d1 > 9 || d2 > 9)
+        return -1;
 
-    bool ok = false;
-    numeric = copy.toInt(&ok);
-    if (!ok)
-        throw std::invalid_argument("Numeric command name message arg, ctor: Invalid numeric: Conversion to int failed");
+    return int(d0 * 100 + d1 * 10 + d2);
+}
+
+int NumericCommandNameMessageArg::parseNumeric(const QByteArray &token)
+{
+    return parseNumeric(token.constData(), token.length());
 }
 
 bool NumericCommandNameMessageArg::operator ==(const MessageArg &other) const
@@ -255,7 +537,7 @@ bool UnrecognizedMessageArg::operator ==(const MessageArg &other) const
     return token == myTypeOther->token;
 }
 
-SourceMessageArg::SourceMessageArg(const QString &source) :
+SourceMessageArg::SourceMessageArg(const NetworkString &source) :
     source(source)
 {
 
@@ -270,7 +552,7 @@ bool SourceMessageArg::operator ==(const MessageArg &other) const
     return source == myTypeOther->source;
 }
 
-ChannelTargetMessageArg::ChannelTargetMessageArg(const QString &channel) :
+ChannelTargetMessageArg::ChannelTargetMessageArg(const NetworkString &channel) :
     channel(channel)
 {
 
@@ -278,7 +560,7 @@ ChannelTargetMessageArg::ChannelTargetMessageArg(const QString &channel) :
 
 QString ChannelTargetMessageArg::targetToString() const
 {
-    return channel;
+    return channel.toString();
 }
 
 bool ChannelTargetMessageArg::operator ==(const MessageArg &other) const
@@ -290,7 +572,7 @@ bool ChannelTargetMessageArg::operator ==(const MessageArg &other) const
     return channel == myTypeOther->channel;
 }
 
-NickTargetMessageArg::NickTargetMessageArg(const QString &nick) :
+NickTargetMessageArg::NickTargetMessageArg(const NetworkString &nick) :
     nick(nick)
 {
 
@@ -298,7 +580,7 @@ NickTargetMessageArg::NickTargetMessageArg(const QString &nick) :
 
 QString NickTargetMessageArg::targetToString() const
 {
-    return nick;
+    return nick.toString();
 }
 
 bool NickTargetMessageArg::operator ==(const MessageArg &other) const
@@ -310,7 +592,7 @@ bool NickTargetMessageArg::operator ==(const MessageArg &other) const
     return nick == myTypeOther->nick;
 }
 
-KeyMessageArg::KeyMessageArg(const QString &key) :
+KeyMessageArg::KeyMessageArg(const NetworkString &key) :
     key(key)
 {
 
@@ -325,7 +607,7 @@ bool KeyMessageArg::operator ==(const MessageArg &other) const
     return key == myTypeOther->key;
 }
 
-ChatterDataMessageArg::ChatterDataMessageArg(const QString &chatterData) :
+ChatterDataMessageArg::ChatterDataMessageArg(const NetworkString &chatterData) :
     chatterData(chatterData)
 {
 
@@ -361,34 +643,69 @@ const QList<MessageType::msgArgType_ptr> &MessageType::argTypes() const
     return _argTypes;
 }
 
-QList<Message::msgArg_ptr> MessageType::argsFromMessageAsTokens(const MessageAsTokens &msgTokens) const
+bool MessageType::tryArgsFromMessageAsTokens(const MessageAsTokens &msgTokens, QList<Message::msgArg_ptr> *args, ParseDiagnostic *diag) const
 {
-    QList<Message::msgArg_ptr> ret;
-    TokensReader reader(msgTokens);
+    if (args == nullptr || diag == nullptr)
+        throw std::invalid_argument("Message type, try args from message as tokens: Args and diag can't be null");
 
-    try {
-        for (std::shared_ptr<MessageArgTypeBase> argType : _argTypes) {
-            ret.append(argType->fromTokensUnsafe_call()(&reader));
+    TokensReader reader(msgTokens);
+    const int count = _argTypes.length();
+    args->reserve(args->length() + count);
+
+    for (int i = 0; i < count; i++) {
+        Message::msgArg_ptr arg = _argTypes[i]->fromTokensUnsafe_call()(&reader);
+        if (reader.hasError()) {
+            diag->error = reader.error();
+            diag->argIndex = i;
+            return false;
         }
 
-        if (!reader.atEnd())
-            throw std::runtime_error("Trailing arguments, that is, more arguments than we had syntax for");
+        args->append(arg);
     }
-    catch (const std::exception &ex) {
-        throw std::runtime_error(std::string("Message type \"") + qPrintable(_name) + "\": Message tokens failed to convert to type, error: " +
-                                 ex.what());
+
+    if (!reader.atEnd()) {
+        diag->error = ParseError::TrailingTokens;
+        diag->argIndex = -1;
+        return false;
     }
 
-    return ret;
+    *diag = ParseDiagnostic();
+    return true;
 }
 
-std::shared_ptr<Message> MessageType::fromMessageAsTokens(const MessageAsTokens &msgTokens) const
+std::shared_ptr<Message> MessageType::tryFromMessageAsTokens(const MessageAsTokens &msgTokens, ParseDiagnostic *diag) const
 {
+    QList<Message::msgArg_ptr> args;
+    if (!tryArgsFromMessageAsTokens(msgTokens, &args, diag))
+        return nullptr;
+
+    // (Only bother with the origin once the rest is known to be fine.)
     MessageOrigin origin = _originType->fromPrefixBytes(msgTokens.prefix);
-    QList<Message::msgArg_ptr> args = argsFromMessageAsTokens(msgTokens);
     return std::make_shared<Message>(origin, args);
 }
 
+QList<Message::msgArg_ptr> MessageType::argsFromMessageAsTokens(const MessageAsTokens &msgTokens) const
+{
+    QList<Message::msgArg_ptr> ret;
+    ParseDiagnostic diag;
+    if (!tryArgsFromMessageAsTokens(msgTokens, &ret, &diag))
+        throw std::runtime_error(std::string("Message type \"") + qPrintable(_name) + "\": Message tokens failed to convert to type, error: " +
+                                 qPrintable(diag.toString()));
+
+    return ret;
+}
+
+std::shared_ptr<Message> MessageType::fromMessageAsTokens(const MessageAsTokens &msgTokens) const
+{
+    ParseDiagnostic diag;
+    std::shared_ptr<Message> msg = tryFromMessageAsTokens(msgTokens, &diag);
+    if (!msg)
+        throw std::runtime_error(std::string("Message type \"") + qPrintable(_name) + "\": Message tokens failed to convert to type, error: " +
+                                 qPrintable(diag.toString()));
+
+    return msg;
+}
+
 std::shared_ptr<MessageType> MessageType::make_shared(const QString &name, MessageType::originType_ptr originType, const QList<MessageType::msgArgType_ptr> &argTypes)
 {
     return std::make_shared<MessageType>(name, originType, argTypes);
@@ -396,14 +713,35 @@ std::shared_ptr<MessageType> MessageType::make_shared(const QString &name, Messa
 
 void MessageTypeVocabulary::registerMessageType(const QString &commandName, std::shared_ptr<MessageType> msgType)
 {
-    _map.insert(commandName.toUpper(), msgType);
+    const QByteArray commandUpper = commandName.toUpper().toLatin1();
+
+    // Keep numerics apart, so that they can be looked up by number.
+    const int numeric = NumericCommandNameMessageArg::parseNumeric(commandUpper);
+    if (numeric >= 0)
+        _numericMap.insert(numeric, msgType);
+    else
+        _map.insert(commandUpper, msgType);
 }
 
 std::shared_ptr<MessageType> MessageTypeVocabulary::messageType(const QString &commandName)
 {
+    return messageType(commandName.toLatin1());
+}
+
+std::shared_ptr<MessageType> MessageTypeVocabulary::messageType(const QByteArray &commandName)
+{
+    const int numeric = NumericCommandNameMessageArg::parseNumeric(commandName);
+    if (numeric >= 0)
+        return numericMessageType(numeric);
+
     return _map.value(commandName.toUpper());
 }
 
+std::shared_ptr<MessageType> MessageTypeVocabulary::numericMessageType(int numeric)
+{
+    return _numericMap.value(numeric);
+}
+
 
 Message::Message(const MessageOrigin &origin, const QList<Message::msgArg_ptr> args) :
     origin(origin), args(args)
@@ -9,6 +9,8 @@
 #include <QString>
 #include <QStringList>
 #include <QMap>
+#include <QHash>
+#include "ircprotostring.h"
 
 namespace cvnirc   {
 namespace core     {  // cvnirc::core
@@ -22,6 +24,38 @@ public:
     class MessageAsTokens parse() const;
 };
 
+// Splits the byte stream received from the server into CR/LF-terminated lines.
+class CVNIRCCORESHARED_EXPORT LineFramer
+{
+public:
+    enum class Error {
+        None,
+        NulByte,
+        BrokenLineTermination,  // Stray CR or LF.
+        LineTooLong,
+    };
+
+    static const int maxBufferedLength = 1*1024*1024;
+
+private:
+    QByteArray _buf;
+    int        _pos = 0;  // (Start of what hasn't been taken, yet.)
+    Error      _error = Error::None;
+
+public:
+    void append(const char *data, int len);
+    void append(const QByteArray &data);
+
+    // Returns false when no complete line is left, or on error.
+    // (After an error, the stream can't be trusted any longer;
+    // it stays set until clear().)
+    bool takeLine(MessageOnNetwork *line);
+
+    Error error() const;
+    int bufferedLength() const;
+    void clear();
+};
+
 class CVNIRCCORESHARED_EXPORT MessageAsTokens
 {
 public:
@@ -31,9 +65,35 @@ public:
     MessageOnNetwork pack() const;
 };
 
+// What went wrong while converting message tokens to a message.
+//
+// Malformed traffic is a fact of life on IRC, so it gets reported this way
+// instead of via exceptions; those are kept for actual programming errors.
+enum class ParseError {
+    None,
+    MissingToken,     // Fewer arguments than the syntax requires.
+    MissingByte,
+    ConstMismatch,    // Argument isn't the fixed value the syntax requires.
+    InvalidNumeric,   // Command isn't exactly 3 digits.
+    TrailingTokens,   // More arguments than we had syntax for.
+};
+
+CVNIRCCORESHARED_EXPORT const char *parseErrorToString(ParseError error);
+
+class CVNIRCCORESHARED_EXPORT ParseDiagnostic
+{
+public:
+    ParseError error = ParseError::None;
+    int argIndex = -1;  // (Arg type the error occurred in, if any.)
+
+    bool ok() const;
+    QString toString() const;
+};
+
 class CVNIRCCORESHARED_EXPORT TokensReader
 {
     QByteArrayList _remainingTokens;
+    ParseError _error = ParseError::None;
 
 public:
     TokensReader(const QByteArrayList &tokens);
@@ -45,8 +105,15 @@ public:
     bool isByteAvailable() const;
     bool isTokenAvailable() const;
 
+    // (These don't throw; when nothing is available, they record an error
+    // and return a null byte/token. Arg types are expected to check.)
     char takeByte();
     QByteArray takeToken();
+
+    // The first error recorded; later ones get ignored.
+    ParseError error() const;
+    bool hasError() const;
+    void setError(ParseError error);
 };
 
 
@@ -71,10 +138,46 @@ public:
 };
 
 
+// Message prefix, split up into nick!user@host.
+//
+// This gets parsed once per distinct prefix (see PrefixCache),
+// and is then shared by every message (and consumer) with that prefix.
+class CVNIRCCORESHARED_EXPORT PrefixParts
+{
+public:
+    NetworkString  prefix;
+    NetworkString  nick;  // (Full prefix, for a server name.)
+    NetworkString  user;  // (Null if not present.)
+    NetworkString  host;  // (Null if not present.)
+
+    static std::shared_ptr<const PrefixParts> parse(const QByteArray &prefixBytes, NetworkString::decoder_ptr decoder = nullptr);
+};
+
+// Remembers the last few distinct prefixes seen,
+// as chatter tends to come from the same few senders in a row.
+class CVNIRCCORESHARED_EXPORT PrefixCache
+{
+public:
+    typedef std::shared_ptr<const PrefixParts>  parts_ptr;
+    static const int size = 8;
+
+private:
+    parts_ptr _entries[size];  // (Most recently used first.)
+    quint64 _hits = 0, _misses = 0;
+
+public:
+    parts_ptr lookup(const QByteArray &prefixBytes, NetworkString::decoder_ptr decoder);
+    void clear();
+
+    quint64 hits() const;
+    quint64 misses() const;
+};
+
 class CVNIRCCORESHARED_EXPORT MessageOrigin
 {
 public:
-    typedef QString (decode_fun)(const QByteArray &prefixBytes);
+    typedef std::shared_ptr<const PrefixParts>  parts_ptr;
+    typedef parts_ptr (decode_fun)(const QByteArray &prefixBytes);
 
     enum class Type {
         LinkServer,
@@ -82,10 +185,16 @@ public:
         SeePrefix,
     };
 
-    Type     type;
-    QString  prefix;
+    Type           type;
+    NetworkString  prefix;
+    parts_ptr      parts;
 
-    static MessageOrigin fromPrefix(const QString &prefix, Type onNull = Type::SeePrefix);
+    const NetworkString &nick() const;
+    const NetworkString &user() const;
+    const NetworkString &host() const;
+
+    static MessageOrigin fromPrefix(const NetworkString &prefix, Type onNull = Type::SeePrefix);
+    static MessageOrigin fromPrefixParts(parts_ptr parts, Type onNull = Type::SeePrefix);
     static MessageOrigin fromPrefixBytes(const QByteArray &prefixBytes, const std::function<decode_fun> &decoder, Type onNull = Type::SeePrefix);
 };
 
@@ -191,8 +300,13 @@ private:
     messageArg_ptr _fromTokens(TokensReader *reader) const
     {
         messageArg_ptr arg = _wrappedType->fromTokens_call()(reader);
-        if (!(*arg == *_constArg))
-            throw std::runtime_error("Const message arg type: The retrieved message arg isn't equal to the const/reference arg");
+        if (!arg || reader->hasError())
+            return nullptr;
+
+        if (!(*arg == *_constArg)) {
+            reader->setError(ParseError::ConstMismatch);
+            return nullptr;
+        }
 
         return arg;
     }
@@ -256,12 +370,13 @@ std::shared_ptr<OptionalMessageArgType<T>> make_optional(const QString &name, st
 }
 
 template <class A> class ListMessageArg;
+template <class A> class CommaListMessageArg;
 
 template <class T = MessageArgType<>>
-class CVNIRCCORESHARED_EXPORT CommaListMessageArgType : public MessageArgType<ListMessageArg<typename T::messageArg_type>>
+class CVNIRCCORESHARED_EXPORT CommaListMessageArgType : public MessageArgType<CommaListMessageArg<typename T::messageArg_type>>
 {
 public:
-    typedef MessageArgType<ListMessageArg<typename T::messageArg_type>>  base_type;
+    typedef MessageArgType<CommaListMessageArg<typename T::messageArg_type>>  base_type;
     typedef typename base_type::messageArg_type  listMsgArg_type;
     typedef typename base_type::messageArg_ptr   listMsgArg_ptr;
     typedef typename base_type::fromTokens_fun   listFromTokens_fun;
@@ -288,15 +403,8 @@ public:
 
     listMsgArg_ptr listFromTokens(TokensReader *reader) const
     {
-        auto ret = std::make_shared<listMsgArg_type>();
-        QByteArrayList elementsBytes = reader->takeToken().split(',');
-        TokensReader innerReader(elementsBytes);
-        while (!innerReader.atEnd()) {
-            ret->list.append(
-                _elementType->fromTokens_call()(&innerReader)
-            );
-        }
-        return ret;
+        // (Elements will be split off the token only when needed.)
+        return std::make_shared<listMsgArg_type>(reader->takeToken(), _elementType);
     }
 };
 
@@ -316,23 +424,39 @@ public:
 
 class CVNIRCCORESHARED_EXPORT CommandNameMessageArg : public MessageArg
 {
+    QByteArray _commandOrig;
+    QByteArray _commandUpper;
+
+protected:
+    CommandNameMessageArg();
+
 public:
-    QString commandOrig;
-    QString commandUpper;
+    explicit CommandNameMessageArg(const QByteArray &commandOrig);
 
-    CommandNameMessageArg(const QString &commandOrig);
+    virtual const QByteArray &commandOrig() const;
+    virtual const QByteArray &commandUpper() const;
 
     bool operator ==(const MessageArg &other) const override;
 };
 
 class CVNIRCCORESHARED_EXPORT NumericCommandNameMessageArg : public CommandNameMessageArg
 {
+    mutable QByteArray _commandRendered;  // (Only on request.)
+
 public:
     int numeric;
 
-    NumericCommandNameMessageArg(const QString &commandOrig);
+    explicit NumericCommandNameMessageArg(int numeric);
+    explicit NumericCommandNameMessageArg(const QByteArray &commandOrig);
+
+    const QByteArray &commandOrig() const override;
+    const QByteArray &commandUpper() const override;
 
     bool operator ==(const MessageArg &other) const override;
+
+    // Returns the numeric, or -1 if this is not exactly 3 digits.
+    static int parseNumeric(const char *data, int len);
+    static int parseNumeric(const QByteArray &token);
 };
 
 class CVNIRCCORESHARED_EXPORT UnrecognizedMessageArg : public MessageArg
@@ -348,9 +472,9 @@ public:
 class CVNIRCCORESHARED_EXPORT SourceMessageArg : public MessageArg
 {
 public:
-    QString source;
+    NetworkString source;
 
-    SourceMessageArg(const QString &source);
+    SourceMessageArg(const NetworkString &source);
 
     bool operator ==(const MessageArg &other) const override;
 };
@@ -364,9 +488,9 @@ public:
 class CVNIRCCORESHARED_EXPORT ChannelTargetMessageArg : public TargetMessageArg
 {
 public:
-    QString channel;
+    NetworkString channel;
 
-    ChannelTargetMessageArg(const QString &channel);
+    ChannelTargetMessageArg(const NetworkString &channel);
 
     QString targetToString() const override;
     bool operator ==(const MessageArg &other) const override;
@@ -375,9 +499,9 @@ public:
 class CVNIRCCORESHARED_EXPORT NickTargetMessageArg : public TargetMessageArg
 {
 public:
-    QString nick;
+    NetworkString nick;
 
-    NickTargetMessageArg(const QString &nick);
+    NickTargetMessageArg(const NetworkString &nick);
 
     QString targetToString() const override;
     bool operator ==(const MessageArg &other) const override;
@@ -386,9 +510,9 @@ public:
 class CVNIRCCORESHARED_EXPORT KeyMessageArg : public MessageArg
 {
 public:
-    QString key;
+    NetworkString key;
 
-    KeyMessageArg(const QString &key);
+    KeyMessageArg(const NetworkString &key);
 
     bool operator ==(const MessageArg &other) const override;
 };
@@ -396,9 +520,9 @@ public:
 class CVNIRCCORESHARED_EXPORT ChatterDataMessageArg : public MessageArg
 {
 public:
-    QString chatterData;
+    NetworkString chatterData;
 
-    ChatterDataMessageArg(const QString &chatterData);
+    ChatterDataMessageArg(const NetworkString &chatterData);
 
     bool operator ==(const MessageArg &other) const override;
 };
@@ -410,38 +534,116 @@ public:
     typedef A                   elementMsgArg_type;
     typedef std::shared_ptr<A>  elementMsgArg_ptr;
 
-    QList<elementMsgArg_ptr>  list;
+protected:
+    mutable QList<elementMsgArg_ptr>  _list;
 
+public:
     ListMessageArg()
     {
 
     }
 
     ListMessageArg(const QList<elementMsgArg_ptr> &list) :
-        list(list)
+        _list(list)
     {
 
     }
 
+    virtual const QList<elementMsgArg_ptr> &list() const
+    {
+        return _list;
+    }
+
+    void append(const elementMsgArg_ptr &element)
+    {
+        list();  // (Make sure lazy elements are there first.)
+        _list.append(element);
+    }
+
     bool operator ==(const MessageArg &other) const override
     {
         const auto *myTypeOther = dynamic_cast<const ListMessageArg*>(&other);
         if (myTypeOther == nullptr)
             return false;
 
-        int len = list.length();
-        int otherLen = myTypeOther->list.length();
+        const QList<elementMsgArg_ptr> &myList(list());
+        const QList<elementMsgArg_ptr> &otherList(myTypeOther->list());
+        int len = myList.length();
+        int otherLen = otherList.length();
         if (len != otherLen)
             return false;
 
         for (int i = 0; i < len; i++) {
-            if (!(*list[i] == *myTypeOther->list[i]))
+            if (!(*myList[i] == *otherList[i]))
                 return false;
         }
         return true;
     }
 };
 
+// List from a single comma-separated token, like "#a,#b,#c".
+//
+// The elements can be iterated over as slices of the original token;
+// element objects only get created when list() is asked for.
+template <class A>
+class CVNIRCCORESHARED_EXPORT CommaListMessageArg : public ListMessageArg<A>
+{
+public:
+    typedef ListMessageArg<A>  base_type;
+    using typename base_type::elementMsgArg_ptr;
+    typedef std::shared_ptr<MessageArgType<A>>  elementType_ptr;
+
+private:
+    QByteArray       _token;
+    elementType_ptr  _elementType;
+    mutable bool     _materialized = false;
+
+public:
+    CommaListMessageArg(const QByteArray &token, elementType_ptr elementType) :
+        _token(token), _elementType(elementType)
+    {
+
+    }
+
+    const QByteArray &token() const
+    {
+        return _token;
+    }
+
+    int count() const
+    {
+        return _token.count(',') + 1;
+    }
+
+    // Calls f(const char *data, int len) for each element.
+    template <typename F>
+    void forEachSlice(F f) const
+    {
+        const char *data = _token.constData();
+        const int len = _token.length();
+        int start = 0;
+        for (int i = 0; i <= len; i++) {
+            if (i == len || data[i] == ',') {
+                f(data + start, i - start);
+                start = i + 1;
+            }
+        }
+    }
+
+    const QList<elementMsgArg_ptr> &list() const override
+    {
+        if (!_materialized) {
+            _materialized = true;
+            forEachSlice([this](const char *data, int len) {
+                TokensReader elementReader(QByteArrayList { QByteArray(data, len) });
+                this->_list.append(_elementType->fromTokens_call()(&elementReader));
+            });
+        }
+
+        return this->_list;
+    }
+};
+
 class CVNIRCCORESHARED_EXPORT MessageArgTypesHolder
 {
 public:
@@ -501,6 +703,11 @@ public:
     originType_ptr originType() const;
     const QList<msgArgType_ptr> &argTypes() const;
 
+    // Non-throwing; on malformed tokens, these return false/null and fill in diag.
+    bool tryArgsFromMessageAsTokens(const MessageAsTokens &msgTokens, QList<Message::msgArg_ptr> *args, ParseDiagnostic *diag) const;
+    std::shared_ptr<Message> tryFromMessageAsTokens(const MessageAsTokens &msgTokens, ParseDiagnostic *diag) const;
+
+    // Same as above, but throwing std::runtime_error on malformed tokens.
     QList<Message::msgArg_ptr> argsFromMessageAsTokens(const MessageAsTokens &msgTokens) const;
     std::shared_ptr<Message> fromMessageAsTokens(const MessageAsTokens &msgTokens) const;
 
@@ -509,11 +716,14 @@ public:
 
 class CVNIRCCORESHARED_EXPORT MessageTypeVocabulary
 {
-    QMap<QString, std::shared_ptr<MessageType>> _map;
+    QHash<QByteArray, std::shared_ptr<MessageType>> _map;
+    QHash<int, std::shared_ptr<MessageType>> _numericMap;
 
 public:
     void registerMessageType(const QString &commandName, std::shared_ptr<MessageType> msgType);
     std::shared_ptr<MessageType> messageType(const QString &commandName);
+    std::shared_ptr<MessageType> messageType(const QByteArray &commandName);
+    std::shared_ptr<MessageType> numericMessageType(int numeric);
 };
 
 }  // namespace cvnirc::core::IRCProto
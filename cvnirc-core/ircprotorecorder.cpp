@@ -0,0 +1,330 @@
+#include "ircprotorecorder.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtEndian>
+#include <chrono>
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+const char TrafficCapture::magic[8] = { 'C', 'V', 'N', 'I', 'R', 'C', 'C', '1' };
+
+template <typename T>
+static void appendLittleEndian(QByteArray *out, T value)
+{
+    uchar buf[sizeof(T)];
+    qToLittleEndian<T>(value, buf);
+    out->append(reinterpret_cast<const char *>(buf), int(sizeof(T)));
+}
+
+template <typename T>
+static T readLittleEndian(const char *data)
+{
+    return qFromLittleEndian<T>(reinterpret_cast<const uchar *>(data));
+}
+
+bool TrafficCapture::isCapture(const QByteArray &data)
+{
+    return data.length() >= headerSize && memcmp(data.constData(), magic, sizeof(magic)) == 0;
+}
+
+bool TrafficCapture::fromBytes(const QByteArray &data, TrafficCapture *capture, QString *errorString)
+{
+    if (capture == nullptr)
+        throw std::invalid_argument("Traffic capture from bytes: Capture can't be null");
+
+    if (!isCapture(data)) {
+        if (errorString != nullptr)
+            *errorString = "Not a traffic capture (bad magic)";
+        return false;
+    }
+
+    const char *p = data.constData();
+    const int len = data.length();
+    capture->wallclockStartMSecs = readLittleEndian<qint64>(p + 8);
+    capture->monotonicStartNSecs = readLittleEndian<quint64>(p + 16);
+    capture->records.clear();
+
+    // (On error, the records read so far are kept; a recording cut short
+    // by a crash is still worth looking at.)
+    int pos = headerSize;
+    while (pos < len) {
+        if (len - pos < recordHeaderSize) {
+            if (errorString != nullptr)
+                *errorString = "Truncated record header at offset " + QString::number(pos);
+            return false;
+        }
+
+        TrafficRecord record;
+        record.nsecs = readLittleEndian<quint64>(p + pos);
+        const quint8 direction = quint8(p[pos + 8]);
+        const quint32 recordLen = readLittleEndian<quint32>(p + pos + 9);
+        if (direction > quint8(TrafficRecord::Direction::Sent)) {
+            if (errorString != nullptr)
+                *errorString = "Invalid direction in record at offset " + QString::number(pos);
+            return false;
+        }
+        if (quint32(len - pos - recordHeaderSize) < recordLen) {
+            if (errorString != nullptr)
+                *errorString = "Truncated record at offset " + QString::number(pos);
+            return false;
+        }
+
+        record.direction = TrafficRecord::Direction(direction);
+        record.bytes = QByteArray(p + pos + recordHeaderSize, int(recordLen));
+        capture->records.append(record);
+        pos += recordHeaderSize + int(recordLen);
+    }
+
+    return true;
+}
+
+QByteArray TrafficCapture::toBytes() const
+{
+    QByteArray ret = headerBytes(wallclockStartMSecs, monotonicStartNSecs);
+    for (const TrafficRecord &record : records) {
+        appendLittleEndian<quint64>(&ret, record.nsecs);
+        ret.append(char(record.direction));
+        appendLittleEndian<quint32>(&ret, quint32(record.bytes.length()));
+        ret.append(record.bytes);
+    }
+    return ret;
+}
+
+QByteArray TrafficCapture::receivedStream() const
+{
+    QByteArray ret;
+    for (const TrafficRecord &record : records) {
+        if (record.direction == TrafficRecord::Direction::Received)
+            ret.append(record.bytes);
+    }
+    return ret;
+}
+
+QByteArray TrafficCapture::headerBytes(qint64 wallclockStartMSecs, quint64 monotonicStartNSecs)
+{
+    QByteArray ret(magic, sizeof(magic));
+    appendLittleEndian<qint64>(&ret, wallclockStartMSecs);
+    appendLittleEndian<quint64>(&ret, monotonicStartNSecs);
+    return ret;
+}
+
+quint64 TrafficCapture::monotonicNSecs()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return quint64(ts.tv_sec) * 1000 * 1000 * 1000 + quint64(ts.tv_nsec);
+#else
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+
+    return quint64(timer.nsecsElapsed());
+#endif
+}
+
+
+static size_t roundUpToPowerOfTwo(size_t size)
+{
+    size_t ret = 64 * 1024;
+    while (ret < size)
+        ret *= 2;
+    return ret;
+}
+
+TrafficRecorder::TrafficRecorder(size_t ringSize) :
+    _ringSize(roundUpToPowerOfTwo(ringSize)),
+    _head(0), _tail(0), _recorded(0), _dropped(0), _stopping(false), _writeFailed(false)
+{
+
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    stop();
+}
+
+bool TrafficRecorder::start(const QString &fileName, QString *errorString)
+{
+    stop();
+
+    FILE *file = fopen(QFile::encodeName(fileName).constData(), "wb");
+    if (file == nullptr) {
+        if (errorString != nullptr)
+            *errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    const QByteArray header = TrafficCapture::headerBytes(QDateTime::currentMSecsSinceEpoch(), TrafficCapture::monotonicNSecs());
+    if (fwrite(header.constData(), 1, size_t(header.length()), file) != size_t(header.length())) {
+        if (errorString != nullptr)
+            *errorString = QString::fromLocal8Bit(strerror(errno));
+        fclose(file);
+        return false;
+    }
+
+    // (Only allocated once actually needed.)
+    if (!_ring)
+        _ring.reset(new char[_ringSize]);
+
+    _file = file;
+    _fileName = fileName;
+    _head = 0;
+    _tail = 0;
+    _recorded = 0;
+    _dropped = 0;
+    _stopping = false;
+    _writeFailed = false;
+    _writeErrno = 0;
+    _writer = std::thread(&TrafficRecorder::_writerLoop, this);
+    return true;
+}
+
+void TrafficRecorder::stop()
+{
+    if (!_writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        _stopping = true;
+    }
+    _writerWakeup.notify_one();
+    _writer.join();
+
+    fclose(_file);
+    _file = nullptr;
+    _writeFailed = false;  // (Reported by now, if anybody asked.)
+}
+
+bool TrafficRecorder::isRecording() const
+{
+    return _file != nullptr && !_writeFailed.load(std::memory_order_relaxed);
+}
+
+const QString &TrafficRecorder::fileName() const
+{
+    return _fileName;
+}
+
+bool TrafficRecorder::writeFailed() const
+{
+    return _writeFailed.load(std::memory_order_relaxed);
+}
+
+QString TrafficRecorder::errorString() const
+{
+    if (!_writeFailed.load(std::memory_order_acquire))
+        return QString();
+
+    return QString::fromLocal8Bit(strerror(_writeErrno));
+}
+
+void TrafficRecorder::record(TrafficRecord::Direction direction, const char *data, int len)
+{
+    if (_file == nullptr || len < 0)
+        return;
+
+    if (_writeFailed.load(std::memory_order_relaxed)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const quint64 head = _head.load(std::memory_order_relaxed);
+    const quint64 tail = _tail.load(std::memory_order_acquire);
+    const size_t total = size_t(TrafficCapture::recordHeaderSize) + size_t(len);
+    if (total > _ringSize - size_t(head - tail)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uchar header[TrafficCapture::recordHeaderSize];
+    qToLittleEndian<quint64>(TrafficCapture::monotonicNSecs(), header);
+    header[8] = uchar(direction);
+    qToLittleEndian<quint32>(quint32(len), header + 9);
+
+    _copyIn(head, header, sizeof(header));
+    _copyIn(head + sizeof(header), data, size_t(len));
+    _head.store(head + total, std::memory_order_release);
+    _recorded.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TrafficRecorder::record(TrafficRecord::Direction direction, const QByteArray &bytes)
+{
+    record(direction, bytes.constData(), bytes.length());
+}
+
+quint64 TrafficRecorder::recordedCount() const
+{
+    return _recorded.load(std::memory_order_relaxed);
+}
+
+quint64 TrafficRecorder::droppedCount() const
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+void TrafficRecorder::_copyIn(quint64 pos, const void *data, size_t len)
+{
+    const size_t offset = size_t(pos & (_ringSize - 1));
+    const size_t first = qMin(len, _ringSize - offset);
+    memcpy(_ring.get() + offset, data, first);
+    memcpy(_ring.get(), static_cast<const char *>(data) + first, len - first);
+}
+
+void TrafficRecorder::_writerLoop()
+{
+    for (;;) {
+        // (Look at the flag first, so that a final drain catches everything.)
+        const bool stopping = _stopping.load();
+        if (!_drain()) {
+            // (Whatever comes after would be missing lines; end it here.)
+            _writeFailed.store(true, std::memory_order_release);
+            break;
+        }
+        if (stopping)
+            break;
+
+        // Nobody wakes us for new data; polling keeps record() cheap.
+        std::unique_lock<std::mutex> lock(_writerMutex);
+        _writerWakeup.wait_for(lock, std::chrono::milliseconds(100), [this]() { return _stopping.load(); });
+    }
+}
+
+bool TrafficRecorder::_drain()
+{
+    quint64 tail = _tail.load(std::memory_order_relaxed);
+    const quint64 head = _head.load(std::memory_order_acquire);
+    if (tail == head)
+        return true;
+
+    bool ok = true;
+    while (ok && tail != head) {
+        const size_t offset = size_t(tail & (_ringSize - 1));
+        const size_t chunk = qMin(size_t(head - tail), _ringSize - offset);
+        if (fwrite(_ring.get() + offset, 1, chunk, _file) != chunk) {
+            _writeErrno = errno;
+            ok = false;
+        }
+        tail += chunk;
+    }
+    _tail.store(tail, std::memory_order_release);
+
+    if (ok && fflush(_file) != 0) {
+        _writeErrno = errno;
+        ok = false;
+    }
+    return ok;
+}
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
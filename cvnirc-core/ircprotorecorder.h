@@ -0,0 +1,114 @@
+#ifndef IRCPROTORECORDER_H
+#define IRCPROTORECORDER_H
+
+#include "cvnirc-core_global.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+// Traffic capture file format (all integers little-endian):
+//
+//   Header:  8 bytes magic "CVNIRCC1",
+//            u64 wall clock at start (ms since epoch),
+//            u64 monotonic clock at start (ns).
+//   Records: u64 monotonic clock (ns), u8 direction, u32 length, bytes.
+//
+// The bytes are the line as on the wire, including CR/LF.
+class CVNIRCCORESHARED_EXPORT TrafficRecord
+{
+public:
+    enum class Direction : quint8 {
+        Received = 0,
+        Sent     = 1,
+    };
+
+    quint64    nsecs = 0;
+    Direction  direction = Direction::Received;
+    QByteArray bytes;
+};
+
+class CVNIRCCORESHARED_EXPORT TrafficCapture
+{
+public:
+    static const char magic[8];
+    static const int headerSize = 8 + 8 + 8;
+    static const int recordHeaderSize = 8 + 1 + 4;
+
+    qint64  wallclockStartMSecs = 0;
+    quint64 monotonicStartNSecs = 0;
+    QList<TrafficRecord> records;
+
+    static bool isCapture(const QByteArray &data);
+    static bool fromBytes(const QByteArray &data, TrafficCapture *capture, QString *errorString = nullptr);
+    QByteArray toBytes() const;
+
+    // Received bytes only, concatenated; i.e., what a socket would have delivered.
+    QByteArray receivedStream() const;
+
+    static QByteArray headerBytes(qint64 wallclockStartMSecs, quint64 monotonicStartNSecs);
+    static quint64 monotonicNSecs();
+};
+
+// Records lines to a capture file, from a background writer thread.
+//
+// Recording a line only copies it into a ring buffer; if the writer
+// can't keep up and the ring is full, lines get dropped (and counted)
+// rather than holding up the caller. If writing fails (disk full...),
+// recording ends there; see writeFailed().
+class CVNIRCCORESHARED_EXPORT TrafficRecorder
+{
+    const size_t _ringSize;  // (Power of two.)
+    std::unique_ptr<char[]> _ring;
+    std::atomic<quint64> _head;  // (Written by record().)
+    std::atomic<quint64> _tail;  // (Written by the writer thread.)
+    std::atomic<quint64> _recorded;
+    std::atomic<quint64> _dropped;
+
+    FILE *_file = nullptr;
+    QString _fileName;
+    std::thread _writer;
+    std::mutex _writerMutex;
+    std::condition_variable _writerWakeup;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _writeFailed;
+    int _writeErrno = 0;  // (Set by the writer thread before _writeFailed.)
+
+public:
+    explicit TrafficRecorder(size_t ringSize = 4*1024*1024);
+    ~TrafficRecorder();
+
+    bool start(const QString &fileName, QString *errorString = nullptr);
+    void stop();
+    bool isRecording() const;
+    const QString &fileName() const;
+    bool writeFailed() const;
+    QString errorString() const;
+
+    void record(TrafficRecord::Direction direction, const char *data, int len);
+    void record(TrafficRecord::Direction direction, const QByteArray &bytes);
+
+    quint64 recordedCount() const;
+    quint64 droppedCount() const;
+
+private:
+    void _copyIn(quint64 pos, const void *data, size_t len);
+    void _writerLoop();
+    bool _drain();
+};
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
+
+#endif // IRCPROTORECORDER_H
@@ -0,0 +1,194 @@
+#include "ircprotostats.h"
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+void RateWindow::add(quint64 count, qint64 nowMSecs)
+{
+    const qint64 sec = nowMSecs / 1000;
+    const int i = int(sec % buckets);
+    if (_bucketSecs[i] != sec) {
+        // (Bucket was last used a whole window ago, or earlier.)
+        _bucketSecs[i] = sec;
+        _counts[i] = 0;
+    }
+
+    _counts[i] += count;
+}
+
+double RateWindow::ratePerSec(qint64 nowMSecs) const
+{
+    const qint64 sec = nowMSecs / 1000;
+    quint64 sum = 0;
+    for (int i = 0; i < buckets; i++) {
+        // (Leave out the current, incomplete second.)
+        if (_bucketSecs[i] > sec - buckets && _bucketSecs[i] < sec)
+            sum += _counts[i];
+    }
+
+    return double(sum) / (buckets - 1);
+}
+
+static QString formatBytes(double bytes)
+{
+    if (bytes < 10 * 1024)
+        return QString::number(bytes, 'f', 0) + " B";
+    if (bytes < 10 * 1024 * 1024)
+        return QString::number(bytes / 1024, 'f', 1) + " KiB";
+
+    return QString::number(bytes / 1024 / 1024, 'f', 1) + " MiB";
+}
+
+QStringList TrafficStats::toDisplayLines() const
+{
+    QString setup = "Connection setup: ";
+    if (connectMSecs < 0) {
+        setup += "not connected";
+    }
+    else {
+        setup += "connect " + QString::number(connectMSecs) + " ms";
+        if (tls) {
+            if (tlsHandshakeMSecs < 0)
+                setup += ", TLS handshake not done";
+            else
+                setup += ", TLS handshake " + QString::number(tlsHandshakeMSecs) + " ms (" +
+                    (tlsTicketOffered ? "ticket offered" : "no ticket") + ", " + tlsCipher + ")";
+        }
+    }
+    if (tlsHandshakes != 0)
+        setup += "; " + QString::number(tlsHandshakes) + " TLS handshakes in total, " +
+            QString::number(tlsTicketsOffered) + " with a session ticket offered";
+
+    return {
+        "Received: " + QString::number(linesReceived) + " lines, " + formatBytes(bytesReceived) +
+            " (now " + QString::number(linesReceivedPerSec, 'f', 1) + " lines/s, " + formatBytes(bytesReceivedPerSec) + "/s)",
+        "Sent: " + QString::number(linesSent) + " lines, " + formatBytes(bytesSent) +
+            " (now " + QString::number(linesSentPerSec, 'f', 1) + " lines/s, " + formatBytes(bytesSentPerSec) + "/s)",
+        "Send queue: " + QString::number(sendQueueLines) + " lines, " + formatBytes(sendQueueBytes) +
+            "; socket write buffer: " + formatBytes(socketBytesToWrite),
+        "Errors: " + QString::number(parseErrors) + " malformed messages, " +
+            QString::number(unrecognizedCommands) + " unrecognized commands, " +
+            QString::number(framingErrors) + " framing errors",
+        setup,
+    };
+}
+
+void LagHistogram::record(qint64 usecs)
+{
+    if (usecs < 0)
+        usecs = 0;
+
+    _counts[bucketIndex(usecs)]++;
+    if (_count == 0 || usecs < _minUSecs)
+        _minUSecs = usecs;
+    if (_count == 0 || usecs > _maxUSecs)
+        _maxUSecs = usecs;
+    _count++;
+    _sumUSecs += usecs;
+}
+
+void LagHistogram::clear()
+{
+    *this = LagHistogram();
+}
+
+quint64 LagHistogram::count() const
+{
+    return _count;
+}
+
+qint64 LagHistogram::minUSecs() const
+{
+    return _minUSecs;
+}
+
+qint64 LagHistogram::maxUSecs() const
+{
+    return _maxUSecs;
+}
+
+qint64 LagHistogram::meanUSecs() const
+{
+    return _count == 0 ? 0 : _sumUSecs / qint64(_count);
+}
+
+qint64 LagHistogram::percentileUSecs(double percentile) const
+{
+    if (_count == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(1, quint64(percentile / 100 * _count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < bucketCount; i++) {
+        seen += _counts[i];
+        if (seen >= rank)
+            return qMin(bucketUpperBound(i), _maxUSecs);
+    }
+
+    return _maxUSecs;
+}
+
+QStringList LagHistogram::toDisplayLines() const
+{
+    if (_count == 0)
+        return { "No round-trip times measured, yet." };
+
+    QStringList ret {
+        QString::number(_count) + " round-trip times: min " + formatUSecs(_minUSecs) +
+            ", mean " + formatUSecs(meanUSecs()) + ", max " + formatUSecs(_maxUSecs),
+        "Percentiles: 50% " + formatUSecs(percentileUSecs(50)) +
+            ", 90% " + formatUSecs(percentileUSecs(90)) +
+            ", 99% " + formatUSecs(percentileUSecs(99)),
+    };
+
+    // Non-empty buckets, for a rough picture of the distribution.
+    QString buckets = "Buckets:";
+    for (int i = 0; i < bucketCount; i++) {
+        if (_counts[i] != 0)
+            buckets += " <=" + formatUSecs(bucketUpperBound(i)) + ":" + QString::number(_counts[i]);
+    }
+    ret.append(buckets);
+
+    return ret;
+}
+
+int LagHistogram::bucketIndex(qint64 usecs)
+{
+    if (usecs < exactBuckets)
+        return int(qMax<qint64>(usecs, 0));
+
+    int msb = 5;
+    while (msb < maxMsb && (usecs >> (msb + 1)) != 0)
+        msb++;
+    if ((usecs >> (msb + 1)) != 0)
+        return bucketCount - 1;  // (Off the scale.)
+
+    // Top 5 bits (MSB included) select the sub-bucket.
+    const int sub = int(usecs >> (msb - 4)) - subBuckets;
+    return exactBuckets + (msb - 5) * subBuckets + sub;
+}
+
+qint64 LagHistogram::bucketUpperBound(int index)
+{
+    if (index < exactBuckets)
+        return index;
+
+    const int msb = 5 + (index - exactBuckets) / subBuckets;
+    const int sub = (index - exactBuckets) % subBuckets;
+    return ((qint64(subBuckets + sub + 1)) << (msb - 4)) - 1;
+}
+
+QString LagHistogram::formatUSecs(qint64 usecs)
+{
+    if (usecs < 10 * 1000)
+        return QString::number(usecs / 1000.0, 'f', 2) + " ms";
+    if (usecs < 10 * 1000 * 1000)
+        return QString::number(usecs / 1000) + " ms";
+
+    return QString::number(usecs / 1000000.0, 'f', 1) + " s";
+}
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
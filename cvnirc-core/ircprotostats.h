@@ -0,0 +1,98 @@
+#ifndef IRCPROTOSTATS_H
+#define IRCPROTOSTATS_H
+
+#include "cvnirc-core_global.h"
+
+#include <QtGlobal>
+#include <QStringList>
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+// Counts events in one-second buckets, for a rate over the last few seconds.
+class CVNIRCCORESHARED_EXPORT RateWindow
+{
+public:
+    static const int buckets = 10;
+
+private:
+    quint64 _counts[buckets] = {};
+    qint64  _bucketSecs[buckets] = {};
+
+public:
+    void add(quint64 count, qint64 nowMSecs);
+
+    // Average per second over the complete seconds in the window.
+    double ratePerSec(qint64 nowMSecs) const;
+};
+
+// Snapshot of a connection's traffic statistics.
+class CVNIRCCORESHARED_EXPORT TrafficStats
+{
+public:
+    // (Totals, over all connections made by one protocol client.)
+    quint64 bytesReceived = 0, linesReceived = 0;
+    quint64 bytesSent = 0, linesSent = 0;
+    quint64 parseErrors = 0, unrecognizedCommands = 0, framingErrors = 0;
+    quint64 tlsHandshakes = 0, tlsTicketsOffered = 0;
+
+    // (Setup of the latest connection; -1: Not done.)
+    qint64  connectMSecs = -1;  // (Including name resolution.)
+    bool    tls = false;
+    qint64  tlsHandshakeMSecs = -1;
+    bool    tlsTicketOffered = false;  // (Whether the server resumed, Qt doesn't say.)
+    QString tlsCipher;
+
+    // (Current.)
+    int    sendQueueLines = 0;
+    qint64 sendQueueBytes = 0;
+    qint64 socketBytesToWrite = 0;
+
+    // (Over the last few seconds.)
+    double bytesReceivedPerSec = 0, linesReceivedPerSec = 0;
+    double bytesSentPerSec = 0, linesSentPerSec = 0;
+
+    QStringList toDisplayLines() const;
+};
+
+// Histogram of round-trip times, HDR style: Buckets get wider
+// the larger the values are, at a constant relative precision
+// (16 sub-buckets per power of two, so about 6%).
+class CVNIRCCORESHARED_EXPORT LagHistogram
+{
+public:
+    static const int exactBuckets = 32;
+    static const int subBuckets = 16;
+    static const int maxMsb = 36;  // (About 19 hours, in microseconds.)
+    static const int bucketCount = exactBuckets + (maxMsb - 5 + 1) * subBuckets;
+
+private:
+    quint32 _counts[bucketCount] = {};
+    quint64 _count = 0;
+    qint64  _sumUSecs = 0;
+    qint64  _minUSecs = 0, _maxUSecs = 0;
+
+public:
+    void record(qint64 usecs);
+    void clear();
+
+    quint64 count() const;
+    qint64 minUSecs() const;
+    qint64 maxUSecs() const;
+    qint64 meanUSecs() const;
+    // (Upper bound of the bucket the percentile falls into.)
+    qint64 percentileUSecs(double percentile) const;
+
+    QStringList toDisplayLines() const;
+
+    static int bucketIndex(qint64 usecs);
+    static qint64 bucketUpperBound(int index);
+    static QString formatUSecs(qint64 usecs);
+};
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
+
+#endif // IRCPROTOSTATS_H
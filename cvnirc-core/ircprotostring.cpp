@@ -0,0 +1,190 @@
+#include "ircprotostring.h"
+
+#include <QTextCodec>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+TextDecoder::TextDecoder(QTextCodec *fallbackCodec) :
+    _fallbackCodec(fallbackCodec)
+{
+
+}
+
+QTextCodec *TextDecoder::fallbackCodec() const
+{
+    return _fallbackCodec;
+}
+
+QString TextDecoder::fallbackName() const
+{
+    if (_fallbackCodec == nullptr)
+        return "ISO-8859-1";
+
+    return QString::fromLatin1(_fallbackCodec->name());
+}
+
+QString TextDecoder::decode(const QByteArray &bytes) const
+{
+    if (bytes.isNull())
+        return QString();
+
+    const char *data = bytes.constData();
+    const int len = bytes.length();
+
+    // Fast path: Most of the traffic is plain ASCII.
+    const int asciiLen = asciiPrefixLength(data, len);
+    if (asciiLen == len)
+        return QString::fromLatin1(bytes);
+
+    if (isValidUtf8(data + asciiLen, len - asciiLen))
+        return QString::fromUtf8(bytes);
+
+    if (_fallbackCodec == nullptr)
+        return QString::fromLatin1(bytes);
+
+    return _fallbackCodec->toUnicode(bytes);
+}
+
+int TextDecoder::asciiPrefixLength(const char *data, int len)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    // Check 16 bytes at a time; any byte with the high bit set ends the run.
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        if (_mm_movemask_epi8(chunk) != 0)
+            break;
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (static_cast<unsigned char>(data[i]) >= 0x80)
+            break;
+    }
+
+    return i;
+}
+
+bool TextDecoder::isValidUtf8(const char *data, int len)
+{
+    const auto *p   = reinterpret_cast<const unsigned char *>(data);
+    const auto *end = p + len;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            // Skip ASCII runs quickly.
+            p += asciiPrefixLength(reinterpret_cast<const char *>(p), int(end - p));
+            continue;
+        }
+
+        unsigned char c = *p;
+        int trailing;
+        unsigned char min2 = 0x80, max2 = 0xBF;  // Allowed range for the 2nd byte.
+        if (c >= 0xC2 && c <= 0xDF) {
+            trailing = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF) {
+            trailing = 2;
+            if (c == 0xE0)
+                min2 = 0xA0;  // Overlong.
+            else if (c == 0xED)
+                max2 = 0x9F;  // Surrogates.
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            trailing = 3;
+            if (c == 0xF0)
+                min2 = 0x90;  // Overlong.
+            else if (c == 0xF4)
+                max2 = 0x8F;  // Beyond U+10FFFF.
+        }
+        else {
+            return false;
+        }
+
+        if (end - p <= trailing)
+            return false;
+
+        if (p[1] < min2 || p[1] > max2)
+            return false;
+
+        for (int i = 2; i <= trailing; i++) {
+            if ((p[i] & 0xC0) != 0x80)
+                return false;
+        }
+
+        p += trailing + 1;
+    }
+
+    return true;
+}
+
+
+NetworkString::NetworkString()
+{
+
+}
+
+NetworkString::NetworkString(const QByteArray &bytes, NetworkString::decoder_ptr decoder) :
+    _bytes(bytes), _decoder(decoder)
+{
+
+}
+
+bool NetworkString::isNull() const
+{
+    return _bytes.isNull();
+}
+
+bool NetworkString::isEmpty() const
+{
+    return _bytes.isEmpty();
+}
+
+const QByteArray &NetworkString::bytes() const
+{
+    return _bytes;
+}
+
+const NetworkString::decoder_ptr &NetworkString::decoder() const
+{
+    return _decoder;
+}
+
+const QString &NetworkString::toString() const
+{
+    if (!_isDecoded) {
+        _decoded = _decoder ? _decoder->decode(_bytes) : TextDecoder().decode(_bytes);
+        _isDecoded = true;
+    }
+
+    return _decoded;
+}
+
+QString NetworkString::toString(const NetworkString::decoder_ptr &otherDecoder) const
+{
+    if (!otherDecoder || otherDecoder == _decoder)
+        return toString();
+
+    return otherDecoder->decode(_bytes);
+}
+
+bool NetworkString::operator ==(const NetworkString &other) const
+{
+    return _bytes == other._bytes;
+}
+
+bool NetworkString::operator !=(const NetworkString &other) const
+{
+    return !(*this == other);
+}
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
@@ -0,0 +1,70 @@
+#ifndef IRCPROTOSTRING_H
+#define IRCPROTOSTRING_H
+
+#include "cvnirc-core_global.h"
+
+#include <memory>
+#include <QByteArray>
+#include <QString>
+
+class QTextCodec;
+
+namespace cvnirc   {
+namespace core     {  // cvnirc::core
+namespace IRCProto {  // cvnirc::core::IRCProto
+
+// Decodes bytes received from the network to QString.
+//
+// Pure ASCII and valid UTF-8 get decoded as such; everything else
+// is taken to be in the fallback encoding (default: Latin-1).
+class CVNIRCCORESHARED_EXPORT TextDecoder
+{
+    QTextCodec *_fallbackCodec;
+
+public:
+    explicit TextDecoder(QTextCodec *fallbackCodec = nullptr);
+
+    QTextCodec *fallbackCodec() const;
+    QString fallbackName() const;
+
+    QString decode(const QByteArray &bytes) const;
+
+    static int asciiPrefixLength(const char *data, int len);
+    static bool isValidUtf8(const char *data, int len);
+};
+
+// Bytes as received from the network, decoded to QString
+// only on first access.
+class CVNIRCCORESHARED_EXPORT NetworkString
+{
+public:
+    typedef std::shared_ptr<const TextDecoder> decoder_ptr;
+
+private:
+    QByteArray _bytes;
+    decoder_ptr _decoder;
+    mutable QString _decoded;
+    mutable bool _isDecoded = false;
+
+public:
+    NetworkString();
+    NetworkString(const QByteArray &bytes, decoder_ptr decoder = nullptr);
+
+    bool isNull() const;
+    bool isEmpty() const;
+
+    const QByteArray &bytes() const;
+    const decoder_ptr &decoder() const;
+
+    const QString &toString() const;
+    QString toString(const decoder_ptr &otherDecoder) const;
+
+    bool operator ==(const NetworkString &other) const;
+    bool operator !=(const NetworkString &other) const;
+};
+
+}  // namespace cvnirc::core::IRCProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
+
+#endif // IRCPROTOSTRING_H
@@ -0,0 +1,216 @@
+#include "remotecore.h"
+
+#include <QLocalSocket>
+#include <stdexcept>
+#include <string>
+
+using namespace cvnirc::core::RemoteProto;
+
+RemoteCore::RemoteCore(QObject *parent) : QObject(parent),
+    _socket(new QLocalSocket(this))
+{
+    connect(_socket, &QLocalSocket::connected, this, &RemoteCore::handle_socket_connected);
+    connect(_socket, &QLocalSocket::readyRead, this, &RemoteCore::handle_socket_readyRead);
+    connect(_socket, &QLocalSocket::disconnected, this, &RemoteCore::handle_socket_disconnected);
+    typedef void (QLocalSocket::*error_signal_type)(QLocalSocket::LocalSocketError);
+    connect(_socket, static_cast<error_signal_type>(&QLocalSocket::error),
+            this, &RemoteCore::handle_socket_error);
+
+    _flushTimer.setSingleShot(true);
+    connect(&_flushTimer, &QTimer::timeout, this, &RemoteCore::handle_flushTimer_timeout);
+}
+
+void RemoteCore::attach(const QString &socketName)
+{
+    if (_socket->state() != QLocalSocket::UnconnectedState)
+        detach();
+
+    _decoder = Decoder();
+    _writer = Writer();
+    _socket->connectToServer(socketName);
+}
+
+void RemoteCore::detach()
+{
+    _detach("Detached.");
+    _socket->abort();
+}
+
+bool RemoteCore::isAttached() const
+{
+    return _attached;
+}
+
+const QMap<quint32, RemoteCore::ContextInfo> &RemoteCore::contexts() const
+{
+    return _contexts;
+}
+
+void RemoteCore::subscribe(quint32 contextId, quint32 replayLines)
+{
+    _writer.writeSubscribe(contextId, replayLines);
+    _scheduleFlush();
+}
+
+void RemoteCore::unsubscribe(quint32 contextId)
+{
+    _writer.writeUnsubscribe(contextId);
+    _scheduleFlush();
+}
+
+void RemoteCore::sendInput(quint32 contextId, const QString &line)
+{
+    if (!_contexts.contains(contextId))
+        throw std::invalid_argument("Remote core, send input: No such context");
+
+    _writer.writeInput(contextId, line);
+    _scheduleFlush();
+}
+
+void RemoteCore::connectToIRCServer(const QString &host, const QString &port, const QString &user, const QString &nick)
+{
+    _writer.writeConnect(host, port, user, nick);
+    _scheduleFlush();
+}
+
+void RemoteCore::handle_socket_connected()
+{
+    // Attach goes first, before anything queued up meanwhile.
+    // (Known contexts are only worth something if it's the same core as before.)
+    Writer attach;
+    attach.writeAttach(_instance, _revision);
+    _socket->write(attach.take());
+    _scheduleFlush();
+}
+
+void RemoteCore::handle_socket_readyRead()
+{
+    _decoder.append(_socket->readAll());
+
+    try {
+        MessageType type;
+        QByteArray payload;
+        while (_socket->state() == QLocalSocket::ConnectedState && _decoder.takeFrame(&type, &payload))
+            _receivedFrame(type, payload);
+    }
+    catch (const std::runtime_error &ex) {
+        // (Before aborting; the disconnect would detach with a vaguer reason.)
+        const QString reason = QString("Protocol error: ") + ex.what();
+        if (_attached) {
+            _detach(reason);
+        }
+        else {
+            _flushTimer.stop();
+            detached("Can't attach: " + reason);
+        }
+        _socket->abort();
+    }
+}
+
+void RemoteCore::handle_socket_disconnected()
+{
+    _detach("Core went away.");
+}
+
+void RemoteCore::handle_socket_error()
+{
+    // (Once attached, the disconnect tells about it.)
+    if (_attached)
+        return;
+
+    _flushTimer.stop();
+    detached("Can't attach: " + _socket->errorString());
+}
+
+void RemoteCore::handle_flushTimer_timeout()
+{
+    if (_writer.isEmpty() || _socket->state() != QLocalSocket::ConnectedState)
+        return;
+
+    _socket->write(_writer.take());
+}
+
+void RemoteCore::_scheduleFlush()
+{
+    // (Collect everything of this event loop iteration into one write.)
+    if (!_flushTimer.isActive())
+        _flushTimer.start(0);
+}
+
+void RemoteCore::_receivedFrame(MessageType type, const QByteArray &payload)
+{
+    Reader reader(payload);
+
+    switch (type) {
+    case MessageType::Hello: {
+        const quint64 version = reader.varint();
+        if (version != protocolVersion)
+            throw std::runtime_error("Unsupported protocol version " + std::to_string(version));
+
+        const quint64 instance = reader.varint();
+        if (instance != _instance) {
+            // (A different core; forget what we knew.)
+            _contexts.clear();
+            _revision = 0;
+        }
+        _instance = instance;
+        _attached = true;
+        attached();
+        break;
+    }
+    case MessageType::Contexts: {
+        QList<ContextInfo> changed;
+        _decoder.readContexts(&reader, &_revision, &changed);
+        for (const ContextInfo &info : changed) {
+            _contexts.insert(info.id, info);
+            contextChanged(info.id);
+        }
+        break;
+    }
+    case MessageType::Line: {
+        quint32 contextId = 0;
+        qint64 msecs = 0;
+        QString text;
+        _decoder.readLine(&reader, &contextId, &msecs, &text);
+        lineReceived(contextId, msecs, text);
+        break;
+    }
+    case MessageType::State: {
+        const quint32 contextId = quint32(reader.varint());
+        const quint8 state = reader.u8();
+        reader.expectEnd();
+        auto it = _contexts.find(contextId);
+        if (it != _contexts.end()) {
+            it.value().state = state;
+            stateChanged(contextId);
+        }
+        break;
+    }
+    case MessageType::ReplayDone: {
+        const quint32 contextId = quint32(reader.varint());
+        reader.expectEnd();
+        replayDone(contextId);
+        break;
+    }
+    case MessageType::Error: {
+        const QString text = reader.string();
+        reader.expectEnd();
+        errorReceived(text);
+        break;
+    }
+    default:
+        // (Newer core; ignore what we don't understand.)
+        break;
+    }
+}
+
+void RemoteCore::_detach(const QString &reason)
+{
+    _flushTimer.stop();
+    if (!_attached)
+        return;
+
+    // (Keep the contexts; a re-attach may only need the changes.)
+    _attached = false;
+    detached(reason);
+}
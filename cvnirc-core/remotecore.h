@@ -0,0 +1,71 @@
+#ifndef REMOTECORE_H
+#define REMOTECORE_H
+
+#include "cvnirc-core_global.h"
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+#include "remoteproto.h"
+
+class QLocalSocket;
+
+// Frontend side of an attach to a core in another process (see
+// RemoteProto): Mirrors the core's contexts, and relays lines
+// and input. Re-attaching to the same core fetches only changes.
+class CVNIRCCORESHARED_EXPORT RemoteCore : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef cvnirc::core::RemoteProto::ContextInfo ContextInfo;
+
+private:
+    QLocalSocket *_socket;
+    cvnirc::core::RemoteProto::Writer  _writer;
+    cvnirc::core::RemoteProto::Decoder _decoder;
+    QTimer _flushTimer;
+
+    QMap<quint32, ContextInfo> _contexts;
+    quint64 _instance = 0;
+    quint64 _revision = 0;
+    bool _attached = false;
+
+public:
+    explicit RemoteCore(QObject *parent = 0);
+
+    void attach(const QString &socketName);
+    void detach();
+    bool isAttached() const;
+
+    const QMap<quint32, ContextInfo> &contexts() const;
+
+    // (Context 0: All of them.)
+    void subscribe(quint32 contextId, quint32 replayLines);
+    void unsubscribe(quint32 contextId);
+    void sendInput(quint32 contextId, const QString &line);
+    void connectToIRCServer(const QString &host, const QString &port, const QString &user, const QString &nick);
+
+signals:
+    void attached();
+    void detached(const QString &reason);
+    void contextChanged(quint32 contextId);
+    void stateChanged(quint32 contextId);
+    void lineReceived(quint32 contextId, qint64 msecs, const QString &text);
+    void replayDone(quint32 contextId);
+    void errorReceived(const QString &text);
+
+private slots:
+    void handle_socket_connected();
+    void handle_socket_readyRead();
+    void handle_socket_disconnected();
+    void handle_socket_error();
+    void handle_flushTimer_timeout();
+
+private:
+    void _scheduleFlush();
+    void _receivedFrame(cvnirc::core::RemoteProto::MessageType type, const QByteArray &payload);
+    void _detach(const QString &reason);
+};
+
+#endif // REMOTECORE_H
@@ -0,0 +1,341 @@
+#include "remoteproto.h"
+
+#include <stdexcept>
+
+namespace cvnirc      {
+namespace core        {  // cvnirc::core
+namespace RemoteProto {  // cvnirc::core::RemoteProto
+
+void Writer::beginFrame(MessageType type)
+{
+    if (_frameStart >= 0)
+        throw std::logic_error("Remote protocol writer, begin frame: Previous frame not ended");
+
+    _frameStart = _buf.size();
+    _buf.append(4, '\0');  // (Length, filled in by endFrame().)
+    putU8(quint8(type));
+}
+
+void Writer::endFrame()
+{
+    if (_frameStart < 0)
+        throw std::logic_error("Remote protocol writer, end frame: No frame begun");
+
+    const int payloadSize = _buf.size() - _frameStart - frameHeaderSize;
+    if (payloadSize > maxFrameBytes)
+        throw std::runtime_error("Remote protocol writer, end frame: Frame too large");
+
+    char *p = _buf.data() + _frameStart;
+    for (int i = 0; i < 4; i++)
+        p[i] = char((quint32(payloadSize) >> (8 * i)) & 0xff);
+    _frameStart = -1;
+}
+
+void Writer::putU8(quint8 value)
+{
+    _buf.append(char(value));
+}
+
+void Writer::putVarint(quint64 value)
+{
+    while (value >= 0x80) {
+        _buf.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    _buf.append(char(value));
+}
+
+void Writer::putSVarint(qint64 value)
+{
+    putVarint((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void Writer::putBytes(const QByteArray &bytes)
+{
+    putVarint(quint64(bytes.size()));
+    _buf.append(bytes);
+}
+
+void Writer::putString(const QString &str)
+{
+    putBytes(str.toUtf8());
+}
+
+void Writer::writeHello(quint64 instance)
+{
+    beginFrame(MessageType::Hello);
+    putVarint(protocolVersion);
+    putVarint(instance);
+    endFrame();
+}
+
+void Writer::writeContexts(quint64 revision, const QList<ContextInfo> &contexts)
+{
+    beginFrame(MessageType::Contexts);
+    putVarint(revision);
+    putVarint(quint64(contexts.count()));
+
+    // Ids ascend, and neighbouring disambiguators tend to share
+    // the server name; so send only what differs from the previous one.
+    quint32 lastId = 0;
+    QByteArray lastDisambiguator;
+    for (const ContextInfo &info : contexts) {
+        if (info.id <= lastId)
+            throw std::invalid_argument("Remote protocol writer, contexts: Ids must ascend");
+
+        const QByteArray disambiguator = info.disambiguator.toUtf8();
+        int shared = 0;
+        const int maxShared = qMin(disambiguator.size(), lastDisambiguator.size());
+        while (shared < maxShared && disambiguator[shared] == lastDisambiguator[shared])
+            shared++;
+
+        putVarint(info.id - lastId);
+        putU8(info.type);
+        putU8(info.state);
+        putVarint(quint64(shared));
+        putBytes(disambiguator.mid(shared));
+
+        lastId = info.id;
+        lastDisambiguator = disambiguator;
+    }
+    endFrame();
+}
+
+void Writer::writeLine(quint32 contextId, qint64 msecs, const QByteArray &utf8Text)
+{
+    beginFrame(MessageType::Line);
+    putVarint(contextId);
+    putSVarint(msecs - _lastLineMSecs);
+    putBytes(utf8Text);
+    endFrame();
+    _lastLineMSecs = msecs;
+}
+
+void Writer::writeState(quint32 contextId, quint8 state)
+{
+    beginFrame(MessageType::State);
+    putVarint(contextId);
+    putU8(state);
+    endFrame();
+}
+
+void Writer::writeReplayDone(quint32 contextId)
+{
+    beginFrame(MessageType::ReplayDone);
+    putVarint(contextId);
+    endFrame();
+}
+
+void Writer::writeError(const QString &text)
+{
+    beginFrame(MessageType::Error);
+    putString(text);
+    endFrame();
+}
+
+void Writer::writeAttach(quint64 instance, quint64 revision)
+{
+    beginFrame(MessageType::Attach);
+    putVarint(instance);
+    putVarint(revision);
+    endFrame();
+}
+
+void Writer::writeSubscribe(quint32 contextId, quint32 replayLines)
+{
+    beginFrame(MessageType::Subscribe);
+    putVarint(contextId);
+    putVarint(replayLines);
+    endFrame();
+}
+
+void Writer::writeUnsubscribe(quint32 contextId)
+{
+    beginFrame(MessageType::Unsubscribe);
+    putVarint(contextId);
+    endFrame();
+}
+
+void Writer::writeInput(quint32 contextId, const QString &text)
+{
+    beginFrame(MessageType::Input);
+    putVarint(contextId);
+    putString(text);
+    endFrame();
+}
+
+void Writer::writeConnect(const QString &host, const QString &port, const QString &user, const QString &nick)
+{
+    beginFrame(MessageType::Connect);
+    putString(host);
+    putString(port);
+    putString(user);
+    putString(nick);
+    endFrame();
+}
+
+bool Writer::isEmpty() const
+{
+    return _buf.isEmpty();
+}
+
+int Writer::size() const
+{
+    return _buf.size();
+}
+
+QByteArray Writer::take()
+{
+    if (_frameStart >= 0)
+        throw std::logic_error("Remote protocol writer, take: Frame not ended");
+
+    QByteArray ret;
+    ret.swap(_buf);
+    return ret;
+}
+
+
+Reader::Reader(const QByteArray &payload) :
+    _payload(payload)
+{
+}
+
+quint8 Reader::u8()
+{
+    if (_pos >= _payload.size())
+        throw std::runtime_error("Remote protocol reader: Unexpected end of frame");
+
+    return quint8(_payload[_pos++]);
+}
+
+quint64 Reader::varint()
+{
+    quint64 value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const quint8 byte = u8();
+        value |= quint64(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+
+    throw std::runtime_error("Remote protocol reader: Varint too long");
+}
+
+qint64 Reader::svarint()
+{
+    const quint64 value = varint();
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+QByteArray Reader::bytes()
+{
+    const quint64 size = varint();
+    if (size > quint64(_payload.size() - _pos))
+        throw std::runtime_error("Remote protocol reader: String exceeds frame");
+
+    const QByteArray ret = _payload.mid(_pos, int(size));
+    _pos += int(size);
+    return ret;
+}
+
+QString Reader::string()
+{
+    return QString::fromUtf8(bytes());
+}
+
+bool Reader::atEnd() const
+{
+    return _pos >= _payload.size();
+}
+
+void Reader::expectEnd() const
+{
+    if (!atEnd())
+        throw std::runtime_error("Remote protocol reader: Trailing garbage in frame");
+}
+
+
+void Decoder::append(const QByteArray &data)
+{
+    // (Drop what's consumed, now and then, instead of on every frame.)
+    if (_pos > 0 && _pos >= _buf.size() / 2) {
+        _buf.remove(0, _pos);
+        _pos = 0;
+    }
+
+    _buf.append(data);
+}
+
+bool Decoder::takeFrame(MessageType *type, QByteArray *payload)
+{
+    if (type == nullptr || payload == nullptr)
+        throw std::invalid_argument("Remote protocol decoder, take frame: Arguments can't be null");
+
+    if (_buf.size() - _pos < frameHeaderSize)
+        return false;
+
+    const uchar *p = reinterpret_cast<const uchar *>(_buf.constData()) + _pos;
+    const quint32 size = quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+    if (size > quint32(maxFrameBytes))
+        throw std::runtime_error("Remote protocol decoder: Frame too large");
+
+    if (quint32(_buf.size() - _pos - frameHeaderSize) < size)
+        return false;
+
+    *type = MessageType(p[4]);
+    *payload = _buf.mid(_pos + frameHeaderSize, int(size));
+    _pos += frameHeaderSize + int(size);
+    return true;
+}
+
+void Decoder::readContexts(Reader *reader, quint64 *revision, QList<ContextInfo> *contexts)
+{
+    if (reader == nullptr || revision == nullptr || contexts == nullptr)
+        throw std::invalid_argument("Remote protocol decoder, read contexts: Arguments can't be null");
+
+    *revision = reader->varint();
+    const quint64 count = reader->varint();
+    contexts->clear();
+
+    quint32 lastId = 0;
+    QByteArray lastDisambiguator;
+    for (quint64 i = 0; i < count; i++) {
+        ContextInfo info;
+        const quint64 idDelta = reader->varint();
+        if (idDelta == 0 || idDelta > 0xffffffffu - lastId)
+            throw std::runtime_error("Remote protocol decoder: Invalid context id");
+        info.id = lastId + quint32(idDelta);
+        info.type = reader->u8();
+        info.state = reader->u8();
+
+        const quint64 shared = reader->varint();
+        if (shared > quint64(lastDisambiguator.size()))
+            throw std::runtime_error("Remote protocol decoder: Invalid shared prefix");
+        const QByteArray disambiguator = lastDisambiguator.left(int(shared)) + reader->bytes();
+        info.disambiguator = QString::fromUtf8(disambiguator);
+
+        contexts->append(info);
+        lastId = info.id;
+        lastDisambiguator = disambiguator;
+    }
+    reader->expectEnd();
+}
+
+void Decoder::readLine(Reader *reader, quint32 *contextId, qint64 *msecs, QString *text)
+{
+    if (reader == nullptr || contextId == nullptr || msecs == nullptr || text == nullptr)
+        throw std::invalid_argument("Remote protocol decoder, read line: Arguments can't be null");
+
+    const quint64 id = reader->varint();
+    if (id == 0 || id > 0xffffffffu)
+        throw std::runtime_error("Remote protocol decoder: Invalid context id");
+    *contextId = quint32(id);
+    _lastLineMSecs += reader->svarint();
+    *msecs = _lastLineMSecs;
+    *text = reader->string();
+    reader->expectEnd();
+}
+
+}  // namespace cvnirc::core::RemoteProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
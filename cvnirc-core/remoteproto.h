@@ -0,0 +1,145 @@
+#ifndef REMOTEPROTO_H
+#define REMOTEPROTO_H
+
+#include "cvnirc-core_global.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+namespace cvnirc      {
+namespace core        {  // cvnirc::core
+namespace RemoteProto {  // cvnirc::core::RemoteProto
+
+// Wire protocol between a core (e.g., cvnirc-bnc) and frontends
+// attached to it over a local socket.
+//
+// Frames: u32 payload length (little-endian), u8 message type, payload.
+// Integers in the payload are varints (LEB128; signed ones zigzag);
+// strings are a varint byte count, then UTF-8.
+//
+// Core to frontend:
+//   Hello      varint version, varint instance
+//   Contexts   varint revision, varint count, then per context (ascending id):
+//              varint id delta, u8 type, u8 state, varint shared prefix
+//              (bytes, with the previous disambiguator), string rest
+//   Line       varint context, svarint msecs (delta to the previous Line), string text
+//   State      varint context, u8 state
+//   ReplayDone varint context
+//   Error      string text
+//
+// Frontend to core:
+//   Attach      varint instance, varint revision  (Of a previous attach; 0: none.)
+//   Subscribe   varint context (0: all, current and future), varint replay lines
+//   Unsubscribe varint context
+//   Input       varint context, string text
+//   Connect     string host, string port, string user, string nick
+//
+// Contexts is a snapshot of what changed after the given revision, so a
+// frontend that re-attaches to the same core instance gets only changes.
+// Several frames usually go out in one write.
+
+static const quint64 protocolVersion = 1;
+static const int maxFrameBytes = 16 * 1024 * 1024;
+static const int frameHeaderSize = 4 + 1;
+
+enum class MessageType : quint8 {
+    Hello       = 1,
+    Contexts    = 2,
+    Line        = 3,
+    State       = 4,
+    ReplayDone  = 5,
+    Error       = 6,
+
+    Attach      = 64,
+    Subscribe   = 65,
+    Unsubscribe = 66,
+    Input       = 67,
+    Connect     = 68,
+};
+
+class CVNIRCCORESHARED_EXPORT ContextInfo
+{
+public:
+    quint32 id = 0;  // (From 1.)
+    quint8  type = 0;   // (IRCCoreContext::Type.)
+    quint8  state = 0;  // (IRCProtoClient::ConnectionState; server contexts only.)
+    QString disambiguator;
+};
+
+// Appends frames to a buffer, to be written out in one go.
+// (Keeps per-stream state; use one per connection.)
+class CVNIRCCORESHARED_EXPORT Writer
+{
+    QByteArray _buf;
+    int _frameStart = -1;
+    qint64 _lastLineMSecs = 0;
+
+public:
+    void beginFrame(MessageType type);
+    void endFrame();
+
+    void putU8(quint8 value);
+    void putVarint(quint64 value);
+    void putSVarint(qint64 value);
+    void putBytes(const QByteArray &bytes);
+    void putString(const QString &str);
+
+    void writeHello(quint64 instance);
+    void writeContexts(quint64 revision, const QList<ContextInfo> &contexts);
+    void writeLine(quint32 contextId, qint64 msecs, const QByteArray &utf8Text);
+    void writeState(quint32 contextId, quint8 state);
+    void writeReplayDone(quint32 contextId);
+    void writeError(const QString &text);
+
+    void writeAttach(quint64 instance, quint64 revision);
+    void writeSubscribe(quint32 contextId, quint32 replayLines);
+    void writeUnsubscribe(quint32 contextId);
+    void writeInput(quint32 contextId, const QString &text);
+    void writeConnect(const QString &host, const QString &port, const QString &user, const QString &nick);
+
+    bool isEmpty() const;
+    int size() const;
+    QByteArray take();
+};
+
+// Reads the payload of one frame. (Throws std::runtime_error when malformed.)
+class CVNIRCCORESHARED_EXPORT Reader
+{
+    const QByteArray &_payload;
+    int _pos = 0;
+
+public:
+    explicit Reader(const QByteArray &payload);
+
+    quint8  u8();
+    quint64 varint();
+    qint64  svarint();
+    QByteArray bytes();
+    QString string();
+    bool atEnd() const;
+    void expectEnd() const;
+};
+
+// Splits the incoming stream into frames, and decodes the
+// messages that depend on per-stream state.
+class CVNIRCCORESHARED_EXPORT Decoder
+{
+    QByteArray _buf;
+    int _pos = 0;
+    qint64 _lastLineMSecs = 0;
+
+public:
+    void append(const QByteArray &data);
+    // (Throws std::runtime_error on an oversized frame.)
+    bool takeFrame(MessageType *type, QByteArray *payload);
+
+    void readContexts(Reader *reader, quint64 *revision, QList<ContextInfo> *contexts);
+    void readLine(Reader *reader, quint32 *contextId, qint64 *msecs, QString *text);
+};
+
+}  // namespace cvnirc::core::RemoteProto
+}  // namespace cvnirc::core
+}  // namespace cvnirc
+
+#endif // REMOTEPROTO_H
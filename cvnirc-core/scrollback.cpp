@@ -0,0 +1,249 @@
+#include "scrollback.h"
+
+#include <stdexcept>
+#include <string.h>
+
+quint32 StringInterner::intern(const QString &str)
+{
+    if (str.isEmpty())
+        return 0;
+
+    auto it = _ids.constFind(str);
+    if (it != _ids.constEnd()) {
+        _slots[it.value() - 1].refs++;
+        return it.value();
+    }
+
+    quint32 id;
+    if (!_freeIds.empty()) {
+        id = _freeIds.back();
+        _freeIds.pop_back();
+    }
+    else {
+        _slots.emplace_back();
+        id = quint32(_slots.size());
+    }
+
+    Slot &slot(_slots[id - 1]);
+    slot.string = str;
+    slot.refs = 1;
+    _ids.insert(str, id);
+    return id;
+}
+
+void StringInterner::release(quint32 id)
+{
+    if (id == 0 || id > _slots.size())
+        return;
+
+    Slot &slot(_slots[id - 1]);
+    if (slot.refs == 0 || --slot.refs > 0)
+        return;
+
+    _ids.remove(slot.string);
+    slot.string.clear();
+    _freeIds.push_back(id);
+}
+
+QString StringInterner::string(quint32 id) const
+{
+    if (id == 0 || id > _slots.size())
+        return QString();
+
+    return _slots[id - 1].string;
+}
+
+int StringInterner::count() const
+{
+    return _ids.count();
+}
+
+
+QString Scrollback::Entry::toDisplayString() const
+{
+    switch (kind) {
+    case Kind::Message:
+    case Kind::OwnMessage:
+        return "<" + sender + "> " + text;
+    case Kind::Notice:
+        return "-" + sender + "- " + text;
+    case Kind::Info:
+    case Kind::Join:
+        break;
+    }
+
+    return text;
+}
+
+Scrollback::Scrollback(const std::shared_ptr<StringInterner> &interner, int maxLines, int arenaBytes) :
+    _interner(interner)
+{
+    if (maxLines <= 0 || maxLines > maxMaxLines)
+        throw std::invalid_argument("Scrollback: Maximum number of lines out of range");
+    if (arenaBytes <= 0 || arenaBytes > maxArenaBytes)
+        throw std::invalid_argument("Scrollback: Arena size out of range");
+
+    if (!_interner)
+        _interner = std::make_shared<StringInterner>();
+
+    _entries.resize(size_t(maxLines));
+
+    quint32 arenaSize = 1;
+    while (arenaSize < quint32(arenaBytes))
+        arenaSize <<= 1;
+    _arena.reset(new char[arenaSize]);
+    _arenaMask = arenaSize - 1;
+}
+
+Scrollback::~Scrollback()
+{
+    // (Not when moved from.)
+    if (_interner)
+        _releaseAll();
+}
+
+quint64 Scrollback::append(qint64 msecs, Kind kind, const QString &sender, const QString &text)
+{
+    QByteArray bytes = text.toUtf8();
+    const quint32 arenaSize = _arenaMask + 1;
+    if (quint32(bytes.size()) > arenaSize) {
+        // (Absurdly long; keep what fits, without splitting a character.)
+        int len = int(arenaSize);
+        while (len > 0 && (static_cast<unsigned char>(bytes[len]) & 0xc0) == 0x80)
+            len--;
+        bytes.truncate(len);
+    }
+    const quint32 len = quint32(bytes.size());
+
+    while (_count == _entries.size() || arenaSize - (_arenaHead - _arenaTail) < len)
+        _dropOldest();
+
+    // Copy the text in, wrapping around the end of the arena if need be.
+    const quint32 textPos = _arenaHead;
+    const quint32 start = textPos & _arenaMask;
+    const quint32 firstPart = qMin(len, arenaSize - start);
+    memcpy(_arena.get() + start, bytes.constData(), firstPart);
+    memcpy(_arena.get(), bytes.constData() + firstPart, len - firstPart);
+    _arenaHead += len;
+    if (_count == 0)
+        _arenaTail = textPos;
+
+    PackedEntry &packed(_entries[(_head + _count) % _entries.size()]);
+    packed.stampKind = (quint64(qMax<qint64>(msecs, 0)) << 8) | quint8(kind);
+    packed.senderId = _interner->intern(sender);
+    packed.textPos = textPos;
+    _count++;
+
+    return endSeq() - 1;
+}
+
+void Scrollback::clear()
+{
+    _releaseAll();
+    _firstSeq = endSeq();
+    _head = 0;
+    _count = 0;
+    _arenaTail = _arenaHead;
+}
+
+int Scrollback::count() const
+{
+    return int(_count);
+}
+
+int Scrollback::maxLines() const
+{
+    return int(_entries.size());
+}
+
+quint64 Scrollback::firstSeq() const
+{
+    return _firstSeq;
+}
+
+quint64 Scrollback::endSeq() const
+{
+    return _firstSeq + _count;
+}
+
+bool Scrollback::entry(quint64 seq, Entry *entry) const
+{
+    if (entry == nullptr)
+        throw std::invalid_argument("Scrollback, entry: Entry can't be null");
+
+    if (seq < _firstSeq || seq >= endSeq())
+        return false;
+
+    *entry = _unpack(size_t(seq - _firstSeq));
+    return true;
+}
+
+QList<Scrollback::Entry> Scrollback::page(quint64 fromSeq, int maxCount) const
+{
+    QList<Entry> ret;
+    fromSeq = qMax(fromSeq, _firstSeq);
+    if (maxCount <= 0 || fromSeq >= endSeq())
+        return ret;
+
+    const size_t first = size_t(fromSeq - _firstSeq);
+    const size_t n = qMin(size_t(maxCount), _count - first);
+    ret.reserve(int(n));
+    for (size_t i = first; i < first + n; i++)
+        ret.append(_unpack(i));
+    return ret;
+}
+
+QList<Scrollback::Entry> Scrollback::last(int maxCount) const
+{
+    if (maxCount <= 0)
+        return QList<Entry>();
+
+    return page(endSeq() - qMin(quint64(maxCount), quint64(_count)), maxCount);
+}
+
+size_t Scrollback::memoryBytes() const
+{
+    return _entries.size() * sizeof(PackedEntry) + (size_t(_arenaMask) + 1);
+}
+
+void Scrollback::_releaseAll()
+{
+    for (size_t i = 0; i < _count; i++)
+        _interner->release(_entries[(_head + i) % _entries.size()].senderId);
+}
+
+void Scrollback::_dropOldest()
+{
+    if (_count == 0)
+        throw std::logic_error("Scrollback: Nothing left to drop");
+
+    _interner->release(_entries[_head].senderId);
+    _head = (_head + 1) % _entries.size();
+    _count--;
+    _firstSeq++;
+    _arenaTail = _count > 0 ? _entries[_head].textPos : _arenaHead;
+}
+
+Scrollback::Entry Scrollback::_unpack(size_t index) const
+{
+    const PackedEntry &packed(_entries[(_head + index) % _entries.size()]);
+    // (Text runs up to where the next line's starts.)
+    const quint32 endPos = index + 1 < _count ? _entries[(_head + index + 1) % _entries.size()].textPos : _arenaHead;
+    const quint32 len = endPos - packed.textPos;
+
+    const quint32 arenaSize = _arenaMask + 1;
+    const quint32 start = packed.textPos & _arenaMask;
+    const quint32 firstPart = qMin(len, arenaSize - start);
+    QByteArray bytes;
+    bytes.reserve(int(len));
+    bytes.append(_arena.get() + start, int(firstPart));
+    bytes.append(_arena.get(), int(len - firstPart));
+
+    Entry ret;
+    ret.seq = _firstSeq + index;
+    ret.msecs = qint64(packed.stampKind >> 8);
+    ret.kind = Kind(packed.stampKind & 0xff);
+    ret.sender = _interner->string(packed.senderId);
+    ret.text = QString::fromUtf8(bytes);
+    return ret;
+}
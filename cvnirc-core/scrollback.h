@@ -0,0 +1,121 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include "cvnirc-core_global.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <memory>
+#include <vector>
+
+// Maps strings that recur a lot (like sender nicks) to small ids.
+// Ids are reference counted: Each intern() needs a release() once the
+// id isn't needed anymore; then the string goes away, and its id gets
+// reused. (So a long-running core only keeps the nicks still in sight.)
+class CVNIRCCORESHARED_EXPORT StringInterner
+{
+    class Slot
+    {
+    public:
+        QString string;
+        quint32 refs = 0;
+    };
+
+    QHash<QString, quint32> _ids;
+    std::vector<Slot> _slots;  // (Index is id - 1.)
+    std::vector<quint32> _freeIds;
+
+public:
+    quint32 intern(const QString &str);  // (0 for the empty string.)
+    void release(quint32 id);
+    QString string(quint32 id) const;
+    int count() const;
+};
+
+// Bounded history of a context, in a compact layout: Per line, one
+// 16-byte record (timestamp and kind packed together, interned sender,
+// position of the text), and the UTF-8 text in an arena shared by all
+// the lines. Both are rings; the oldest lines make room for new ones.
+//
+// Lines are numbered; the numbers stay valid as older lines fall out,
+// so frontends can page through it.
+class CVNIRCCORESHARED_EXPORT Scrollback
+{
+public:
+    enum class Kind : quint8 {
+        Info,        // (Text is all there is.)
+        Join,        // (Likewise; sender is who joined.)
+        Message,
+        Notice,
+        OwnMessage,
+    };
+
+    class Entry
+    {
+    public:
+        quint64 seq = 0;
+        qint64  msecs = 0;  // (Since the epoch.)
+        Kind    kind = Kind::Info;
+        QString sender;
+        QString text;
+
+        QString toDisplayString() const;
+    };
+
+    static const int defaultMaxLines = 2000;
+    static const int averageLineBytes = 128;  // (For sizing the arena.)
+    static const int maxArenaBytes = 1 << 30;
+    static const int maxMaxLines = maxArenaBytes / averageLineBytes;
+
+private:
+    class PackedEntry
+    {
+    public:
+        quint64 stampKind;  // (Milliseconds << 8 | kind.)
+        quint32 senderId;
+        quint32 textPos;    // (In the arena; wraps around at 2^32, like the arena does at its size.)
+    };
+
+    std::vector<PackedEntry> _entries;
+    size_t  _head = 0;   // (Oldest.)
+    size_t  _count = 0;
+    quint64 _firstSeq = 1;
+
+    std::unique_ptr<char[]> _arena;
+    quint32 _arenaMask;
+    quint32 _arenaHead = 0, _arenaTail = 0;
+
+    // (Shared; whoever goes last takes it along.)
+    std::shared_ptr<StringInterner> _interner;
+
+public:
+    // (Without an interner, uses one of its own.
+    // Arena size gets rounded up to a power of two.)
+    explicit Scrollback(const std::shared_ptr<StringInterner> &interner = nullptr, int maxLines = defaultMaxLines,
+                        int arenaBytes = defaultMaxLines * averageLineBytes);
+    Scrollback(Scrollback &&other) = default;
+    ~Scrollback();
+
+    quint64 append(qint64 msecs, Kind kind, const QString &sender, const QString &text);
+    void clear();
+
+    int count() const;
+    int maxLines() const;
+    quint64 firstSeq() const;  // (Oldest line still there.)
+    quint64 endSeq() const;    // (Number the next line will get.)
+
+    bool entry(quint64 seq, Entry *entry) const;
+    QList<Entry> page(quint64 fromSeq, int maxCount) const;
+    QList<Entry> last(int maxCount) const;
+
+    // (Records plus arena; what the lines cost, give or take the interner.)
+    size_t memoryBytes() const;
+
+private:
+    void _releaseAll();
+    void _dropOldest();
+    Entry _unpack(size_t index) const;
+};
+
+#endif // SCROLLBACK_H
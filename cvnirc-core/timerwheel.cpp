@@ -0,0 +1,228 @@
+#include "timerwheel.h"
+
+#include <QPointer>
+#include <stdexcept>
+
+static const quint64 levelMask = TimerWheel::levelSlots - 1;
+static const quint64 maxTicksAhead = (quint64(1) << (TimerWheel::levels * TimerWheel::levelBits)) - 1;
+
+TimerWheel::TimerWheel(int tickMSecs, QObject *parent) : QObject(parent),
+    _tickMSecs(tickMSecs)
+{
+    if (tickMSecs <= 0)
+        throw std::invalid_argument("Timer wheel: Tick interval must be positive");
+
+    for (int &head : _heads)
+        head = -1;
+
+    _clock.start();
+    _wakeTimer.setSingleShot(true);
+    connect(&_wakeTimer, &QTimer::timeout, this, &TimerWheel::handle_wakeTimer_timeout);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(int delayMSecs, callback_type callback)
+{
+    if (!callback)
+        throw std::invalid_argument("Timer wheel, schedule: Callback can't be empty");
+
+    int index = _freeHead;
+    if (index >= 0) {
+        _freeHead = _nodes[index].next;
+    }
+    else {
+        index = int(_nodes.size());
+        _nodes.emplace_back();
+    }
+
+    const qint64 nowMSecs = _clock.elapsed();
+    if (_pendingCount == 0) {
+        // (Wheel stood still while empty; catch up without turning it.)
+        _currentTick = qMax(_currentTick, quint64(nowMSecs / _tickMSecs));
+    }
+
+    // (Round up, so that it's never early.)
+    const qint64 dueMSecs = nowMSecs + qMax(delayMSecs, 0);
+    const quint64 expiryTick = quint64((dueMSecs + _tickMSecs - 1) / _tickMSecs);
+
+    Node &node(_nodes[index]);
+    node.expiryTick = qMin(qMax(expiryTick, _currentTick), _currentTick + maxTicksAhead);
+    node.callback = std::move(callback);
+    _link(index);
+    _pendingCount++;
+
+    if (!_wakeTimer.isActive() || node.expiryTick < _wakeTick)
+        _scheduleWake();
+
+    return (TimerId(node.generation) << 32) | quint32(index + 1);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(int delayMSecs, QObject *context, callback_type callback)
+{
+    if (context == nullptr)
+        throw std::invalid_argument("Timer wheel, schedule: Context can't be null");
+
+    QPointer<QObject> guard(context);
+    return schedule(delayMSecs, [guard, callback]() {
+        if (guard)
+            callback();
+    });
+}
+
+void TimerWheel::cancel(TimerId id)
+{
+    const int index = _nodeIndex(id);
+    if (index < 0)
+        return;
+
+    _unlink(index);
+    _free(index);
+
+    if (_pendingCount == 0)
+        _wakeTimer.stop();
+}
+
+bool TimerWheel::isScheduled(TimerId id) const
+{
+    return _nodeIndex(id) >= 0;
+}
+
+int TimerWheel::pendingCount() const
+{
+    return _pendingCount;
+}
+
+int TimerWheel::tickMSecs() const
+{
+    return _tickMSecs;
+}
+
+void TimerWheel::handle_wakeTimer_timeout()
+{
+    // Catch up on all the ticks that have passed by now.
+    // (Usually one; but the event loop may have been busy, or the machine asleep.)
+    const quint64 nowTick = quint64(_clock.elapsed() / _tickMSecs);
+    while (_currentTick <= nowTick && _pendingCount > 0)
+        _processTick();
+
+    _scheduleWake();
+}
+
+int TimerWheel::_nodeIndex(TimerId id) const
+{
+    const int index = int(quint32(id)) - 1;
+    if (index < 0 || index >= int(_nodes.size()))
+        return -1;
+
+    const Node &node(_nodes[index]);
+    if (node.slot < 0 || node.generation != quint32(id >> 32))
+        return -1;
+
+    return index;
+}
+
+void TimerWheel::_link(int index)
+{
+    Node &node(_nodes[index]);
+
+    // Pick the finest level that reaches out far enough.
+    const quint64 ticksAhead = node.expiryTick - _currentTick;
+    int level = 0;
+    while (level < levels - 1 && ticksAhead >= (quint64(1) << ((level + 1) * levelBits)))
+        level++;
+    const int slot = level * levelSlots + int((node.expiryTick >> (level * levelBits)) & levelMask);
+
+    node.slot = slot;
+    node.prev = -1;
+    node.next = _heads[slot];
+    if (node.next >= 0)
+        _nodes[node.next].prev = index;
+    _heads[slot] = index;
+}
+
+void TimerWheel::_unlink(int index)
+{
+    Node &node(_nodes[index]);
+    if (node.prev >= 0)
+        _nodes[node.prev].next = node.next;
+    else
+        _heads[node.slot] = node.next;
+    if (node.next >= 0)
+        _nodes[node.next].prev = node.prev;
+
+    node.prev = node.next = -1;
+}
+
+void TimerWheel::_free(int index)
+{
+    Node &node(_nodes[index]);
+    node.callback = nullptr;
+    node.slot = -1;
+    node.generation++;  // (Invalidates outstanding ids.)
+    node.next = _freeHead;
+    _freeHead = index;
+    _pendingCount--;
+}
+
+void TimerWheel::_cascade(int level, int slot)
+{
+    const int head = level * levelSlots + slot;
+    int index = _heads[head];
+    _heads[head] = -1;
+
+    while (index >= 0) {
+        const int next = _nodes[index].next;
+        _link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::_processTick()
+{
+    const int slot = int(_currentTick & levelMask);
+
+    // Finer level wraps around: Distribute the next batch from the coarser one.
+    if (slot == 0) {
+        for (int level = 1; level < levels; level++) {
+            const int levelSlot = int((_currentTick >> (level * levelBits)) & levelMask);
+            _cascade(level, levelSlot);
+            if (levelSlot != 0)
+                break;
+        }
+    }
+
+    // Move the due timers aside, so that firing one may still cancel
+    // the others, and new ones (even for "now") land in a later tick.
+    int index = _heads[slot];
+    _heads[slot] = -1;
+    _heads[firingSlot] = index;
+    for (; index >= 0; index = _nodes[index].next)
+        _nodes[index].slot = firingSlot;
+
+    _currentTick++;
+
+    while ((index = _heads[firingSlot]) >= 0) {
+        _unlink(index);
+        const callback_type callback = std::move(_nodes[index].callback);
+        _free(index);
+        callback();
+    }
+}
+
+void TimerWheel::_scheduleWake()
+{
+    if (_pendingCount == 0) {
+        _wakeTimer.stop();
+        return;
+    }
+
+    // Next tick with something to do: A non-empty slot, or a cascade.
+    quint64 tick = _currentTick;
+    for (int i = 0; i < levelSlots; i++, tick++) {
+        if ((tick & levelMask) == 0 || _heads[tick & levelMask] >= 0)
+            break;
+    }
+
+    _wakeTick = tick;
+    const qint64 delayMSecs = qint64(_wakeTick) * _tickMSecs - _clock.elapsed();
+    _wakeTimer.start(int(qMax<qint64>(delayMSecs, 0)));
+}
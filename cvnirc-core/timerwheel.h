@@ -0,0 +1,83 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "cvnirc-core_global.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <functional>
+#include <vector>
+
+// Many coarse timers (think: several per connection), driven by a single QTimer.
+//
+// Hierarchical: Timers due within the next 64 ticks sit in the slot of
+// their tick; later ones sit in coarser levels of 64 slots each, and
+// cascade down a level whenever the finer level wraps around.
+// Scheduling and cancelling are O(1); timers live in a node pool and
+// are linked into their slot by index, so neither needs an allocation
+// once the pool is warm.
+class CVNIRCCORESHARED_EXPORT TimerWheel : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef quint64 TimerId;  // (0: No timer.)
+    typedef std::function<void()> callback_type;
+
+    static const int levelBits = 6;
+    static const int levelSlots = 1 << levelBits;
+    static const int levels = 4;  // (So, up to 2^24 ticks ahead.)
+
+private:
+    class Node
+    {
+    public:
+        quint64 expiryTick = 0;
+        callback_type callback;
+        int prev = -1, next = -1;
+        int slot = -1;  // (-1: Free.)
+        quint32 generation = 0;
+    };
+
+    // Slots of all levels, then the list of timers currently firing.
+    static const int firingSlot = levels * levelSlots;
+
+    QTimer _wakeTimer;
+    QElapsedTimer _clock;
+    int _tickMSecs;
+    quint64 _currentTick = 0;  // (Next tick to process.)
+    quint64 _wakeTick = 0;
+    std::vector<Node> _nodes;
+    int _freeHead = -1;
+    int _heads[firingSlot + 1];
+    int _pendingCount = 0;
+
+public:
+    explicit TimerWheel(int tickMSecs = 100, QObject *parent = 0);
+
+    // Runs callback once, after at least delayMSecs (rounded up to whole ticks).
+    TimerId schedule(int delayMSecs, callback_type callback);
+    // Same, but skipped if context got destroyed meanwhile.
+    TimerId schedule(int delayMSecs, QObject *context, callback_type callback);
+    // (Ignores timers that already fired or got cancelled.)
+    void cancel(TimerId id);
+    bool isScheduled(TimerId id) const;
+
+    int pendingCount() const;
+    int tickMSecs() const;
+
+private slots:
+    void handle_wakeTimer_timeout();
+
+private:
+    int _nodeIndex(TimerId id) const;
+    void _link(int index);
+    void _unlink(int index);
+    void _free(int index);
+    void _cascade(int level, int slot);
+    void _processTick();
+    void _scheduleWake();
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,70 @@
+#include "tlssessioncache.h"
+
+#include <stdexcept>
+
+TlsSessionCache::TlsSessionCache(int maxEntries, QObject *parent) : QObject(parent),
+    _maxEntries(maxEntries)
+{
+    if (maxEntries <= 0)
+        throw std::invalid_argument("TLS session cache: Maximum number of entries must be positive");
+}
+
+QByteArray TlsSessionCache::ticket(const QString &host, quint16 port)
+{
+    auto it = _tickets.constFind(_key(host, port));
+    if (it == _tickets.constEnd()) {
+        _misses++;
+        return QByteArray();
+    }
+
+    _hits++;
+    return it.value();
+}
+
+void TlsSessionCache::store(const QString &host, quint16 port, const QByteArray &ticket)
+{
+    if (ticket.isEmpty())
+        throw std::invalid_argument("TLS session cache, store: Ticket can't be empty");
+
+    const QString key = _key(host, port);
+    if (_tickets.contains(key))
+        _order.removeOne(key);
+    _tickets.insert(key, ticket);
+    _order.append(key);
+
+    while (_order.count() > _maxEntries)
+        _tickets.remove(_order.takeFirst());
+}
+
+void TlsSessionCache::remove(const QString &host, quint16 port)
+{
+    const QString key = _key(host, port);
+    if (_tickets.remove(key) > 0)
+        _order.removeOne(key);
+}
+
+void TlsSessionCache::clear()
+{
+    _tickets.clear();
+    _order.clear();
+}
+
+int TlsSessionCache::count() const
+{
+    return _tickets.count();
+}
+
+quint64 TlsSessionCache::hits() const
+{
+    return _hits;
+}
+
+quint64 TlsSessionCache::misses() const
+{
+    return _misses;
+}
+
+QString TlsSessionCache::_key(const QString &host, quint16 port)
+{
+    return host.toLower() + ":" + QString::number(port);
+}
@@ -0,0 +1,45 @@
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include "cvnirc-core_global.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// TLS session tickets per server (host name and port), so that
+// a reconnect can resume the session instead of doing the full
+// handshake again. Oldest entries get dropped beyond a maximum.
+class CVNIRCCORESHARED_EXPORT TlsSessionCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int defaultMaxEntries = 256;
+
+private:
+    QHash<QString, QByteArray> _tickets;
+    QList<QString> _order;  // (Oldest first.)
+    int _maxEntries;
+    quint64 _hits = 0, _misses = 0;
+
+public:
+    explicit TlsSessionCache(int maxEntries = defaultMaxEntries, QObject *parent = 0);
+
+    // (Null if there is none.)
+    QByteArray ticket(const QString &host, quint16 port);
+    void store(const QString &host, quint16 port, const QByteArray &ticket);
+    void remove(const QString &host, quint16 port);
+    void clear();
+
+    int count() const;
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    static QString _key(const QString &host, quint16 port);
+};
+
+#endif // TLSSESSIONCACHE_H
@@ -28,15 +28,20 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += main.cpp\
     mainwindow.cpp \
     connectdialog.cpp \
-    logbuffer.cpp
+    logbuffer.cpp \
+    timestampformatter.cpp \
+    searchpanel.cpp
 
 HEADERS += mainwindow.h \
     connectdialog.h \
-    logbuffer.h
+    logbuffer.h \
+    timestampformatter.h \
+    searchpanel.h
 
 FORMS += mainwindow.ui \
     connectdialog.ui \
-    logbuffer.ui
+    logbuffer.ui \
+    searchpanel.ui
 
 RESOURCES += \
     cvnirc-gui.qrc
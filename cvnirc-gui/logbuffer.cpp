@@ -1,15 +1,22 @@
 #include "logbuffer.h"
 #include "ui_logbuffer.h"
+#include "timestampformatter.h"
 
 #include <QDate>
+#include <QDateTime>
 #include <QMetaEnum>
 #include <stdexcept>
 
 LogBuffer::LogBuffer(QWidget *parent) :
     QWidget(parent),
+    _timestamps(TimestampFormatter::instance()),
     ui(new Ui::LogBuffer)
 {
     ui->setupUi(this);
+
+    // Timestamps are time-of-day only; so make the date known, too.
+    _appendDayMarker("Log started", _timestamps->currentDate());
+    connect(_timestamps, &TimestampFormatter::dayChanged, this, &LogBuffer::handle_timestamps_dayChanged);
 }
 
 LogBuffer::~LogBuffer()
@@ -34,11 +41,13 @@ void LogBuffer::addContext(IRCCoreContext *context)
     switch (_type) {
     case Type::General:
         connect(context, &IRCCoreContext::notifyUser, this, &LogBuffer::appendLine);
+        connect(context, &IRCCoreContext::highlighted, this, &LogBuffer::handle_ircContext_highlighted);
         break;
     case Type::Protocol:
         connect(context, &IRCCoreContext::sendingLine, this, &LogBuffer::appendSendingLine);
         connect(context, &IRCCoreContext::receivedLine, this, &LogBuffer::appendReceivedLine);
         connect(context, &IRCCoreContext::connectionStateChanged, this, &LogBuffer::handle_ircContext_connectionStateChanged);
+        context->ircProtoClient()->addRawLineObserver();
         break;
     }
 }
@@ -53,11 +62,13 @@ void LogBuffer::removeContext(IRCCoreContext *context)
 
     switch (_type) {
     case Type::Protocol:
+        context->ircProtoClient()->removeRawLineObserver();
         disconnect(context, &IRCCoreContext::connectionStateChanged, this, &LogBuffer::handle_ircContext_connectionStateChanged);
         disconnect(context, &IRCCoreContext::receivedLine, this, &LogBuffer::appendReceivedLine);
         disconnect(context, &IRCCoreContext::sendingLine, this, &LogBuffer::appendSendingLine);
         break;
     case Type::General:
+        disconnect(context, &IRCCoreContext::highlighted, this, &LogBuffer::handle_ircContext_highlighted);
         disconnect(context, &IRCCoreContext::notifyUser, this, &LogBuffer::appendLine);
         break;
     }
@@ -112,22 +123,49 @@ QString LogBuffer::_contextToStr(const IRCCoreContext *context)
 void LogBuffer::appendLine(const QString &line, IRCCoreContext *context)
 {
     // Prepend timestamp and context information, and append to logbuffer.
-    QDateTime ts = QDateTime::currentDateTime();
-    ui->textEdit->append("[" + ts.toString() + "] " + _contextToStr(context) + line);
+    // (The timestamp prefix is rendered once per second only.)
+    const QString &ts(_timestamps->prefix());
+    const QString contextStr = _contextToStr(context);
+    QString fullLine;
+    fullLine.reserve(ts.length() + contextStr.length() + line.length());
+    fullLine.append(ts).append(contextStr).append(line);
+    ui->textEdit->append(fullLine);
 
     // Support colored tabs.
     if (_activity < Activity::General)
         setActivity(Activity::General);
 }
 
+void LogBuffer::_appendDayMarker(const QString &what, const QDate &date)
+{
+    // (Don't go through appendLine(), as this is no activity.)
+    ui->textEdit->append("--- " + what + ": " + date.toString(Qt::ISODate) + " (" + date.toString() + ")");
+}
+
+void LogBuffer::appendHistory(const QList<Scrollback::Entry> &entries)
+{
+    if (entries.isEmpty())
+        return;
+
+    // (Full date and time, as it's not today's log.)
+    ui->textEdit->append("--- History from the chat log:");
+    for (const Scrollback::Entry &entry : entries)
+        ui->textEdit->append("[" + QDateTime::fromMSecsSinceEpoch(entry.msecs).toString("yyyy-MM-dd HH:mm:ss") + "] " +
+                             entry.toDisplayString());
+    ui->textEdit->append("--- End of history");
+}
+
 void LogBuffer::appendSendingLine(const QString &rawLine, IRCCoreContext *context)
 {
     return appendLine("< " + rawLine, context);
 }
 
-void LogBuffer::appendReceivedLine(const QString &rawLine, IRCCoreContext *context)
+void LogBuffer::appendReceivedLine(const QByteArray &rawLine, IRCCoreContext *context)
 {
-    return appendLine("> " + rawLine, context);
+    if (context == nullptr)
+        return appendLine("> " + QString::fromLatin1(rawLine.toPercentEncoding()), context);
+
+    return appendLine("> " + context->ircProtoClient()->rawLineToDisplay(rawLine), context);
 }
 
 void LogBuffer::handle_ircContext_connectionStateChanged(IRCCoreContext *context)
@@ -146,3 +184,13 @@ void LogBuffer::handle_ircContext_connectionStateChanged(IRCCoreContext *context
         , context
     );
 }
+
+void LogBuffer::handle_ircContext_highlighted()
+{
+    setActivity(Activity::Highlight);
+}
+
+void LogBuffer::handle_timestamps_dayChanged(const QDate &newDate)
+{
+    _appendDayMarker("Day changed", newDate);
+}
@@ -3,9 +3,12 @@
 
 #include <QWidget>
 #include <QList>
+#include <QDate>
 
 #include "irccore.h"
 
+class TimestampFormatter;
+
 namespace Ui {
 class LogBuffer;
 }
@@ -36,6 +39,7 @@ public:
 private:
     Type _type = Type::General;
     Activity _activity = Activity::None;
+    TimestampFormatter *_timestamps;
 
 public:
     explicit LogBuffer(QWidget *parent = 0);
@@ -57,15 +61,20 @@ signals:
 public slots:
     void appendLine(const QString &line, IRCCoreContext *context = nullptr);
     void appendSendingLine(const QString &rawLine, IRCCoreContext *context = nullptr);
-    void appendReceivedLine(const QString &rawLine, IRCCoreContext *context = nullptr);
+    void appendReceivedLine(const QByteArray &rawLine, IRCCoreContext *context = nullptr);
+    // Lines from an earlier session (like from the chat log); no activity.
+    void appendHistory(const QList<Scrollback::Entry> &entries);
 
 private slots:
     void handle_ircContext_connectionStateChanged(IRCCoreContext *context = nullptr);
+    void handle_ircContext_highlighted();
+    void handle_timestamps_dayChanged(const QDate &newDate);
 
 private:
     Ui::LogBuffer *ui;
 
     QString _contextToStr(const IRCCoreContext *context);
+    void _appendDayMarker(const QString &what, const QDate &date);
 };
 
 #endif // LOGBUFFER_H
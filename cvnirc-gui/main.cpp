@@ -1,10 +1,33 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+
+#include <stdio.h>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("canvon IRC client built-with-Qt-framework GUI (graphical user interface)");
+    parser.addHelpOption();
+
+    QCommandLineOption optLogDir("log-dir", "Keep chat logs in this directory (and show the last lines of a context's log in its new tab).", "dir");
+    if (!parser.addOption(optLogDir)) {
+        fputs("Failed to add option for logging\n", stderr);
+        return 1;
+    }
+
+    parser.process(a);
+
     MainWindow w;
+    if (parser.isSet(optLogDir)) {
+        QString errorString;
+        if (!w.irc().chatLog().start(parser.value(optLogDir), &errorString)) {
+            fprintf(stderr, "Can't log to \"%s\": %s\n", qPrintable(parser.value(optLogDir)), qPrintable(errorString));
+            return 1;
+        }
+    }
     w.show();
 
     return a.exec();
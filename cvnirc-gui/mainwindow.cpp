@@ -2,8 +2,13 @@
 #include "ui_mainwindow.h"
 #include "connectdialog.h"
 #include "irccorecommandgroup.h"
+#include "timestampformatter.h"
+#include "searchpanel.h"
 
 #include <QMetaEnum>
+#include <QLabel>
+#include <QDockWidget>
+#include <QApplication>
 #include <QFileInfo>
 #include <QDir>
 #include <QProcess>
@@ -18,8 +23,26 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     ui->setupUi(this);
 
+    // (The timestamps' day-change timer shares the connections' timer wheel.)
+    TimestampFormatter::instance()->setTimerWheel(&_irc.timerWheel());
+
+    // Lag of the current tab's connection, to the right of the status bar.
+    _lagLabel = new QLabel(this);
+    ui->statusBar->addPermanentWidget(_lagLabel);
+
     ui->logBufferProto->setType(LogBuffer::Type::Protocol);
 
+    // Searching the chat logs, in a dock that's hidden until asked for.
+    _searchPanel = new SearchPanel(&_irc, this);
+    _searchDock = new QDockWidget("Search Logs", this);
+    _searchDock->setObjectName("dockWidgetSearch");
+    _searchDock->setWidget(_searchPanel);
+    addDockWidget(Qt::BottomDockWidgetArea, _searchDock);
+    _searchDock->hide();
+    ui->menuWindow->addAction("Search &Logs", this, &MainWindow::handle_actionSearchLogs_triggered,
+                              QKeySequence("Ctrl+Shift+F"));
+    connect(_searchPanel, &SearchPanel::hitActivated, this, &MainWindow::handle_searchPanel_hitActivated);
+
     // Make some commands available to the user.
     _cmdLayer.rootCommandGroup().addSubGroup(new IRCCoreCommandGroup(&_irc, "IRC"));
     // TODO: Also register UI-specific commands.
@@ -49,6 +72,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
     updateState();
     updateSwitchToTabMenu();
+    updateLagDisplay();
 }
 
 MainWindow::~MainWindow()
@@ -113,42 +137,52 @@ void MainWindow::updateState()
         break;
     }
 
-    // Update tab names.
-    // N.B.: Skip Main tab.
-    for (int i = 1; i < ui->tabWidget->count(); i++) {
-        QWidget *w = ui->tabWidget->widget(i);
-        auto *logBuf = dynamic_cast<LogBuffer *>(w);
-        if (logBuf == nullptr) {
-            qDebug() << Q_FUNC_INFO << i << "This tab is not a LogBuffer!";
-            continue;
-        }
-
-        applyTabNameComponents(logBuf, tabNameComponents(*logBuf));
-    }
+    // (Tab names get updated per context, on disambiguatorChanged().)
 }
 
 void MainWindow::updateSwitchToTabMenu()
 {
-    auto &menu(*ui->menuSwitchToTab);
-    menu.clear();
-    for (int i = 0; i < ui->tabWidget->count(); i++) {
-        const QString tabName = ui->tabWidget->tabText(i);
-        const int num = i + 1;
-        const QString numStr = QString::number(num);
-        const QString actionText = (num < 10 ? "&" : "") + numStr + " - " + tabName;
-        const QKeySequence shortcut("Alt+" + numStr);
-
-        QAction *action = menu.addAction(actionText,
-            this, &MainWindow::handle_menuTab_triggered,
-            num < 10 ? QKeySequence("Alt+" + numStr)
-                     : num == 10 ? QKeySequence("Alt+0") : 0);
-        if (action == nullptr) {
-            qDebug() << Q_FUNC_INFO << "menu.addAction() failed, ignoring";
-            continue;
-        }
+    // Full rebuild; normally, entries get appended/updated one by one.
+    ui->menuSwitchToTab->clear();
+    _switchToTabActions.clear();
+    for (int i = 0; i < ui->tabWidget->count(); i++)
+        _appendSwitchToTabAction(i);
+}
 
-        action->setData(i);
+void MainWindow::_appendSwitchToTabAction(int index)
+{
+    if (index != _switchToTabActions.length()) {
+        qDebug() << Q_FUNC_INFO << "Tab index does not match menu entries, rebuilding menu";
+        updateSwitchToTabMenu();
+        return;
     }
+
+    const int num = index + 1;
+    QAction *action = ui->menuSwitchToTab->addAction(QString(),
+        this, &MainWindow::handle_menuTab_triggered,
+        num < 10 ? QKeySequence("Alt+" + QString::number(num))
+                 : num == 10 ? QKeySequence("Alt+0") : 0);
+    if (action == nullptr) {
+        qDebug() << Q_FUNC_INFO << "menu.addAction() failed, ignoring";
+        return;
+    }
+
+    action->setData(index);
+    _switchToTabActions.append(action);
+    _updateSwitchToTabAction(index);
+}
+
+void MainWindow::_updateSwitchToTabAction(int index)
+{
+    if (!(index >= 0 && index < _switchToTabActions.length()))
+        return;
+
+    const QString tabName = ui->tabWidget->tabText(index);
+    const int num = index + 1;
+    const QString numStr = QString::number(num);
+    const QString actionText = (num < 10 ? "&" : "") + numStr + " - " + tabName;
+
+    _switchToTabActions[index]->setText(actionText);
 }
 
 void MainWindow::switchToContextTab(IRCCoreContext *context)
@@ -170,18 +204,7 @@ void MainWindow::switchToContextTab(IRCCoreContext *context)
 
 QWidget *MainWindow::findTabWidgetForContext(IRCCoreContext *context)
 {
-    // (Start at index 1 to skip main logbuffer.)
-    for (int i = 1; i < ui->tabWidget->count(); i++) {
-        QWidget *w = ui->tabWidget->widget(i);
-        auto *logBuf = dynamic_cast<LogBuffer *>(w);
-        if (logBuf == nullptr)
-            continue;
-
-        if (logBuf->contexts().contains(context))
-            return w;
-    }
-
-    return nullptr;
+    return _tabsByContext.value(context, nullptr);
 }
 
 QWidget *MainWindow::openTabForContext(IRCCoreContext *context)
@@ -192,19 +215,36 @@ QWidget *MainWindow::openTabForContext(IRCCoreContext *context)
     QWidget *w = findTabWidgetForContext(context);
     if (w == nullptr) {
         auto *logBuf = new LogBuffer();
+        // (Before the context's new lines come in.)
+        if (_irc.chatLog().isLogging() && !context->logPath().isEmpty())
+            logBuf->appendHistory(_irc.chatLog().readLast(context->logPath(), _historyLines));
         logBuf->addContext(context);
         w = logBuf;
 
-        ui->tabWidget->addTab(w, "New tab");
+        int index = ui->tabWidget->addTab(w, "New tab");
+        _tabsByContext.insert(context, logBuf);
+        _appendSwitchToTabAction(index);
         applyTabNameComponents(logBuf, tabNameComponents(*logBuf));
 
         connect(logBuf, &LogBuffer::activityChanged, this, &MainWindow::handle_logBuffer_activityChanged);
-
-        updateSwitchToTabMenu();
+        connect(context, &IRCCoreContext::disambiguatorChanged, this, &MainWindow::handle_context_disambiguatorChanged);
     }
     return w;
 }
 
+void MainWindow::updateLagDisplay()
+{
+    IRCCoreContext *context = contextFromUI();
+    IRCProtoClient *client = context ? context->ircProtoClient() : nullptr;
+    const qint64 lagUSecs = client ? client->lagUSecs() : -1;
+    if (lagUSecs < 0) {
+        _lagLabel->clear();
+        return;
+    }
+
+    _lagLabel->setText("Lag: " + IRCProto::LagHistogram::formatUSecs(lagUSecs));
+}
+
 // Find out what's the current context.
 IRCCoreContext *MainWindow::contextFromUI()
 {
@@ -282,6 +322,7 @@ void MainWindow::applyTabNameComponents(LogBuffer *logBuf, const QStringList &co
 
     ui->tabWidget->setTabText(index, tabText);
     ui->tabWidget->setTabToolTip(index, tabToolTip);
+    _updateSwitchToTabAction(index);
 }
 
 void MainWindow::on_action_Quit_triggered()
@@ -364,10 +405,33 @@ void MainWindow::handle_irc_createdContext(IRCCoreContext *context)
                 this, &MainWindow::updateState);
         connect(context->ircProtoClient(), &IRCProtoClient::hostPortRequestedLastChanged,
                 this, &MainWindow::updateState);
+        connect(context->ircProtoClient(), &IRCProtoClient::lagChanged,
+                this, &MainWindow::updateLagDisplay);
     }
 
     // Allow the context to request focus.
     connect(context, &IRCCoreContext::focusWanted, this, &MainWindow::switchToContextTab);
+
+    connect(context, &IRCCoreContext::highlighted, this, &MainWindow::handle_context_highlighted);
+}
+
+void MainWindow::handle_context_disambiguatorChanged(IRCCoreContext *context)
+{
+    LogBuffer *logBuf = _tabsByContext.value(context, nullptr);
+    if (logBuf == nullptr) {
+        qDebug() << Q_FUNC_INFO << "No tab for this context";
+        return;
+    }
+
+    applyTabNameComponents(logBuf, tabNameComponents(*logBuf));
+}
+
+void MainWindow::handle_context_highlighted(const QString &line, IRCCoreContext *context)
+{
+    // (The tab turns red by itself; see LogBuffer. This is for when we're not looking.)
+    if (context != nullptr && contextFromUI() != context)
+        ui->statusBar->showMessage("Highlight in " + context->disambiguator() + ": " + line, 10000);
+    QApplication::alert(this);
 }
 
 void MainWindow::handle_menuTab_triggered()
@@ -401,6 +465,8 @@ void MainWindow::handle_tabWidget_currentChanged(int index)
         return;
     }
 
+    _searchPanel->setCurrentContext(contextFromUI());
+
     auto *logBuf = dynamic_cast<LogBuffer *>(ui->tabWidget->widget(index));
     if (logBuf == nullptr) {
         qDebug() << Q_FUNC_INFO << "New tab is not a LogBuffer";
@@ -409,6 +475,8 @@ void MainWindow::handle_tabWidget_currentChanged(int index)
 
     // Clear tab color when switching to a tab.
     logBuf->setActivity(LogBuffer::Activity::None);
+
+    updateLagDisplay();
 }
 
 void MainWindow::handle_logBuffer_activityChanged()
@@ -498,3 +566,25 @@ void MainWindow::handle_helpViewer_errorOccurred(QProcess::ProcessError err)
         + ": " + _helpViewer.errorString()
     );
 }
+
+void MainWindow::handle_actionSearchLogs_triggered()
+{
+    _searchDock->show();
+    _searchDock->raise();
+    _searchPanel->focusQuery();
+}
+
+void MainWindow::handle_searchPanel_hitActivated(const QString &contextPath, qint64 msecs)
+{
+    Q_UNUSED(msecs)
+
+    // (Only works for contexts that have a tab in this session.)
+    for (auto it = _tabsByContext.constBegin(); it != _tabsByContext.constEnd(); ++it) {
+        if (it.key()->logPath() == contextPath) {
+            switchToContextTab(it.key());
+            return;
+        }
+    }
+
+    ui->statusBar->showMessage("No tab open for " + ChatLog::contextDisplayName(contextPath), 5000);
+}
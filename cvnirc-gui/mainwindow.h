@@ -4,6 +4,8 @@
 #include <QMainWindow>
 #include <QStringList>
 #include <QProcess>
+#include <QHash>
+#include <QList>
 
 #include "irccore.h"
 #include "commandlayer.h"
@@ -13,6 +15,10 @@ class MainWindow;
 }
 
 class LogBuffer;
+class SearchPanel;
+class QAction;
+class QDockWidget;
+class QLabel;
 
 class MainWindow : public QMainWindow
 {
@@ -40,6 +46,7 @@ public:
 public slots:
     void updateState();
     void updateSwitchToTabMenu();
+    void updateLagDisplay();
     void switchToContextTab(IRCCoreContext *context);
 
 private slots:
@@ -49,19 +56,35 @@ private slots:
     void on_action_Disconnect_triggered();
     void on_actionFocusUserInput_triggered();
     void on_actionLocalOnlineHelp_triggered();
+    void handle_actionSearchLogs_triggered();
 
     void on_pushButtonUserInput_clicked();
 
     void handle_irc_createdContext(IRCCoreContext *context);
+    void handle_context_disambiguatorChanged(IRCCoreContext *context);
+    void handle_context_highlighted(const QString &line, IRCCoreContext *context);
     //void handle_irc_receivedMessage(IRCProtoMessage &msg);
     void handle_menuTab_triggered();
     void handle_tabWidget_currentChanged(int index);
     void handle_logBuffer_activityChanged();
     void handle_helpViewer_errorOccurred(QProcess::ProcessError err);
+    void handle_searchPanel_hitActivated(const QString &contextPath, qint64 msecs);
 
 private:
     Ui::MainWindow *ui;
     QString baseWindowTitle;
+    QLabel *_lagLabel;
+    int _historyLines = 100;  // (Loaded from the chat log into new tabs.)
+    SearchPanel *_searchPanel;
+    QDockWidget *_searchDock;
+
+    // Tab registry, so that a change to one context
+    // touches only its own tab and Switch-To-Tab menu entry.
+    QHash<IRCCoreContext *, LogBuffer *> _tabsByContext;
+    QList<QAction *> _switchToTabActions;  // (Indexed by tab index.)
+
+    void _appendSwitchToTabAction(int index);
+    void _updateSwitchToTabAction(int index);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,102 @@
+#include "searchpanel.h"
+#include "ui_searchpanel.h"
+
+#include <QDateTime>
+#include <stdexcept>
+
+enum HitRole {
+    ContextPathRole = Qt::UserRole,
+    MSecsRole,
+};
+
+SearchPanel::SearchPanel(IRCCore *irc, QWidget *parent) :
+    QWidget(parent),
+    _irc(irc),
+    ui(new Ui::SearchPanel)
+{
+    if (_irc == nullptr)
+        throw std::invalid_argument("SearchPanel ctor: IRCCore can't be null");
+
+    ui->setupUi(this);
+
+    connect(ui->lineEditQuery, &QLineEdit::returnPressed, this, &SearchPanel::search);
+    connect(ui->pushButtonSearch, &QPushButton::clicked, this, &SearchPanel::search);
+    connect(ui->listWidgetHits, &QListWidget::itemActivated, this, &SearchPanel::handle_listWidgetHits_itemActivated);
+    connect(&_searchWatcher, &QFutureWatcherBase::finished, this, &SearchPanel::handle_searchWatcher_finished);
+}
+
+SearchPanel::~SearchPanel()
+{
+    delete ui;
+}
+
+void SearchPanel::setCurrentContext(IRCCoreContext *context)
+{
+    _currentContext = context;
+}
+
+void SearchPanel::search()
+{
+    // (Forget about one still running.)
+    _searchWatcher.cancel();
+    ui->listWidgetHits->clear();
+
+    const ChatLog &chatLog(_irc->chatLog());
+    if (!chatLog.isLogging()) {
+        ui->labelStatus->setText("Not logging; start with /log start DIR, or --log-dir.");
+        return;
+    }
+
+    QStringList contextPaths;
+    if (ui->checkBoxHere->isChecked()) {
+        if (!_currentContext || _currentContext->logPath().isEmpty()) {
+            ui->labelStatus->setText("Current tab has no context to search.");
+            return;
+        }
+        contextPaths.append(_currentContext->logPath());
+    }
+
+    _searchTimer.start();
+    try {
+        _searchWatcher.setFuture(ChatSearch::searchInBackground(chatLog, ui->lineEditQuery->text(), contextPaths, maxHits));
+    }
+    catch (const std::exception &ex) {
+        ui->labelStatus->setText(ex.what());
+        return;
+    }
+    ui->labelStatus->setText("Searching...");
+}
+
+void SearchPanel::handle_searchWatcher_finished()
+{
+    if (_searchWatcher.isCanceled())
+        return;
+
+    const QList<ChatSearchHit> hits = _searchWatcher.result();
+    const qint64 msecs = _searchTimer.elapsed();
+
+    for (const ChatSearchHit &hit : hits) {
+        auto *item = new QListWidgetItem(
+            "[" + QDateTime::fromMSecsSinceEpoch(hit.entry.msecs).toString("yyyy-MM-dd HH:mm:ss") + "] " +
+            ChatLog::contextDisplayName(hit.contextPath) + ": " + hit.entry.toDisplayString(),
+            ui->listWidgetHits);
+        item->setData(ContextPathRole, hit.contextPath);
+        item->setData(MSecsRole, hit.entry.msecs);
+    }
+
+    ui->labelStatus->setText(QString::number(hits.count()) + " hits (best first), in " + QString::number(msecs) + " ms.");
+}
+
+void SearchPanel::focusQuery()
+{
+    ui->lineEditQuery->setFocus();
+    ui->lineEditQuery->selectAll();
+}
+
+void SearchPanel::handle_listWidgetHits_itemActivated(QListWidgetItem *item)
+{
+    if (item == nullptr)
+        return;
+
+    hitActivated(item->data(ContextPathRole).toString(), item->data(MSecsRole).toLongLong());
+}
@@ -0,0 +1,50 @@
+#ifndef SEARCHPANEL_H
+#define SEARCHPANEL_H
+
+#include <QWidget>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+
+#include "irccore.h"
+
+namespace Ui {
+class SearchPanel;
+}
+
+class QListWidgetItem;
+
+// Searches the core's chat logs; see ChatSearch.
+class SearchPanel : public QWidget
+{
+    Q_OBJECT
+    IRCCore *_irc;
+    QPointer<IRCCoreContext> _currentContext;
+    QFutureWatcher<QList<ChatSearchHit>> _searchWatcher;
+    QElapsedTimer _searchTimer;
+
+public:
+    static const int maxHits = 200;
+
+    explicit SearchPanel(IRCCore *irc, QWidget *parent = 0);
+    ~SearchPanel();
+
+    // (For "Current tab only".)
+    void setCurrentContext(IRCCoreContext *context);
+
+signals:
+    void hitActivated(const QString &contextPath, qint64 msecs);
+
+public slots:
+    void search();
+    void focusQuery();
+
+private slots:
+    void handle_listWidgetHits_itemActivated(QListWidgetItem *item);
+    void handle_searchWatcher_finished();
+
+private:
+    Ui::SearchPanel *ui;
+};
+
+#endif // SEARCHPANEL_H
@@ -0,0 +1,135 @@
+#include "timestampformatter.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <time.h>
+
+// Consult the (comparatively expensive) wall clock at least this often,
+// so that clock adjustments get picked up eventually.
+static const qint64 resyncIntervalMSecs = 60 * 1000;
+
+TimestampFormatter::TimestampFormatter(QObject *parent) : QObject(parent)
+{
+    _resync();
+    _currentDate = QDateTime::fromMSecsSinceEpoch(_wallclockBaseMSecs).date();
+}
+
+TimestampFormatter *TimestampFormatter::instance()
+{
+    // (Parented to the application, so it goes away together with it.)
+    static TimestampFormatter *shared = nullptr;
+    if (shared == nullptr)
+        shared = new TimestampFormatter(qApp);
+
+    return shared;
+}
+
+const QString &TimestampFormatter::prefix()
+{
+    qint64 nowMSecs = _nowMSecs();
+    if (nowMSecs / 1000 == _cachedSecs)
+        return _cachedPrefix;
+
+    // Only on a second boundary: Render anew, possibly re-reading the wall clock.
+    if (nowMSecs - _wallclockBaseMSecs >= resyncIntervalMSecs) {
+        _resync();
+        nowMSecs = _wallclockBaseMSecs;
+    }
+
+    const QDateTime ts = QDateTime::fromMSecsSinceEpoch(nowMSecs);
+    _cachedSecs = nowMSecs / 1000;
+    _cachedPrefix = "[" + ts.time().toString("HH:mm:ss") + "] ";
+
+    // (Do this last, as handlers will likely want a prefix, too.)
+    _checkDate(ts.date());
+
+    return _cachedPrefix;
+}
+
+const QDate &TimestampFormatter::currentDate() const
+{
+    return _currentDate;
+}
+
+void TimestampFormatter::setTimerWheel(TimerWheel *timerWheel)
+{
+    if (_dayChangeTimer != 0 && _timerWheel)
+        _timerWheel->cancel(_dayChangeTimer);
+    _dayChangeTimer = 0;
+
+    _timerWheel = timerWheel;
+    _scheduleDayChangeTimer();
+}
+
+void TimestampFormatter::_dayChangeTimeout()
+{
+    _dayChangeTimer = 0;
+
+    _resync();
+    _cachedSecs = -1;
+
+    const QDate date = QDateTime::fromMSecsSinceEpoch(_wallclockBaseMSecs).date();
+    if (date == _currentDate) {
+        // Woke up early (or the clock got adjusted); try again later.
+        _scheduleDayChangeTimer();
+        return;
+    }
+
+    _checkDate(date);
+}
+
+qint64 TimestampFormatter::_monotonicMSecs()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    // Millisecond-ish resolution is plenty for a per-second cache,
+    // and this one does not even need to leave user space.
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return qint64(ts.tv_sec) * 1000 + ts.tv_nsec / (1000 * 1000);
+#else
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+
+    return timer.elapsed();
+#endif
+}
+
+qint64 TimestampFormatter::_nowMSecs() const
+{
+    return _wallclockBaseMSecs + (_monotonicMSecs() - _monotonicBaseMSecs);
+}
+
+void TimestampFormatter::_resync()
+{
+    _monotonicBaseMSecs = _monotonicMSecs();
+    _wallclockBaseMSecs = QDateTime::currentMSecsSinceEpoch();
+}
+
+void TimestampFormatter::_checkDate(const QDate &date)
+{
+    if (date == _currentDate)
+        return;
+
+    _currentDate = date;
+    _scheduleDayChangeTimer();
+    dayChanged(_currentDate);
+}
+
+void TimestampFormatter::_scheduleDayChangeTimer()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const QDateTime nextMidnight(now.date().addDays(1), QTime(0, 0));
+
+    // Fire a bit after midnight, but at least once an hour,
+    // so that clock adjustments (e.g., DST, NTP) won't confuse us for long.
+    qint64 msecs = now.msecsTo(nextMidnight) + 500;
+    if (_dayChangeTimer != 0 && _timerWheel)
+        _timerWheel->cancel(_dayChangeTimer);
+    _dayChangeTimer = 0;
+    if (_timerWheel) {
+        _dayChangeTimer = _timerWheel->schedule(int(qBound<qint64>(1000, msecs, 60 * 60 * 1000)), this,
+                                                [this]() { _dayChangeTimeout(); });
+    }
+}
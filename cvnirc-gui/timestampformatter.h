@@ -0,0 +1,46 @@
+#ifndef TIMESTAMPFORMATTER_H
+#define TIMESTAMPFORMATTER_H
+
+#include <QObject>
+#include <QDate>
+#include <QString>
+#include <QPointer>
+#include "timerwheel.h"
+
+class TimestampFormatter : public QObject
+{
+    Q_OBJECT
+    qint64  _wallclockBaseMSecs = 0;  // Wall clock at _monotonicBaseMSecs.
+    qint64  _monotonicBaseMSecs = 0;
+    qint64  _cachedSecs = -1;
+    QString _cachedPrefix;
+    QDate   _currentDate;
+    QPointer<TimerWheel> _timerWheel;
+    TimerWheel::TimerId  _dayChangeTimer = 0;
+
+public:
+    explicit TimestampFormatter(QObject *parent = 0);
+
+    static TimestampFormatter *instance();
+
+    // Rendered "[HH:mm:ss] " prefix for the current second.
+    const QString &prefix();
+    const QDate &currentDate() const;
+
+    // Day changes get noticed while idle only with a timer wheel to wake us up.
+    void setTimerWheel(TimerWheel *timerWheel);
+
+signals:
+    void dayChanged(const QDate &newDate);
+
+private:
+    void _dayChangeTimeout();
+    static qint64 _monotonicMSecs();
+
+    qint64 _nowMSecs() const;
+    void _resync();
+    void _checkDate(const QDate &date);
+    void _scheduleDayChangeTimer();
+};
+
+#endif // TIMESTAMPFORMATTER_H
@@ -0,0 +1,110 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QHostAddress>
+#include <QSslSocket>
+#include "mockserver.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("canvon IRC client built-with-Qt-framework mock IRC server, for load testing");
+    parser.addHelpOption();
+
+    MockServer::Options options;
+    QCommandLineOption optListen({ "l", "listen" }, "Address to listen on.", "address", "127.0.0.1");
+    QCommandLineOption optPort({ "p", "port" }, "Port to listen on.", "port", "6667");
+    QCommandLineOption optChannels({ "c", "channels" }, "Number of channels (N).", "count", QString::number(options.channels));
+    QCommandLineOption optUsers({ "u", "users" }, "Number of users per channel (M).", "count", QString::number(options.users));
+    QCommandLineOption optRate({ "r", "rate" }, "PRIVMSGs per second, in total (X).", "count", QString::number(options.privmsgsPerSec));
+    QCommandLineOption optNames("names-interval", "Send NAMES bursts for all channels every this many milliseconds (0: off).", "msecs", "0");
+    QCommandLineOption optNetsplit("netsplit-interval", "Split off/rejoin half of the users every this many milliseconds (0: off).", "msecs", "0");
+    QCommandLineOption optPing("ping-interval", "Measure client latency via PING every this many milliseconds (0: off).", "msecs", QString::number(options.pingIntervalMSecs));
+    QCommandLineOption optStats("stats-interval", "Print statistics every this many milliseconds (0: off).", "msecs", QString::number(options.statsIntervalMSecs));
+    QCommandLineOption optSeed("seed", "Random seed, for reproducible load.", "number", QString::number(options.seed));
+    QCommandLineOption optTlsCert("tls-cert", "Speak TLS, with this certificate (PEM file).", "file");
+    QCommandLineOption optTlsKey("tls-key", "Private key for the TLS certificate (PEM file).", "file");
+    for (const QCommandLineOption &option : { optListen, optPort, optChannels, optUsers, optRate, optNames, optNetsplit, optPing, optStats, optSeed, optTlsCert, optTlsKey }) {
+        if (!parser.addOption(option)) {
+            fputs("Failed to add options\n", stderr);
+            return 1;
+        }
+    }
+
+    parser.process(a);
+
+    bool ok = true;
+    auto intValue = [&](const QCommandLineOption &option) {
+        bool valueOk = false;
+        int value = parser.value(option).toInt(&valueOk);
+        if (!valueOk || value < 0)
+            ok = false;
+        return value;
+    };
+    options.channels = intValue(optChannels);
+    options.users = intValue(optUsers);
+    options.namesBurstIntervalMSecs = intValue(optNames);
+    options.netsplitIntervalMSecs = intValue(optNetsplit);
+    options.pingIntervalMSecs = intValue(optPing);
+    options.statsIntervalMSecs = intValue(optStats);
+    options.seed = unsigned(intValue(optSeed));
+    const int port = intValue(optPort);
+    bool rateOk = false;
+    options.privmsgsPerSec = parser.value(optRate).toDouble(&rateOk);
+    if (!ok || !rateOk || options.privmsgsPerSec < 0 || port > 65535) {
+        fputs("Invalid option value\n", stderr);
+        return 1;
+    }
+
+    QHostAddress address;
+    if (!address.setAddress(parser.value(optListen))) {
+        fputs("Invalid listen address\n", stderr);
+        return 1;
+    }
+
+    if (parser.isSet(optTlsCert) != parser.isSet(optTlsKey)) {
+        fputs("TLS needs both certificate and key\n", stderr);
+        return 1;
+    }
+    if (parser.isSet(optTlsCert)) {
+        if (!QSslSocket::supportsSsl()) {
+            fputs("TLS is not available (no SSL library found)\n", stderr);
+            return 1;
+        }
+
+        QFile certFile(parser.value(optTlsCert)), keyFile(parser.value(optTlsKey));
+        if (!certFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly)) {
+            fputs("Can't read TLS certificate or key file\n", stderr);
+            return 1;
+        }
+
+        options.tlsCertificate = QSslCertificate(certFile.readAll(), QSsl::Pem);
+        const QByteArray keyPem = keyFile.readAll();
+        for (QSsl::KeyAlgorithm algorithm : { QSsl::Rsa, QSsl::Ec }) {
+            options.tlsKey = QSslKey(keyPem, algorithm, QSsl::Pem);
+            if (!options.tlsKey.isNull())
+                break;
+        }
+        if (options.tlsCertificate.isNull() || options.tlsKey.isNull()) {
+            fputs("Invalid TLS certificate or key\n", stderr);
+            return 1;
+        }
+    }
+
+    MockServer server(options);
+    if (!server.listen(address, quint16(port))) {
+        fprintf(stderr, "Can't listen: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+
+    printf("Listening on %s port %d%s: %d channels, %d users, %g PRIVMSG/s\n",
+           qPrintable(address.toString()), port, options.tlsCertificate.isNull() ? "" : " (TLS)",
+           options.channels, options.users, options.privmsgsPerSec);
+    fflush(stdout);
+
+    return a.exec();
+}
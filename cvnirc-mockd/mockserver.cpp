@@ -0,0 +1,354 @@
+#include "mockserver.h"
+
+#include <QSslSocket>
+#include <QTcpSocket>
+#include <stdio.h>
+
+using namespace cvnirc::core::IRCProto;
+
+// (Drive load generation at this granularity.)
+static const int loadTickMSecs = 10;
+
+MockTcpServer::MockTcpServer(QObject *parent) : QTcpServer(parent)
+{
+}
+
+void MockTcpServer::incomingConnection(qintptr socketDescriptor)
+{
+    if (tlsCertificate.isNull()) {
+        QTcpServer::incomingConnection(socketDescriptor);
+        return;
+    }
+
+    auto *socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+
+    socket->setLocalCertificate(tlsCertificate);
+    socket->setPrivateKey(tlsKey);
+    addPendingConnection(socket);
+    socket->startServerEncryption();
+}
+
+MockServer::MockServer(const Options &options, QObject *parent) : QObject(parent),
+    _options(options),
+    _random(options.seed)
+{
+    _server.tlsCertificate = _options.tlsCertificate;
+    _server.tlsKey = _options.tlsKey;
+    connect(&_server, &QTcpServer::newConnection, this, &MockServer::handle_server_newConnection);
+
+    connect(&_loadTimer, &QTimer::timeout, this, &MockServer::handle_loadTimer_timeout);
+    connect(&_namesTimer, &QTimer::timeout, this, &MockServer::handle_namesTimer_timeout);
+    connect(&_netsplitTimer, &QTimer::timeout, this, &MockServer::handle_netsplitTimer_timeout);
+    connect(&_pingTimer, &QTimer::timeout, this, &MockServer::handle_pingTimer_timeout);
+    connect(&_statsTimer, &QTimer::timeout, this, &MockServer::handle_statsTimer_timeout);
+
+    _clock.start();
+    _lastLoadNSecs = _clock.nsecsElapsed();
+
+    if (_options.privmsgsPerSec > 0)
+        _loadTimer.start(loadTickMSecs);
+    if (_options.namesBurstIntervalMSecs > 0)
+        _namesTimer.start(_options.namesBurstIntervalMSecs);
+    if (_options.netsplitIntervalMSecs > 0)
+        _netsplitTimer.start(_options.netsplitIntervalMSecs);
+    if (_options.pingIntervalMSecs > 0)
+        _pingTimer.start(_options.pingIntervalMSecs);
+    if (_options.statsIntervalMSecs > 0)
+        _statsTimer.start(_options.statsIntervalMSecs);
+}
+
+bool MockServer::listen(const QHostAddress &address, quint16 port)
+{
+    return _server.listen(address, port);
+}
+
+QString MockServer::errorString() const
+{
+    return _server.errorString();
+}
+
+void MockServer::handle_server_newConnection()
+{
+    while (QTcpSocket *socket = _server.nextPendingConnection()) {
+        _clients.insert(socket, Client());
+        connect(socket, &QIODevice::readyRead, this, &MockServer::handle_client_readyRead);
+        connect(socket, &QAbstractSocket::disconnected, this, &MockServer::handle_client_disconnected);
+        printf("Client connected from %s\n", qPrintable(socket->peerAddress().toString()));
+
+        auto *sslSocket = qobject_cast<QSslSocket *>(socket);
+        if (sslSocket != nullptr) {
+            _clients[socket].tlsHandshakeStartNSecs = _clock.nsecsElapsed();
+            connect(sslSocket, &QSslSocket::encrypted, this, &MockServer::handle_client_encrypted);
+            typedef void (QSslSocket::*sslErrors_signal_type)(const QList<QSslError> &);
+            connect(sslSocket, static_cast<sslErrors_signal_type>(&QSslSocket::sslErrors),
+                    this, &MockServer::handle_client_sslErrors);
+        }
+    }
+}
+
+void MockServer::handle_client_encrypted()
+{
+    auto *socket = qobject_cast<QSslSocket *>(sender());
+    if (socket == nullptr || !_clients.contains(socket))
+        return;
+
+    const qint64 nsecs = _clock.nsecsElapsed() - _clients[socket].tlsHandshakeStartNSecs;
+    printf("TLS handshake with %s done in %.2f ms (%s)\n",
+           qPrintable(socket->peerAddress().toString()), nsecs / 1e6,
+           qPrintable(socket->sessionCipher().name()));
+}
+
+void MockServer::handle_client_sslErrors(const QList<QSslError> &errors)
+{
+    for (const QSslError &error : errors)
+        printf("TLS error: %s\n", qPrintable(error.errorString()));
+}
+
+void MockServer::handle_client_readyRead()
+{
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
+    if (socket == nullptr || !_clients.contains(socket))
+        return;
+
+    Client &client(_clients[socket]);
+    client.framer.append(socket->readAll());
+
+    MessageOnNetwork raw;
+    while (client.framer.takeLine(&raw)) {
+        _linesReceived++;
+        _receivedLine(socket, &client, raw.bytes);
+    }
+
+    if (client.framer.error() != LineFramer::Error::None) {
+        printf("Client sent broken framing, disconnecting\n");
+        socket->disconnectFromHost();
+    }
+}
+
+void MockServer::handle_client_disconnected()
+{
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
+    if (socket == nullptr)
+        return;
+
+    printf("Client %s disconnected\n", _clients.value(socket).nick.constData());
+    _clients.remove(socket);
+    socket->deleteLater();
+}
+
+void MockServer::_receivedLine(QTcpSocket *socket, Client *client, const QByteArray &line)
+{
+    const MessageAsTokens msgTokens = MessageOnNetwork { line }.parse();
+    const QByteArrayList &tokens(msgTokens.mainTokens);
+    if (tokens.isEmpty())
+        return;
+
+    const QByteArray command = tokens[0].toUpper();
+    const QByteArray &server(_options.serverName);
+
+    if (command == "NICK" && tokens.length() >= 2) {
+        if (client->registered)
+            _sendLine(socket, ":" + client->nick + "!mock@mock.invalid NICK :" + tokens[1]);
+        client->nick = tokens[1];
+        if (!client->registered && client->hasUser)
+            _register(socket, client);
+    }
+    else if (command == "USER") {
+        client->hasUser = true;
+        if (!client->registered && !client->nick.isEmpty())
+            _register(socket, client);
+    }
+    else if (command == "PING") {
+        _sendLine(socket, ":" + server + " PONG " + server + " :" + tokens.value(1));
+    }
+    else if (command == "PONG") {
+        if (!client->pendingPingToken.isNull() && tokens.last() == client->pendingPingToken) {
+            const qint64 latency = _clock.nsecsElapsed() - client->pendingPingNSecs;
+            _pongs++;
+            _pongLatencySumNSecs += latency;
+            _pongLatencyMaxNSecs = qMax(_pongLatencyMaxNSecs, latency);
+            client->pendingPingToken.clear();
+        }
+    }
+    else if (!client->registered) {
+        _sendLine(socket, ":" + server + " 451 * :You have not registered");
+    }
+    else if (command == "JOIN" && tokens.length() >= 2) {
+        for (const QByteArray &channel : tokens[1].split(',')) {
+            _sendLine(socket, ":" + client->nick + "!mock@mock.invalid JOIN " + channel);
+            _sendNames(socket, *client, channel);
+        }
+    }
+    else if (command == "PART" && tokens.length() >= 2) {
+        _sendLine(socket, ":" + client->nick + "!mock@mock.invalid PART " + tokens[1]);
+    }
+    else if (command == "PRIVMSG" || command == "NOTICE") {
+        // (Nobody's listening.)
+    }
+    else if (command == "QUIT") {
+        _sendLine(socket, "ERROR :Closing link (Quit)");
+        socket->disconnectFromHost();
+    }
+    else {
+        _sendLine(socket, ":" + server + " 421 " + client->nick + " " + tokens[0] + " :Unknown command");
+    }
+}
+
+void MockServer::_register(QTcpSocket *socket, Client *client)
+{
+    client->registered = true;
+    const QByteArray &server(_options.serverName);
+    _sendLine(socket, ":" + server + " 001 " + client->nick + " :Welcome to the cvnirc mock network " + client->nick);
+
+    // Put the client into all the load channels right away.
+    for (int i = 0; i < _options.channels; i++) {
+        const QByteArray channel = _channelName(i);
+        _sendLine(socket, ":" + client->nick + "!mock@mock.invalid JOIN " + channel);
+        _sendNames(socket, *client, channel);
+    }
+
+    printf("Client %s registered\n", client->nick.constData());
+}
+
+void MockServer::_sendLine(QTcpSocket *socket, const QByteArray &line)
+{
+    QByteArray bytes;
+    bytes.reserve(line.length() + 2);
+    bytes.append(line).append("\r\n");
+    socket->write(bytes);
+
+    _linesSent++;
+    _bytesSent += bytes.length();
+}
+
+void MockServer::_broadcast(const QByteArray &line)
+{
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        if (it.value().registered)
+            _sendLine(it.key(), line);
+    }
+}
+
+void MockServer::_sendNames(QTcpSocket *socket, const Client &client, const QByteArray &channel)
+{
+    const QByteArray intro = ":" + _options.serverName + " 353 " + client.nick + " = " + channel + " :";
+    QByteArray line = intro + client.nick;
+    const int users = _activeUsers();
+    for (int i = 0; i < users; i++) {
+        const QByteArray nick = "user" + QByteArray::number(i);
+        if (line.length() + 1 + nick.length() > 400) {
+            _sendLine(socket, line);
+            line = intro + nick;
+        }
+        else {
+            line.append(' ').append(nick);
+        }
+    }
+    _sendLine(socket, line);
+    _sendLine(socket, ":" + _options.serverName + " 366 " + client.nick + " " + channel + " :End of /NAMES list.");
+}
+
+void MockServer::handle_loadTimer_timeout()
+{
+    const qint64 nowNSecs = _clock.nsecsElapsed();
+    _privmsgBacklog += _options.privmsgsPerSec * (nowNSecs - _lastLoadNSecs) / 1e9;
+    _lastLoadNSecs = nowNSecs;
+
+    // (Don't try to catch up for more than a second's worth.)
+    _privmsgBacklog = qMin(_privmsgBacklog, qMax(_options.privmsgsPerSec, 1.0));
+
+    const int users = _activeUsers();
+    if (users <= 0 || _options.channels <= 0)
+        return;
+
+    std::uniform_int_distribution<int> userDist(0, users - 1);
+    std::uniform_int_distribution<int> channelDist(0, _options.channels - 1);
+    while (_privmsgBacklog >= 1) {
+        _privmsgBacklog -= 1;
+        _broadcast(_userPrefix(userDist(_random)) + " PRIVMSG " + _channelName(channelDist(_random)) +
+                   " :synthetic message " + QByteArray::number(++_privmsgSeq) + ", the quick brown fox jumps over the lazy dog");
+    }
+}
+
+void MockServer::handle_namesTimer_timeout()
+{
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        if (!it.value().registered)
+            continue;
+
+        for (int i = 0; i < _options.channels; i++)
+            _sendNames(it.key(), it.value(), _channelName(i));
+    }
+}
+
+void MockServer::handle_netsplitTimer_timeout()
+{
+    // Alternate between splitting off the second half of the users, and healing.
+    const int first = qMax(_options.users / 2, 1);
+    if (!_split) {
+        _split = true;
+        for (int i = first; i < _options.users; i++)
+            _broadcast(_userPrefix(i) + " QUIT :*.net *.split");
+        printf("Netsplit: %d users gone\n", _options.users - first);
+    }
+    else {
+        _split = false;
+        for (int i = first; i < _options.users; i++) {
+            for (int j = 0; j < _options.channels; j++)
+                _broadcast(_userPrefix(i) + " JOIN " + _channelName(j));
+        }
+        printf("Netsplit healed: %d users back\n", _options.users - first);
+    }
+}
+
+void MockServer::handle_pingTimer_timeout()
+{
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        Client &client(it.value());
+        if (!client.registered || !client.pendingPingToken.isNull())
+            continue;
+
+        // (The answer queues up behind everything sent before,
+        // so this measures how far the client is behind.)
+        client.pendingPingNSecs = _clock.nsecsElapsed();
+        client.pendingPingToken = "mockd-" + QByteArray::number(client.pendingPingNSecs);
+        _sendLine(it.key(), "PING :" + client.pendingPingToken);
+    }
+}
+
+void MockServer::handle_statsTimer_timeout()
+{
+    const double secs = _options.statsIntervalMSecs / 1000.0;
+    qint64 maxBacklog = 0;
+    for (auto it = _clients.constBegin(); it != _clients.constEnd(); ++it)
+        maxBacklog = qMax(maxBacklog, it.key()->bytesToWrite());
+
+    printf("%d clients; sent %.0f lines/s (%.1f KiB/s), received %.0f lines/s; "
+           "PONG latency avg %.2f ms, max %.2f ms (%llu); send backlog max %.1f KiB\n",
+           _clients.count(), _linesSent / secs, _bytesSent / secs / 1024, _linesReceived / secs,
+           _pongs ? _pongLatencySumNSecs / 1e6 / _pongs : 0.0, _pongLatencyMaxNSecs / 1e6,
+           static_cast<unsigned long long>(_pongs), maxBacklog / 1024.0);
+    fflush(stdout);
+
+    _linesSent = _bytesSent = _linesReceived = _pongs = 0;
+    _pongLatencySumNSecs = _pongLatencyMaxNSecs = 0;
+}
+
+int MockServer::_activeUsers() const
+{
+    return _split ? qMin(qMax(_options.users / 2, 1), _options.users) : _options.users;
+}
+
+QByteArray MockServer::_channelName(int i) const
+{
+    return "#load" + QByteArray::number(i);
+}
+
+QByteArray MockServer::_userPrefix(int i) const
+{
+    return ":user" + QByteArray::number(i) + "!mock@mock.invalid";
+}
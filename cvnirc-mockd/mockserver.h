@@ -0,0 +1,121 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QTcpServer>
+#include <QTimer>
+#include <random>
+#include "ircprotomessage.h"
+
+class QTcpSocket;
+class QSslError;
+
+// Hands out QSslSockets that are starting server-side encryption,
+// if given a certificate; plain sockets otherwise.
+class MockTcpServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    QSslCertificate tlsCertificate;
+    QSslKey tlsKey;
+
+    explicit MockTcpServer(QObject *parent = 0);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+};
+
+// Speaks just enough IRC to register clients and keep them busy
+// with synthetic channel traffic.
+class MockServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    class Options
+    {
+    public:
+        QByteArray serverName = "mockd.invalid";
+        int    channels = 10;
+        int    users = 100;
+        double privmsgsPerSec = 100;
+        int    namesBurstIntervalMSecs = 0;  // (0: Off.)
+        int    netsplitIntervalMSecs = 0;    // (0: Off.)
+        int    pingIntervalMSecs = 1000;     // (For measuring latency; 0: Off.)
+        int    statsIntervalMSecs = 5000;
+        unsigned seed = 1;
+        QSslCertificate tlsCertificate;  // (Null: Plain TCP.)
+        QSslKey tlsKey;
+    };
+
+private:
+    class Client
+    {
+    public:
+        cvnirc::core::IRCProto::LineFramer framer;
+        QByteArray nick;
+        bool hasUser = false;
+        bool registered = false;
+        QByteArray pendingPingToken;
+        qint64     pendingPingNSecs = 0;
+        qint64     tlsHandshakeStartNSecs = 0;
+    };
+
+    Options _options;
+    MockTcpServer _server;
+    QHash<QTcpSocket *, Client> _clients;
+
+    QTimer _loadTimer;
+    QTimer _namesTimer;
+    QTimer _netsplitTimer;
+    QTimer _pingTimer;
+    QTimer _statsTimer;
+    QElapsedTimer _clock;
+    qint64 _lastLoadNSecs = 0;
+    double _privmsgBacklog = 0;
+    quint64 _privmsgSeq = 0;
+    std::mt19937 _random;
+    bool _split = false;  // (Whether the second half of the users is gone.)
+
+    // Statistics, since the last report.
+    quint64 _linesSent = 0, _bytesSent = 0, _linesReceived = 0;
+    quint64 _pongs = 0;
+    qint64  _pongLatencySumNSecs = 0, _pongLatencyMaxNSecs = 0;
+
+public:
+    explicit MockServer(const Options &options, QObject *parent = 0);
+
+    bool listen(const QHostAddress &address, quint16 port);
+    QString errorString() const;
+
+private slots:
+    void handle_server_newConnection();
+    void handle_client_readyRead();
+    void handle_client_disconnected();
+    void handle_client_encrypted();
+    void handle_client_sslErrors(const QList<QSslError> &errors);
+    void handle_loadTimer_timeout();
+    void handle_namesTimer_timeout();
+    void handle_netsplitTimer_timeout();
+    void handle_pingTimer_timeout();
+    void handle_statsTimer_timeout();
+
+private:
+    void _receivedLine(QTcpSocket *socket, Client *client, const QByteArray &line);
+    void _register(QTcpSocket *socket, Client *client);
+    void _sendLine(QTcpSocket *socket, const QByteArray &line);
+    void _broadcast(const QByteArray &line);
+    void _sendNames(QTcpSocket *socket, const Client &client, const QByteArray &channel);
+
+    int _activeUsers() const;
+    QByteArray _channelName(int i) const;
+    QByteArray _userPrefix(int i) const;
+};
+
+#endif // MOCKSERVER_H
@@ -4,9 +4,17 @@ SUBDIRS += \
     cvnirc-core \
     cvnirc-gui \
     cvnirc-cli \
+    cvnirc-bench \
+    cvnirc-capture \
+    cvnirc-mockd \
+    cvnirc-bnc \
     doc
 
 cvnirc-gui.depends = cvnirc-core
 cvnirc-cli.depends = cvnirc-core
+cvnirc-bench.depends = cvnirc-core
+cvnirc-capture.depends = cvnirc-core
+cvnirc-mockd.depends = cvnirc-core
+cvnirc-bnc.depends = cvnirc-core
 
 VERSION = 0.5.10
@@ -16,3 +16,10 @@ if(lessThan(QT_MAJOR_VERSION,5)|equals(QT_MAJOR_VERSION,5):lessThan(QT_MINOR_VER
     message(Qt version: $$[QT_VERSION])
 }
 else: DEFINES += CVN_HAVE_QPROCESS_ERROROCCURRED
+
+if(lessThan(QT_MAJOR_VERSION,5)|equals(QT_MAJOR_VERSION,5):lessThan(QT_MINOR_VERSION,15)) {
+    # DEFINES -= CVN_HAVE_QSSLSOCKET_NEWSESSIONTICKETRECEIVED
+    warning("The Qt version is too old; it does not support QSslSocket signal newSessionTicketReceived() (new in Qt 5.15). TLS 1.3 sessions will not be resumed!")
+    message(Qt version: $$[QT_VERSION])
+}
+else: DEFINES += CVN_HAVE_QSSLSOCKET_NEWSESSIONTICKETRECEIVED